@@ -0,0 +1,375 @@
+/*
+ *  Benchmark of the table-driven and direct-coded L scanners.
+ *
+ *  Generates a synthetic L corpus (functions with declarations, loops,
+ *  expressions, strings and comments), checks that both scanners return the
+ *  same tokens, then times several passes of each one.  The direct-coded
+ *  scanner is timed with every skip kernel the CPU supports.  Last, random
+ *  small edits are applied to the token stream of the corpus, and checked
+ *  against a full relex.
+ *
+ *  Usage: L_bench [megabytes] [passes]
+ */
+
+#include "L_incremental.h"
+#include "L_lexer.h"
+#include "L_skip.h"
+#include "L_token_stream.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_MEGABYTES 64
+#define DEFAULT_PASSES    5
+#define N_EDITS           10000
+
+typedef Token (*NextToken) (Lexer * const p_lexer);
+
+typedef struct
+{
+  char   * data;
+  size_t   len;
+  size_t   cap;
+  uint64_t seed;
+} Corpus;
+
+static uint32_t corpus_random (Corpus * const p_corpus, uint32_t n)
+{
+  // xorshift64*.
+  p_corpus->seed ^= p_corpus->seed >> 12;
+  p_corpus->seed ^= p_corpus->seed << 25;
+  p_corpus->seed ^= p_corpus->seed >> 27;
+  return (uint32_t)((p_corpus->seed * 2685821657736338717ULL) >> 32) % n;
+}
+
+static void corpus_add (Corpus * const p_corpus, const char *s)
+{
+  const size_t len = strlen(s);
+  if (p_corpus->len + len < p_corpus->cap)
+  {
+    memcpy(p_corpus->data + p_corpus->len, s, len);
+    p_corpus->len += len;
+  }
+}
+
+static void corpus_add_ident (Corpus * const p_corpus)
+{
+  static const char * const words [] =
+  {
+    "count", "index", "value", "total", "node", "left", "right", "size",
+    "buffer", "result", "x", "y", "i", "j", "next_item", "is_done"
+  };
+  char ident[32];
+
+  snprintf(ident, sizeof(ident), "%s%u",
+           words[corpus_random(p_corpus, sizeof(words) / sizeof(words[0]))],
+           corpus_random(p_corpus, 100));
+  corpus_add(p_corpus, ident);
+}
+
+static void corpus_add_expr (Corpus * const p_corpus, int depth)
+{
+  static const char * const ops [] =
+  {
+    " + ", " - ", " * ", " / ", " % ", " == ", " != ", " < ", " <= ",
+    " > ", " >= ", " && ", " || "
+  };
+  char number[16];
+
+  switch (corpus_random(p_corpus, depth > 2 ? 2 : 5))
+  {
+    case 0:
+      corpus_add_ident(p_corpus);
+      break;
+    case 1:
+      snprintf(number, sizeof(number), "%u", corpus_random(p_corpus, 100000));
+      corpus_add(p_corpus, number);
+      break;
+    case 2:
+      corpus_add(p_corpus, "(");
+      corpus_add_expr(p_corpus, depth + 1);
+      corpus_add(p_corpus, ")");
+      break;
+    case 3:
+      corpus_add_ident(p_corpus);
+      corpus_add(p_corpus, "(");
+      corpus_add_expr(p_corpus, depth + 1);
+      corpus_add(p_corpus, ", ");
+      corpus_add_expr(p_corpus, depth + 1);
+      corpus_add(p_corpus, ")");
+      break;
+    default:
+      corpus_add_expr(p_corpus, depth + 1);
+      corpus_add(p_corpus, ops[corpus_random(p_corpus,
+                                             sizeof(ops) / sizeof(ops[0]))]);
+      corpus_add_expr(p_corpus, depth + 1);
+      break;
+  }
+}
+
+static void corpus_add_statement (Corpus * const p_corpus)
+{
+  switch (corpus_random(p_corpus, 6))
+  {
+    case 0:
+      corpus_add(p_corpus, "    let ");
+      corpus_add_ident(p_corpus);
+      corpus_add(p_corpus, " = ");
+      corpus_add_expr(p_corpus, 0);
+      corpus_add(p_corpus, ";\n");
+      break;
+    case 1:
+      corpus_add(p_corpus, "    while (");
+      corpus_add_expr(p_corpus, 0);
+      corpus_add(p_corpus, ") {\n        ");
+      corpus_add_ident(p_corpus);
+      corpus_add(p_corpus, " = ");
+      corpus_add_expr(p_corpus, 0);
+      corpus_add(p_corpus, ";\n    }\n");
+      break;
+    case 2:
+      corpus_add(p_corpus, "    if (");
+      corpus_add_expr(p_corpus, 0);
+      corpus_add(p_corpus, ") { return true; } else { return false; }\n");
+      break;
+    case 3:
+      corpus_add(p_corpus, "    // ");
+      corpus_add_ident(p_corpus);
+      corpus_add(p_corpus, " is updated below, see the notes.\n");
+      break;
+    case 4:
+      corpus_add(p_corpus, "    print(\"value of ");
+      corpus_add_ident(p_corpus);
+      corpus_add(p_corpus, ": \\\"\", ");
+      corpus_add_ident(p_corpus);
+      corpus_add(p_corpus, "[");
+      corpus_add_expr(p_corpus, 0);
+      corpus_add(p_corpus, "]);\n");
+      break;
+    default:
+      corpus_add(p_corpus, "    ");
+      corpus_add_ident(p_corpus);
+      corpus_add(p_corpus, " = ");
+      corpus_add_expr(p_corpus, 0);
+      corpus_add(p_corpus, ";\n");
+      break;
+  }
+}
+
+static bool corpus_generate (Corpus * const p_corpus, size_t size)
+{
+  p_corpus->cap = size + 1;
+  p_corpus->len = 0;
+  p_corpus->seed = 0x9e3779b97f4a7c15ULL;
+  p_corpus->data = malloc(p_corpus->cap);
+  if (NULL == p_corpus->data)
+    return false;
+
+  // Stop well before the end so that no function is cut.
+  while (p_corpus->len + 4096 < size)
+  {
+    corpus_add(p_corpus, "/* Function generated for the benchmark,\n"
+                         " * with a block comment. */\nfn ");
+    corpus_add_ident(p_corpus);
+    corpus_add(p_corpus, "(");
+    corpus_add_ident(p_corpus);
+    corpus_add(p_corpus, ": int, ");
+    corpus_add_ident(p_corpus);
+    corpus_add(p_corpus, ": int) -> int {\n");
+    for (uint32_t n = 4 + corpus_random(p_corpus, 12); n > 0; --n)
+      corpus_add_statement(p_corpus);
+    corpus_add(p_corpus, "    return ");
+    corpus_add_expr(p_corpus, 0);
+    corpus_add(p_corpus, ";\n}\n\n");
+  }
+
+  p_corpus->data[p_corpus->len] = '\0'; // Sentinel.
+  return true;
+}
+
+// Hash of the token stream, to check that both scanners agree.
+static uint64_t scan (NextToken next, const Corpus * const p_corpus,
+                      size_t *p_n_tokens)
+{
+  Lexer lexer;
+  Token token;
+  uint64_t hash = 0;
+  size_t n_tokens = 0;
+
+  lexer_init(&lexer, p_corpus->data, p_corpus->len);
+  do
+  {
+    token = next(&lexer);
+    hash = (hash ^ (uint64_t)token.kind ^ (uint64_t)token.len << 8)
+           * 0x100000001b3ULL;
+    ++n_tokens;
+  } while (TOKEN_EOF != token.kind);
+
+  *p_n_tokens = n_tokens;
+  return hash;
+}
+
+static double now (void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + 1e-9 * (double)t.tv_nsec;
+}
+
+static int compare_doubles (const void *p_a, const void *p_b)
+{
+  const double a = *(const double *)p_a;
+  const double b = *(const double *)p_b;
+  return (a > b) - (a < b);
+}
+
+static void bench (const char *name, NextToken next,
+                   const Corpus * const p_corpus, int n_passes)
+{
+  double seconds[n_passes];
+  size_t n_tokens = 0;
+
+  for (int i = 0; i < n_passes; ++i)
+  {
+    const double t0 = now();
+    scan(next, p_corpus, &n_tokens);
+    seconds[i] = now() - t0;
+  }
+  qsort(seconds, (size_t)n_passes, sizeof(double), compare_doubles);
+
+  const double mb = (double)p_corpus->len / 1e6;
+  printf("%-14s %10.1f %10.1f %12.1f\n", name, mb / seconds[0],
+         mb / seconds[n_passes / 2], (double)n_tokens / seconds[0] / 1e6);
+}
+
+static bool same_tokens (const TokenStream * const p_a,
+                         const TokenStream * const p_b)
+{
+  return p_a->n == p_b->n
+         && 0 == memcmp(p_a->kinds, p_b->kinds, p_a->n * sizeof(uint8_t))
+         && 0 == memcmp(p_a->starts, p_b->starts, p_a->n * sizeof(uint32_t))
+         && 0 == memcmp(p_a->lens, p_b->lens, p_a->n * sizeof(uint32_t));
+}
+
+// Typing and erasing, including tokens that change the rest of a line or of
+// the file.  Returns false when out of memory or on a wrong token stream.
+static bool bench_edits (Corpus * const p_corpus)
+{
+  static const char * const texts [] =
+  {
+    "", "x", " ", "\n", "1", "+", "(", ")", ";", "let", "/*", "*/", "\"", "//"
+  };
+  char *p_src = malloc(p_corpus->len + 1);
+  size_t len = p_corpus->len;
+  TokenStream ts, full;
+  bool ok = NULL != p_src;
+  double t_edits = 0;
+  size_t n_relexed = 0;
+
+  token_stream_init(&ts);
+  token_stream_init(&full);
+  if (ok)
+    memcpy(p_src, p_corpus->data, len + 1);
+
+  double t0 = now();
+  ok = ok && token_stream_lex(&ts, p_src, len);
+  const double t_full = now() - t0;
+
+  for (int i = 0; ok && i < N_EDITS; ++i)
+  {
+    const char * const text = texts[corpus_random(p_corpus,
+                                                  sizeof(texts) / sizeof(texts[0]))];
+    TextEdit edit;
+    TokenDamage damage;
+
+    edit.offset = corpus_random(p_corpus, (uint32_t)len + 1);
+    edit.delete_len = corpus_random(p_corpus, 3);
+    if (edit.delete_len > len - edit.offset)
+      edit.delete_len = len - edit.offset;
+    edit.text = text;
+    edit.text_len = strlen(text);
+
+    t0 = now();
+    ok = token_stream_edit(&ts, &p_src, &len, &edit, &damage);
+    t_edits += now() - t0;
+    n_relexed += damage.n_inserted;
+  }
+
+  ok = ok && token_stream_lex(&full, p_src, len) && same_tokens(&ts, &full);
+  if (ok)
+    printf("%d edits: %.2f us per edit, %.1f tokens relexed per edit, "
+           "full lex %.1f ms\n", N_EDITS, 1e6 * t_edits / N_EDITS,
+           (double)n_relexed / N_EDITS, 1e3 * t_full);
+
+  token_stream_free(&ts);
+  token_stream_free(&full);
+  free(p_src);
+  return ok;
+}
+
+int main (int argc, char **argv)
+{
+  // Input checks.
+  if (argc > 3)
+  {
+    printf("Wrong number of command-line arguments: ");
+    printf("%d arguments found, at most %d expected\n", argc -1, 2);
+    printf("Usage: L_bench [megabytes] [passes]\n");
+    return 1;
+  }
+
+  const int megabytes = (argc > 1) ? atoi(argv[1]) : DEFAULT_MEGABYTES;
+  const int n_passes = (argc > 2) ? atoi(argv[2]) : DEFAULT_PASSES;
+  if (megabytes <= 0 || n_passes <= 0)
+  {
+    printf("The size and the number of passes must be positive\n");
+    return 1;
+  }
+
+  Corpus corpus;
+  if (!corpus_generate(&corpus, (size_t)megabytes << 20))
+  {
+    printf("Out of memory\n");
+    return 1;
+  }
+
+  size_t n_table = 0;
+  const uint64_t h_table = scan(lexer_next, &corpus, &n_table);
+  const SkipLevel max_level = lex_skip_detect();
+  for (SkipLevel level = SKIP_SCALAR; level <= max_level; ++level)
+  {
+    size_t n_direct = 0;
+    lex_skip_select(level);
+    if (h_table != scan(lexer_next_direct, &corpus, &n_direct)
+        || n_table != n_direct)
+    {
+      printf("The scanners disagree with %s kernels\n",
+             lex_skip_level_name(level));
+      free(corpus.data);
+      return 2;
+    }
+  }
+
+  printf("%zu bytes, %zu tokens, %d passes\n", corpus.len, n_table, n_passes);
+  printf("%-14s %10s %10s %12s\n", "scanner", "best MB/s", "median MB/s",
+         "Mtokens/s");
+  bench("table", lexer_next, &corpus, n_passes);
+  for (SkipLevel level = SKIP_SCALAR; level <= max_level; ++level)
+  {
+    char name[32];
+    snprintf(name, sizeof(name), "direct/%s", lex_skip_level_name(level));
+    lex_skip_select(level);
+    bench(name, lexer_next_direct, &corpus, n_passes);
+  }
+
+  const bool ok = bench_edits(&corpus);
+  if (!ok)
+    printf("The edited token stream differs from a full relex\n");
+
+  free(corpus.data);
+  return ok ? 0 : 2;
+}
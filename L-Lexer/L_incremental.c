@@ -0,0 +1,136 @@
+/*
+ *  Incremental relexing of edited L sources.
+ */
+
+#include "L_incremental.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Index of the first token from lo on starting at pos or after.
+static size_t lower_bound (const TokenStream * const p_ts, size_t lo, size_t pos)
+{
+  size_t hi = p_ts->n;
+
+  while (lo < hi)
+  {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (p_ts->starts[mid] < pos)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+// End of the last token that read no byte from offset on: the scanner reads
+// one byte past a token, more for the tokens listed apart.
+static size_t restart_offset (const TokenStream * const p_ts, size_t offset)
+{
+  size_t restart = 0;
+
+  for (size_t i = lower_bound(p_ts, 0, offset); i > 0; --i)
+  {
+    const size_t end = (size_t)p_ts->starts[i - 1] + p_ts->lens[i - 1];
+    if (end < offset)
+    {
+      restart = end;
+      break;
+    }
+  }
+
+  for (size_t i = 0; i < p_ts->n_lookahead; ++i)
+    if (p_ts->lookahead_starts[i] < restart && p_ts->lookahead_ends[i] > offset)
+      restart = p_ts->lookahead_starts[i];
+
+  return restart;
+}
+
+static bool edit_text (char **pp_src, size_t *p_len, const TextEdit * const p_edit)
+{
+  const size_t len = *p_len - p_edit->delete_len + p_edit->text_len;
+  char *p_src = *pp_src;
+
+  if (p_edit->text_len > p_edit->delete_len)
+  {
+    p_src = realloc(p_src, len + 1);
+    if (NULL == p_src)
+      return false;
+    *pp_src = p_src;
+  }
+
+  // The sentinel moves with the tail.
+  memmove(p_src + p_edit->offset + p_edit->text_len,
+          p_src + p_edit->offset + p_edit->delete_len,
+          *p_len - p_edit->offset - p_edit->delete_len + 1);
+  memcpy(p_src + p_edit->offset, p_edit->text, p_edit->text_len);
+  *p_len = len;
+  return true;
+}
+
+// Returns false for an edit out of the source, or when out of memory: the
+// stream must then be lexed again from scratch if the source was edited.
+bool token_stream_edit (TokenStream * const p_ts,
+                        char **pp_src,
+                        size_t *p_len,
+                        const TextEdit * const p_edit,
+                        TokenDamage * const p_damage)
+{
+  if (p_edit->offset > *p_len || p_edit->delete_len > *p_len - p_edit->offset
+      || *p_len - p_edit->delete_len + p_edit->text_len > UINT32_MAX)
+    return false;
+
+  const size_t restart = restart_offset(p_ts, p_edit->offset);
+  const size_t first = lower_bound(p_ts, 0, restart);
+  const size_t edit_end = p_edit->offset + p_edit->text_len;
+
+  if (!edit_text(pp_src, p_len, p_edit))
+    return false;
+
+  // Relex until a token starts where an old one started, past the edit.  The
+  // old TOKEN_EOF guarantees that it happens.
+  TokenStream fresh;
+  size_t pos = restart;
+  size_t sync = 0;
+  bool ok = true;
+
+  token_stream_init(&fresh);
+  for (;;)
+  {
+    if (pos >= edit_end)
+    {
+      const size_t old = pos - p_edit->text_len + p_edit->delete_len;
+      sync = lower_bound(p_ts, first, old);
+      if (sync < p_ts->n && p_ts->starts[sync] == old)
+        break;
+    }
+
+    int kind;
+    const size_t end = token_stream_scan(&fresh, *pp_src, pos, &kind);
+    if (SIZE_MAX == end
+        || (!token_is_trivia(kind)
+            && !token_stream_push(&fresh, kind, (uint32_t)pos,
+                                  (uint32_t)(end - pos))))
+    {
+      ok = false;
+      break;
+    }
+    pos = end;
+  }
+
+  if (ok)
+  {
+    p_damage->first = first;
+    p_damage->n_removed = sync - first;
+    p_damage->n_inserted = fresh.n;
+    ok = token_stream_splice(p_ts, first, sync - first, &fresh, restart,
+                             p_ts->starts[sync],
+                             (int64_t)p_edit->text_len
+                             - (int64_t)p_edit->delete_len);
+  }
+
+  token_stream_free(&fresh);
+  return ok;
+}
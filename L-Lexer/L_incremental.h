@@ -0,0 +1,43 @@
+/*
+ *  Incremental relexing of edited L sources.
+ *
+ *  An edit replaces delete_len bytes at offset by text_len bytes.  Lexing
+ *  restarts at the end of the last token that did not read the edited bytes
+ *  and stops at the first token, past the inserted text, that starts where an
+ *  old token started: the scanner keeps no state between tokens, so the rest
+ *  of the stream is the old one, shifted.  The tokens in between are spliced
+ *  in, and the damaged range is reported so that a parser can reuse what lies
+ *  outside of it.
+ */
+
+#pragma once
+
+#include "L_token_stream.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct
+{
+  size_t       offset;
+  size_t       delete_len;
+  const char * text;
+  size_t       text_len;
+} TextEdit;
+
+// Tokens [first, first + n_removed) of the old stream are now
+// [first, first + n_inserted).
+typedef struct
+{
+  size_t first;
+  size_t n_removed;
+  size_t n_inserted;
+} TokenDamage;
+
+// *pp_src is a malloc'ed buffer of *p_len bytes plus the NUL sentinel, lexed
+// into p_ts: it is edited in place, and may be moved.
+bool token_stream_edit (TokenStream * const p_ts,
+                        char **pp_src,
+                        size_t *p_len,
+                        const TextEdit * const p_edit,
+                        TokenDamage * const p_damage);
@@ -0,0 +1,371 @@
+/*
+ *  Concurrent interning of identifiers.
+ */
+
+#include "L_interner.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_SLOTS    1024
+#define ARENA_BLOCK      (64 * 1024)
+#define FIRST_CHUNK_BITS 8  // Chunk k of the id directory has 2^(k + 8) ids.
+#define N_CHUNKS         25 // Enough for 2^32 ids.
+
+typedef struct Table Table;
+
+// A slot holds the 32-bit hash of its string and id + 1, 0 when empty.
+struct Table
+{
+  size_t             mask;
+  Table            * p_older; // Retired tables, freed with the interner.
+  _Atomic uint64_t   slots [];
+};
+
+typedef struct Block Block;
+
+struct Block
+{
+  Block  * p_next;
+  size_t   used;
+  size_t   size;
+  char     bytes [];
+};
+
+typedef struct
+{
+  pthread_mutex_t   lock;
+  Block           * p_blocks; // Arena, current block first.
+} Stripe;
+
+// A record is the length of the string on 32 bits, then its bytes and NUL.
+typedef _Atomic(const char *) RecordPtr;
+
+struct Interner
+{
+  _Atomic(Table *)     table;
+  _Atomic uint32_t     n_ids;
+  _Atomic(RecordPtr *) chunks [N_CHUNKS];
+  Stripe               stripes [INTERNER_STRIPES];
+};
+
+// FNV-1a: the low half gives the slot, the high half the stripe.
+static uint64_t hash_string (const char *s, size_t len)
+{
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; ++i)
+    h = (h ^ (unsigned char)s[i]) * 1099511628211ULL;
+  return h;
+}
+
+static Table * table_new (size_t n_slots)
+{
+  Table *p_table = calloc(1, sizeof(Table) + n_slots * sizeof(uint64_t));
+  if (NULL != p_table)
+    p_table->mask = n_slots - 1;
+  return p_table;
+}
+
+/**** Records. ****/
+
+static RecordPtr * record_ptr (const Interner * const p_interner,
+                               uint32_t id,
+                               bool create)
+{
+  const uint64_t v = (uint64_t)id + (1u << FIRST_CHUNK_BITS);
+  const int k = 63 - __builtin_clzll(v) - FIRST_CHUNK_BITS;
+  const uint64_t index = v - ((uint64_t)1 << (k + FIRST_CHUNK_BITS));
+  Interner * const p_mutable = (Interner *)p_interner;
+  RecordPtr *p_chunk = atomic_load_explicit(&p_mutable->chunks[k],
+                                            memory_order_acquire);
+
+  if (NULL == p_chunk && create)
+  {
+    RecordPtr *p_new = calloc((size_t)1 << (k + FIRST_CHUNK_BITS),
+                              sizeof(RecordPtr));
+    if (NULL == p_new)
+      return NULL;
+
+    // Another stripe may install the chunk first.
+    if (atomic_compare_exchange_strong_explicit(&p_mutable->chunks[k],
+                                                &p_chunk, p_new,
+                                                memory_order_acq_rel,
+                                                memory_order_acquire))
+      p_chunk = p_new;
+    else
+      free(p_new);
+  }
+
+  return (NULL != p_chunk) ? &p_chunk[index] : NULL;
+}
+
+static const char * record (const Interner * const p_interner, uint32_t id)
+{
+  RecordPtr * const p_ptr = record_ptr(p_interner, id, false);
+  return (NULL != p_ptr)
+         ? atomic_load_explicit(p_ptr, memory_order_acquire) : NULL;
+}
+
+static char * stripe_alloc (Stripe * const p_stripe, size_t size)
+{
+  Block *p_block = p_stripe->p_blocks;
+
+  if (NULL == p_block || p_block->used + size > p_block->size)
+  {
+    const size_t block_size = (size > ARENA_BLOCK) ? size : ARENA_BLOCK;
+    p_block = malloc(sizeof(Block) + block_size);
+    if (NULL == p_block)
+      return NULL;
+
+    p_block->p_next = p_stripe->p_blocks;
+    p_block->used = 0;
+    p_block->size = block_size;
+    p_stripe->p_blocks = p_block;
+  }
+
+  char * const p = p_block->bytes + p_block->used;
+  p_block->used += size;
+  return p;
+}
+
+/**** Table. ****/
+
+static bool find_in (const Interner * const p_interner,
+                     const Table * const p_table,
+                     const char *s,
+                     size_t len,
+                     uint64_t hash,
+                     uint32_t *p_id)
+{
+  const uint32_t h32 = (uint32_t)hash;
+
+  for (size_t i = h32 & p_table->mask; ; i = (i + 1) & p_table->mask)
+  {
+    const uint64_t slot = atomic_load_explicit(
+      &((Table *)p_table)->slots[i], memory_order_acquire);
+    if (0 == slot)
+      return false;
+    if ((uint32_t)(slot >> 32) != h32)
+      continue;
+
+    const uint32_t id = (uint32_t)slot - 1;
+    const char * const p_record = record(p_interner, id);
+    uint32_t record_len;
+    memcpy(&record_len, p_record, sizeof(uint32_t));
+    if (record_len == len
+        && 0 == memcmp(p_record + sizeof(uint32_t), s, len))
+    {
+      *p_id = id;
+      return true;
+    }
+  }
+}
+
+// Concurrent inserts from other stripes may race for the same slot.
+static void claim_slot (Table * const p_table, uint64_t hash, uint32_t id)
+{
+  const uint64_t value = (uint64_t)(uint32_t)hash << 32 | ((uint64_t)id + 1);
+
+  for (size_t i = (uint32_t)hash & p_table->mask; ; i = (i + 1) & p_table->mask)
+  {
+    uint64_t empty = 0;
+    if (atomic_compare_exchange_strong_explicit(&p_table->slots[i], &empty,
+                                                value, memory_order_release,
+                                                memory_order_relaxed))
+      return;
+  }
+}
+
+// Keep the table at most half full, plus one insert in flight per stripe.
+static bool is_crowded (const Interner * const p_interner,
+                        const Table * const p_table)
+{
+  const uint32_t n_ids = atomic_load_explicit(
+    &((Interner *)p_interner)->n_ids, memory_order_relaxed);
+  return (size_t)n_ids + INTERNER_STRIPES > (p_table->mask + 1) / 2;
+}
+
+static bool grow (Interner * const p_interner)
+{
+  bool ok = true;
+
+  for (int i = 0; i < INTERNER_STRIPES; ++i)
+    pthread_mutex_lock(&p_interner->stripes[i].lock);
+
+  Table * const p_old = atomic_load_explicit(&p_interner->table,
+                                             memory_order_relaxed);
+  if (is_crowded(p_interner, p_old))
+  {
+    Table * const p_new = table_new(2 * (p_old->mask + 1));
+    ok = NULL != p_new;
+    if (ok)
+    {
+      for (size_t i = 0; i <= p_old->mask; ++i)
+      {
+        const uint64_t slot = atomic_load_explicit(&p_old->slots[i],
+                                                   memory_order_relaxed);
+        size_t j = (uint32_t)(slot >> 32) & p_new->mask;
+        if (0 == slot)
+          continue;
+        while (0 != atomic_load_explicit(&p_new->slots[j], memory_order_relaxed))
+          j = (j + 1) & p_new->mask;
+        atomic_store_explicit(&p_new->slots[j], slot, memory_order_relaxed);
+      }
+
+      p_new->p_older = p_old;
+      atomic_store_explicit(&p_interner->table, p_new, memory_order_release);
+    }
+  }
+
+  for (int i = INTERNER_STRIPES - 1; i >= 0; --i)
+    pthread_mutex_unlock(&p_interner->stripes[i].lock);
+  return ok;
+}
+
+/**** Interface. ****/
+
+Interner * interner_new (void)
+{
+  Interner *p_interner = calloc(1, sizeof(Interner));
+  if (NULL == p_interner)
+    return NULL;
+
+  Table * const p_table = table_new(INITIAL_SLOTS);
+  if (NULL == p_table)
+  {
+    free(p_interner);
+    return NULL;
+  }
+
+  atomic_init(&p_interner->table, p_table);
+  for (int i = 0; i < INTERNER_STRIPES; ++i)
+    pthread_mutex_init(&p_interner->stripes[i].lock, NULL);
+  return p_interner;
+}
+
+// No other thread may use the interner any more.
+void interner_free (Interner * p_interner)
+{
+  if (NULL == p_interner)
+    return;
+
+  Table *p_table = atomic_load(&p_interner->table);
+  while (NULL != p_table)
+  {
+    Table * const p_older = p_table->p_older;
+    free(p_table);
+    p_table = p_older;
+  }
+
+  for (int k = 0; k < N_CHUNKS; ++k)
+    free(atomic_load(&p_interner->chunks[k]));
+
+  for (int i = 0; i < INTERNER_STRIPES; ++i)
+  {
+    Block *p_block = p_interner->stripes[i].p_blocks;
+    while (NULL != p_block)
+    {
+      Block * const p_next = p_block->p_next;
+      free(p_block);
+      p_block = p_next;
+    }
+    pthread_mutex_destroy(&p_interner->stripes[i].lock);
+  }
+
+  free(p_interner);
+}
+
+bool interner_find (const Interner * const p_interner,
+                    const char *s,
+                    size_t len,
+                    uint32_t *p_id)
+{
+  const Table * const p_table = atomic_load_explicit(
+    &((Interner *)p_interner)->table, memory_order_acquire);
+  return find_in(p_interner, p_table, s, len, hash_string(s, len), p_id);
+}
+
+uint32_t intern (Interner * const p_interner, const char *s, size_t len)
+{
+  const uint64_t hash = hash_string(s, len);
+  Stripe * const p_stripe = &p_interner->stripes[(hash >> 32) % INTERNER_STRIPES];
+  uint32_t id;
+
+  if (len > UINT32_MAX - sizeof(uint32_t) - 1)
+    return INTERN_NONE;
+
+  // Lock-free path, for strings already interned.
+  Table *p_table = atomic_load_explicit(&p_interner->table, memory_order_acquire);
+  if (find_in(p_interner, p_table, s, len, hash, &id))
+    return id;
+
+  for (;;)
+  {
+    pthread_mutex_lock(&p_stripe->lock);
+    p_table = atomic_load_explicit(&p_interner->table, memory_order_acquire);
+    if (!is_crowded(p_interner, p_table))
+      break;
+
+    pthread_mutex_unlock(&p_stripe->lock);
+    if (!grow(p_interner))
+      return INTERN_NONE;
+  }
+
+  // Only this stripe inserts this string: look again under its lock.
+  if (find_in(p_interner, p_table, s, len, hash, &id))
+  {
+    pthread_mutex_unlock(&p_stripe->lock);
+    return id;
+  }
+
+  const size_t size = (sizeof(uint32_t) + len + 1 + 3) & ~(size_t)3;
+  char * const p_record = stripe_alloc(p_stripe, size);
+  id = (NULL != p_record)
+       ? atomic_fetch_add_explicit(&p_interner->n_ids, 1, memory_order_relaxed)
+       : INTERN_NONE;
+  RecordPtr * const p_ptr = (INTERN_NONE != id)
+                            ? record_ptr(p_interner, id, true) : NULL;
+
+  if (NULL != p_ptr)
+  {
+    const uint32_t record_len = (uint32_t)len;
+    memcpy(p_record, &record_len, sizeof(uint32_t));
+    memcpy(p_record + sizeof(uint32_t), s, len);
+    p_record[sizeof(uint32_t) + len] = '\0';
+
+    // Publish the record before the slot pointing to it.
+    atomic_store_explicit(p_ptr, p_record, memory_order_release);
+    claim_slot(p_table, hash, id);
+  }
+  else
+  {
+    id = INTERN_NONE;
+  }
+
+  pthread_mutex_unlock(&p_stripe->lock);
+  return id;
+}
+
+const char * interner_string (const Interner * const p_interner,
+                              uint32_t id,
+                              size_t *p_len)
+{
+  const char * const p_record = (id < interner_count(p_interner))
+                                ? record(p_interner, id) : NULL;
+  uint32_t record_len = 0;
+
+  if (NULL != p_record)
+    memcpy(&record_len, p_record, sizeof(uint32_t));
+  if (NULL != p_len)
+    *p_len = record_len;
+
+  return (NULL != p_record) ? p_record + sizeof(uint32_t) : NULL;
+}
+
+uint32_t interner_count (const Interner * const p_interner)
+{
+  return atomic_load_explicit(&((Interner *)p_interner)->n_ids,
+                              memory_order_acquire);
+}
@@ -0,0 +1,44 @@
+/*
+ *  Concurrent interning of identifiers.
+ *
+ *  Every distinct string gets a stable 32-bit symbol id, dense from 0, so
+ *  that identifiers are compared as integers.  One interner may be shared by
+ *  threads lexing or parsing different files.
+ *
+ *  The strings live in open addressing slots holding their hash and id.
+ *  Lookups of interned strings take no lock: they read the slots with
+ *  acquire loads.  New strings are inserted under the lock of one of
+ *  INTERNER_STRIPES stripes, chosen by hash, which also owns the arena the
+ *  bytes are copied to.  Growing the table takes every stripe; older tables
+ *  stay readable until the interner is freed.  Strings and ids are never
+ *  removed or moved.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define INTERNER_STRIPES 16
+#define INTERN_NONE      UINT32_MAX // Id returned when out of memory.
+
+typedef struct Interner Interner;
+
+Interner * interner_new (void);
+
+void interner_free (Interner * p_interner);
+
+uint32_t intern (Interner * const p_interner, const char *s, size_t len);
+
+bool interner_find (const Interner * const p_interner,
+                    const char *s,
+                    size_t len,
+                    uint32_t *p_id);
+
+// NUL-terminated bytes of a symbol.
+const char * interner_string (const Interner * const p_interner,
+                              uint32_t id,
+                              size_t *p_len);
+
+uint32_t interner_count (const Interner * const p_interner);
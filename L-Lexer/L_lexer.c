@@ -0,0 +1,64 @@
+/*
+ *  Table-driven and direct-coded scanners for the language L.
+ */
+
+#include "L_lexer.h"
+
+void lexer_init (Lexer * const p_lexer, const char *src, size_t len)
+{
+  p_lexer->src = (const unsigned char *)src;
+  p_lexer->len = len;
+  p_lexer->pos = 0;
+}
+
+Token lexer_next (Lexer * const p_lexer)
+{
+  const unsigned char * const src = p_lexer->src;
+  const size_t len = p_lexer->len;
+  const size_t start = p_lexer->pos;
+  Token token = { TOKEN_EOF, start, 0 };
+
+  if (start >= len)
+    return token;
+
+  // Run the DFA until it dies, remembering the last accepting position.
+  lex_state_t state = LEX_START;
+  size_t end = start + 1;
+  token.kind = TOKEN_ERROR;
+
+  for (size_t i = start; i < len; ++i)
+  {
+    state = lex_trans[state + lex_class_of[src[i]]];
+    if (LEX_DEAD == state)
+      break;
+
+    // Accepting states are numbered last.
+    if (state >= LEX_FIRST_ACCEPT)
+    {
+      token.kind = lex_accept[state / LEX_N_CLASSES];
+      end = i + 1;
+    }
+  }
+
+  if (LEX_KEYWORD_HOST == token.kind)
+    token.kind = lex_keyword(src + start, end - start);
+
+  token.len = end - start;
+  p_lexer->pos = end;
+  return token;
+}
+
+Token lexer_next_direct (Lexer * const p_lexer)
+{
+  const size_t start = p_lexer->pos;
+  Token token = { TOKEN_EOF, start, 0 };
+
+  if (start >= p_lexer->len)
+    return token;
+
+  const unsigned char * const p_start = p_lexer->src + start;
+  const unsigned char *p_read;
+  token.len = (size_t)(lex_scan_direct(p_start, &token.kind, &p_read) - p_start);
+  p_lexer->pos = start + token.len;
+  return token;
+}
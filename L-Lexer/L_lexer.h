@@ -0,0 +1,37 @@
+/*
+ *  Table-driven scanner for the language L.
+ *
+ *  The tables are generated by L_lexgen from L.tokens.  Each call returns
+ *  the longest token starting at the current position; when several rules
+ *  accept it, the first rule of the spec wins.  A byte that starts no token
+ *  is returned alone as TOKEN_ERROR, and the end of the input as TOKEN_EOF.
+ *
+ *  lexer_next_direct returns the same tokens with the direct-coded scanner,
+ *  which needs a NUL byte right after the input: src[len] == '\0'.
+ */
+
+#pragma once
+
+#include "L_tables.h"
+
+#include <stddef.h>
+
+typedef struct
+{
+  int    kind;  // TOKEN_* of L_tables.h.
+  size_t start; // Offset of the first byte in the source.
+  size_t len;
+} Token;
+
+typedef struct
+{
+  const unsigned char * src;
+  size_t                len;
+  size_t                pos;
+} Lexer;
+
+void lexer_init (Lexer * const p_lexer, const char *src, size_t len);
+
+Token lexer_next (Lexer * const p_lexer);
+
+Token lexer_next_direct (Lexer * const p_lexer);
@@ -0,0 +1,902 @@
+/*
+ *  Lexer generator for the language L.
+ *
+ *  Reads a token spec, one rule per line made of a token name and a regular
+ *  expression (see L.tokens), parses every expression with the RE parser,
+ *  and builds one DFA for all the rules.  The DFA is minimized starting from
+ *  one block per accepted rule, so that the rule of every accepting state is
+ *  kept: when several rules accept the same string the first one wins.
+ *
+ *  Rules that are a plain word, such as "fn" or "while", are keywords: they
+ *  are left out of the DFA, which matches them with a more general rule like
+ *  IDENT, the host rule.  The scanners then look up the tokens of the host
+ *  rule in a minimal perfect hash table of the keywords built here, with
+ *  hash and displace: a first hash picks a bucket, whose displacement seeds
+ *  the second hash giving the slot.
+ *
+ *  The accepting states are numbered after all the others, so that the
+ *  scanner tells them apart with a single comparison.
+ *
+ *  The same DFA is also written as direct code, re2c style: every state is
+ *  a label followed by a switch on the next byte.  A state entered from a
+ *  single other state, such as the inner states of a keyword, is inlined in
+ *  the case of its predecessor.  The input must end with a NUL sentinel,
+ *  which no rule may match, so that no end of buffer check is needed.
+ *  States looping on whitespace, identifier characters or comment bodies
+ *  skip the whole run with the vector kernels of L_skip.h first.
+ *
+ *  Usage: L_lexgen <spec> <prefix>
+ *  writes the tables of a table-driven scanner in <prefix>.h and <prefix>.c,
+ *  and the direct-coded scanner in <prefix>_direct.c.
+ */
+
+#include "RE_parser.h"
+#include "RE_automaton.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LINE_LEN 1024
+#define MAX_RULES    256
+#define MAX_DISPLACE 65535
+
+typedef struct
+{
+  char *name;
+  char *rexpr;
+  bool  keyword; // Plain word, matched through the keyword table.
+} Rule;
+
+typedef struct
+{
+  Rule rules [MAX_RULES];
+  int  n_rules;
+} Spec;
+
+static void spec_free (Spec * const p_spec)
+{
+  for (int i = 0; i < p_spec->n_rules; ++i)
+  {
+    free(p_spec->rules[i].name);
+    free(p_spec->rules[i].rexpr);
+  }
+  p_spec->n_rules = 0;
+}
+
+static char * copy_span (const char *s, size_t len)
+{
+  char *p = malloc(len + 1);
+  if (NULL != p)
+  {
+    memcpy(p, s, len);
+    p[len] = '\0';
+  }
+  return p;
+}
+
+static bool is_word (const char *s)
+{
+  if (NULL == s || '\0' == *s)
+    return false;
+
+  for (; '\0' != *s; ++s)
+    if ('_' != *s && !isalnum((unsigned char)*s))
+      return false;
+  return true;
+}
+
+// Blank lines and lines starting with "//" are ignored.
+static bool spec_read (const char *path, Spec * const p_spec)
+{
+  char line[MAX_LINE_LEN];
+  int line_no = 0;
+  FILE *fp = fopen(path, "r");
+
+  p_spec->n_rules = 0;
+  if (NULL == fp)
+  {
+    printf("Cannot open '%s'\n", path);
+    return false;
+  }
+
+  while (NULL != fgets(line, sizeof(line), fp))
+  {
+    char *p = line;
+    ++line_no;
+
+    while (isspace((unsigned char)*p))
+      ++p;
+    if ('\0' == *p || 0 == strncmp(p, "//", 2))
+      continue;
+
+    const char *name = p;
+    while ('_' == *p || isalnum((unsigned char)*p))
+      ++p;
+    const size_t name_len = (size_t)(p - name);
+
+    while (' ' == *p || '\t' == *p)
+      ++p;
+    const char *rexpr = p;
+    while ('\0' != *p && '\n' != *p && '\r' != *p && ' ' != *p && '\t' != *p)
+      p += ('\\' == p[0] && '\0' != p[1]) ? 2 : 1;
+    const size_t rexpr_len = (size_t)(p - rexpr);
+
+    if (0 == name_len || 0 == rexpr_len || MAX_RULES == p_spec->n_rules)
+    {
+      printf("%s:%d: expected a token name and a regular expression\n",
+             path, line_no);
+      fclose(fp);
+      return false;
+    }
+
+    Rule * const p_rule = &p_spec->rules[p_spec->n_rules++];
+    p_rule->name = copy_span(name, name_len);
+    p_rule->rexpr = copy_span(rexpr, rexpr_len);
+    p_rule->keyword = is_word(p_rule->rexpr);
+  }
+
+  fclose(fp);
+  return true;
+}
+
+static bool build_dfa (const Spec * const p_spec, Dfa * const p_dfa)
+{
+  Nfa nfa;
+  Parser * const p_parser = parser_new();
+  bool ok = NULL != p_parser;
+
+  nfa_init(&nfa);
+  for (int i = 0; ok && i < p_spec->n_rules; ++i)
+  {
+    if (p_spec->rules[i].keyword)
+      continue;
+
+    Node * p_tree = node_new();
+    SyntaxError error;
+    const ParseStatus status = parser_parse(p_parser, p_spec->rules[i].rexpr,
+                                            p_tree, &error);
+    if (PARSE_SYNTAX_ERROR == status)
+    {
+      char message[256];
+      printf("Syntax error in rule %s: %s\n", p_spec->rules[i].name,
+             parse_error_message(&error, p_spec->rules[i].rexpr, message,
+                                 sizeof(message)));
+      ok = false;
+    }
+    else if (PARSE_OK != status)
+    {
+      printf("Out of memory\n");
+      ok = false;
+    }
+    else
+    {
+      ok = nfa_add_rule(&nfa, p_tree, i);
+    }
+    node_free(p_tree);
+  }
+
+  ok = ok && dfa_build(p_dfa, &nfa) && dfa_minimize(p_dfa);
+  nfa_free(&nfa);
+  parser_free(p_parser);
+
+  if (ok && NFA_NO_ACCEPT != p_dfa->accept[p_dfa->start])
+  {
+    printf("Rule %s matches the empty string\n",
+           p_spec->rules[p_dfa->accept[p_dfa->start]].name);
+    ok = false;
+  }
+
+  return ok;
+}
+
+/**** Keywords. ****/
+
+typedef struct
+{
+  int      host;                  // Rule matching the keywords, -1 if none.
+  int      n;
+  int      max_len;
+  int      n_buckets;
+  uint32_t displace [MAX_RULES];
+  int      slot_rule [MAX_RULES]; // Keyword rule of each slot.
+} Keywords;
+
+// 64-bit FNV-1a, the high half selects the bucket and the low half, with
+// the displacement of the bucket, the slot.  Must match the code written by
+// emit_keywords.
+static uint64_t keyword_hash (const char *p, size_t len)
+{
+  uint64_t h = 14695981039346656037ull;
+  for (size_t i = 0; i < len; ++i)
+    h = (h ^ (unsigned char)p[i]) * 1099511628211ull;
+  return h;
+}
+
+static int keyword_bucket (uint64_t h, int n_buckets)
+{
+  return (int)(((h >> 32) * (uint64_t)n_buckets) >> 32);
+}
+
+// The low half is mixed after the displacement, as (lo ^ d) % n alone would
+// never separate words of equal low bits.
+static int keyword_slot (uint64_t h, uint32_t d, int n)
+{
+  const uint32_t x = ((uint32_t)h ^ d) * 2654435761u;
+  return (int)(((uint64_t)x * (uint64_t)n) >> 32);
+}
+
+// Rule accepting the whole word, or NFA_NO_ACCEPT.
+static int accepting_rule (const Dfa * const p_dfa, const char *word)
+{
+  const size_t n_classes = (size_t)p_dfa->classes.n_classes;
+  int s = p_dfa->start;
+
+  for (; '\0' != *word; ++word)
+    s = p_dfa->trans[(size_t)s * n_classes
+                     + p_dfa->classes.class_of[(unsigned char)*word]];
+  return p_dfa->accept[s];
+}
+
+// Find the displacement of every bucket, the largest buckets first.
+static bool place_keywords (const Spec * const p_spec,
+                            const int *p_rules,
+                            Keywords * const p_kw)
+{
+  int bucket_of[MAX_RULES];
+  int size[MAX_RULES] = { 0 };
+  int slots[MAX_RULES];
+  bool done[MAX_RULES] = { false };
+
+  for (int i = 0; i < p_kw->n; ++i)
+  {
+    const char * const word = p_spec->rules[p_rules[i]].rexpr;
+    bucket_of[i] = keyword_bucket(keyword_hash(word, strlen(word)),
+                                  p_kw->n_buckets);
+    ++size[bucket_of[i]];
+  }
+  for (int slot = 0; slot < p_kw->n; ++slot)
+    p_kw->slot_rule[slot] = -1;
+
+  for (int placed = 0; placed < p_kw->n_buckets; ++placed)
+  {
+    int b = -1;
+    for (int k = 0; k < p_kw->n_buckets; ++k)
+      if (!done[k] && (b < 0 || size[k] > size[b]))
+        b = k;
+    done[b] = true;
+    p_kw->displace[b] = 0;
+    if (0 == size[b])
+      continue;
+
+    bool free_slots = false;
+    for (uint32_t d = 0; !free_slots && d <= MAX_DISPLACE; ++d)
+    {
+      int n_slots = 0;
+      free_slots = true;
+      for (int i = 0; free_slots && i < p_kw->n; ++i)
+      {
+        if (bucket_of[i] != b)
+          continue;
+
+        const char * const word = p_spec->rules[p_rules[i]].rexpr;
+        const int slot = keyword_slot(keyword_hash(word, strlen(word)), d,
+                                      p_kw->n);
+        free_slots = p_kw->slot_rule[slot] < 0;
+        for (int k = 0; free_slots && k < n_slots; ++k)
+          free_slots = slots[k] != slot;
+        slots[n_slots++] = slot;
+      }
+
+      if (free_slots)
+      {
+        p_kw->displace[b] = d;
+        n_slots = 0;
+        for (int i = 0; i < p_kw->n; ++i)
+          if (bucket_of[i] == b)
+            p_kw->slot_rule[slots[n_slots++]] = p_rules[i];
+      }
+    }
+
+    if (!free_slots)
+      return false;
+  }
+
+  return true;
+}
+
+static bool build_keywords (const Spec * const p_spec,
+                            const Dfa * const p_dfa,
+                            Keywords * const p_kw)
+{
+  int rules[MAX_RULES];
+
+  memset(p_kw, 0, sizeof(Keywords));
+  p_kw->host = -1;
+
+  for (int i = 0; i < p_spec->n_rules; ++i)
+  {
+    const Rule * const p_rule = &p_spec->rules[i];
+    if (!p_rule->keyword)
+      continue;
+
+    const int host = accepting_rule(p_dfa, p_rule->rexpr);
+    if (NFA_NO_ACCEPT == host || (p_kw->host >= 0 && host != p_kw->host))
+    {
+      printf("Keyword %s must be matched by the same rule as the others\n",
+             p_rule->name);
+      return false;
+    }
+    if (host < i)
+    {
+      printf("Keyword %s is hidden by rule %s\n",
+             p_rule->name, p_spec->rules[host].name);
+      return false;
+    }
+
+    const int len = (int)strlen(p_rule->rexpr);
+    p_kw->max_len = (len > p_kw->max_len) ? len : p_kw->max_len;
+    p_kw->host = host;
+    rules[p_kw->n++] = i;
+  }
+
+  // About two keywords per bucket, more buckets when no displacement fits.
+  for (p_kw->n_buckets = (p_kw->n + 1) / 2; p_kw->n_buckets <= p_kw->n;
+       ++p_kw->n_buckets)
+    if (place_keywords(p_spec, rules, p_kw))
+      return true;
+
+  if (0 == p_kw->n)
+    return true;
+
+  printf("No perfect hash found for the keywords\n");
+  return false;
+}
+
+// Renumber the states, non-accepting ones first.  Returns the number of
+// the first accepting state.
+static int order_states (Dfa * const p_dfa)
+{
+  const int n = p_dfa->n_states;
+  const size_t n_classes = (size_t)p_dfa->classes.n_classes;
+  int *p_new = malloc((size_t)n * sizeof(int));
+  int *p_trans = malloc((size_t)n * n_classes * sizeof(int));
+  int *p_accept = malloc((size_t)n * sizeof(int));
+  int n_rejecting = 0;
+
+  if (NULL == p_new || NULL == p_trans || NULL == p_accept)
+  {
+    free(p_new);
+    free(p_trans);
+    free(p_accept);
+    return -1;
+  }
+
+  for (int s = 0; s < n; ++s)
+    n_rejecting += (NFA_NO_ACCEPT == p_dfa->accept[s]);
+
+  int next_rejecting = 0;
+  int next_accepting = n_rejecting;
+  for (int s = 0; s < n; ++s)
+    p_new[s] = (NFA_NO_ACCEPT == p_dfa->accept[s]) ? next_rejecting++
+                                                   : next_accepting++;
+
+  for (int s = 0; s < n; ++s)
+  {
+    p_accept[p_new[s]] = p_dfa->accept[s];
+    for (size_t c = 0; c < n_classes; ++c)
+      p_trans[(size_t)p_new[s] * n_classes + c] =
+        p_new[p_dfa->trans[(size_t)s * n_classes + c]];
+  }
+
+  free(p_dfa->trans);
+  free(p_dfa->accept);
+  p_dfa->trans = p_trans;
+  p_dfa->accept = p_accept;
+  p_dfa->start = p_new[p_dfa->start];
+  free(p_new);
+  return n_rejecting;
+}
+
+// The dead state rejects and never leaves; -1 when the DFA has none.
+static int dead_state (const Dfa * const p_dfa)
+{
+  const int n_classes = p_dfa->classes.n_classes;
+
+  for (int s = 0; s < p_dfa->n_states; ++s)
+  {
+    bool dead = NFA_NO_ACCEPT == p_dfa->accept[s];
+    for (int c = 0; dead && c < n_classes; ++c)
+      dead = s == p_dfa->trans[(size_t)s * (size_t)n_classes + (size_t)c];
+    if (dead)
+      return s;
+  }
+
+  return -1;
+}
+
+static void emit_header (FILE *fp,
+                         const char *spec_path,
+                         const Spec * const p_spec,
+                         const Dfa * const p_dfa,
+                         const Keywords * const p_kw,
+                         int first_accept,
+                         const char *state_type)
+{
+  const int n_classes = p_dfa->classes.n_classes;
+  const int dead = dead_state(p_dfa);
+
+  fprintf(fp, "/*\n *  Generated by L_lexgen from %s, do not edit.\n */\n\n",
+          spec_path);
+  fprintf(fp, "#pragma once\n\n#include <stddef.h>\n#include <stdint.h>\n\n");
+
+  fprintf(fp, "enum\n{\n");
+  for (int i = 0; i < p_spec->n_rules; ++i)
+    fprintf(fp, "  TOKEN_%s,\n", p_spec->rules[i].name);
+  fprintf(fp, "  TOKEN_COUNT\n};\n\n");
+
+  fprintf(fp, "#define TOKEN_EOF   TOKEN_COUNT\n");
+  fprintf(fp, "#define TOKEN_ERROR (TOKEN_COUNT + 1)\n\n");
+
+  // States are premultiplied by the number of classes: a state is the
+  // index of its row in lex_trans.
+  fprintf(fp, "#define LEX_N_STATES  %d\n", p_dfa->n_states);
+  fprintf(fp, "#define LEX_N_CLASSES %d\n", n_classes);
+  fprintf(fp, "#define LEX_START     %d\n", p_dfa->start * n_classes);
+  if (dead >= 0)
+    fprintf(fp, "#define LEX_DEAD      %d\n", dead * n_classes);
+  else
+    fprintf(fp, "#define LEX_DEAD      (-1)\n");
+  fprintf(fp, "#define LEX_FIRST_ACCEPT %d\n\n", first_accept * n_classes);
+
+  // Tokens of the host rule go through lex_keyword.
+  if (p_kw->host >= 0)
+    fprintf(fp, "#define LEX_KEYWORD_HOST TOKEN_%s\n\n",
+            p_spec->rules[p_kw->host].name);
+  else
+    fprintf(fp, "#define LEX_KEYWORD_HOST (-1)\n\n");
+
+  fprintf(fp, "typedef %s lex_state_t;\n\n", state_type);
+  fprintf(fp, "extern const char * const token_names [TOKEN_COUNT + 2];\n");
+  fprintf(fp, "extern const uint8_t lex_class_of [256];\n");
+  fprintf(fp, "extern const lex_state_t lex_trans "
+              "[LEX_N_STATES * LEX_N_CLASSES];\n");
+  fprintf(fp, "extern const int16_t lex_accept [LEX_N_STATES];\n\n");
+
+  fprintf(fp, "// Kind of the keyword p[0, len), or LEX_KEYWORD_HOST.\n");
+  fprintf(fp, "int lex_keyword (const unsigned char *p, size_t len);\n\n");
+
+  fprintf(fp, "// Direct-coded scanner: p points into a NUL-terminated input, "
+              "returns the\n// end of the longest token and its kind.  "
+              "*pp_read receives the end of the\n// bytes read, past the token "
+              "when the DFA tried a longer one.\n");
+  fprintf(fp, "const unsigned char * lex_scan_direct (const unsigned char *p,\n"
+              "                                       int *p_kind,\n"
+              "                                       const unsigned char **pp_read);\n");
+}
+
+static void emit_keywords (FILE *fp,
+                           const Spec * const p_spec,
+                           const Keywords * const p_kw)
+{
+  if (0 == p_kw->n)
+  {
+    fprintf(fp, "\nint lex_keyword (const unsigned char *p, size_t len)\n{\n");
+    fprintf(fp, "  (void)p;\n  (void)len;\n  return LEX_KEYWORD_HOST;\n}\n");
+    return;
+  }
+
+  fprintf(fp, "\n// Minimal perfect hash of the keywords.\n");
+  fprintf(fp, "static const uint16_t keyword_displace [%d] =\n{", p_kw->n_buckets);
+  for (int b = 0; b < p_kw->n_buckets; ++b)
+    fprintf(fp, "%s%u,", (0 == b % 12) ? "\n  " : " ", p_kw->displace[b]);
+  fprintf(fp, "\n};\n\n");
+
+  fprintf(fp, "static const struct\n{\n  char    text [%d];\n  uint8_t len;\n"
+              "  uint8_t kind;\n} keywords [%d] =\n{\n",
+          p_kw->max_len + 1, p_kw->n);
+  for (int slot = 0; slot < p_kw->n; ++slot)
+  {
+    const Rule * const p_rule = &p_spec->rules[p_kw->slot_rule[slot]];
+    fprintf(fp, "  { \"%s\", %zu, TOKEN_%s },\n", p_rule->rexpr,
+            strlen(p_rule->rexpr), p_rule->name);
+  }
+  fprintf(fp, "};\n\n");
+
+  // One hash, one compare: a word of another length fails the compare.
+  fprintf(fp, "int lex_keyword (const unsigned char *p, size_t len)\n{\n");
+  fprintf(fp, "  uint64_t h = 14695981039346656037ull;\n");
+  fprintf(fp, "  for (size_t i = 0; i < len; ++i)\n");
+  fprintf(fp, "    h = (h ^ p[i]) * 1099511628211ull;\n\n");
+  fprintf(fp, "  const uint32_t d = keyword_displace[((h >> 32) * %du) >> 32];\n",
+          p_kw->n_buckets);
+  fprintf(fp, "  const uint32_t x = ((uint32_t)h ^ d) * 2654435761u;\n");
+  fprintf(fp, "  const uint32_t slot = (uint32_t)(((uint64_t)x * %du) >> 32);\n",
+          p_kw->n);
+  fprintf(fp, "  return (len == keywords[slot].len\n"
+              "          && 0 == memcmp(p, keywords[slot].text, len))\n"
+              "         ? keywords[slot].kind : LEX_KEYWORD_HOST;\n}\n");
+}
+
+static void emit_source (FILE *fp,
+                         const char *spec_path,
+                         const char *header,
+                         const Spec * const p_spec,
+                         const Dfa * const p_dfa,
+                         const Keywords * const p_kw)
+{
+  const int n_classes = p_dfa->classes.n_classes;
+
+  fprintf(fp, "/*\n *  Generated by L_lexgen from %s, do not edit.\n */\n\n",
+          spec_path);
+  fprintf(fp, "#include \"%s\"\n\n#include <string.h>\n\n", header);
+
+  fprintf(fp, "const char * const token_names [TOKEN_COUNT + 2] =\n{\n");
+  for (int i = 0; i < p_spec->n_rules; ++i)
+    fprintf(fp, "  \"%s\",\n", p_spec->rules[i].name);
+  fprintf(fp, "  \"EOF\",\n  \"ERROR\"\n};\n\n");
+
+  fprintf(fp, "const uint8_t lex_class_of [256] =\n{");
+  for (int b = 0; b < BYTE_VALUES; ++b)
+    fprintf(fp, "%s%3d,", (0 == b % 16) ? "\n  " : " ",
+            p_dfa->classes.class_of[b]);
+  fprintf(fp, "\n};\n\n");
+
+  fprintf(fp, "const lex_state_t lex_trans [LEX_N_STATES * LEX_N_CLASSES] =\n{");
+  for (int s = 0; s < p_dfa->n_states; ++s)
+  {
+    fprintf(fp, "\n  // State %d.", s);
+    for (int c = 0; c < n_classes; ++c)
+      fprintf(fp, "%s%d,", (0 == c % 12) ? "\n  " : " ",
+              p_dfa->trans[(size_t)s * (size_t)n_classes + (size_t)c]
+              * n_classes);
+  }
+  fprintf(fp, "\n};\n\n");
+
+  fprintf(fp, "const int16_t lex_accept [LEX_N_STATES] =\n{");
+  for (int s = 0; s < p_dfa->n_states; ++s)
+    fprintf(fp, "%s%d,", (0 == s % 12) ? "\n  " : " ", p_dfa->accept[s]);
+  fprintf(fp, "\n};\n");
+
+  emit_keywords(fp, p_spec, p_kw);
+}
+
+/**** Direct code. ****/
+
+typedef struct
+{
+  const Spec * p_spec;
+  const Dfa  * p_dfa;
+  int          dead;
+  int        * n_preds;     // Distinct predecessors other than the state.
+  bool       * needs_label; // Some goto jumps to the state.
+} DirectCode;
+
+static int target (const Dfa * const p_dfa, int s, int b)
+{
+  const size_t n_classes = (size_t)p_dfa->classes.n_classes;
+  return p_dfa->trans[(size_t)s * n_classes + p_dfa->classes.class_of[b]];
+}
+
+static bool is_inlined (const DirectCode * const p_dc, int s)
+{
+  return s != p_dc->p_dfa->start && 1 == p_dc->n_preds[s];
+}
+
+static void emit_byte (FILE *fp, int b)
+{
+  if (isalnum(b) || (ispunct(b) && '\'' != b && '\\' != b))
+    fprintf(fp, "'%c'", b);
+  else
+    fprintf(fp, "0x%02x", b);
+}
+
+// Every byte leading to t, as case ranges.
+static void emit_cases (FILE *fp, const DirectCode * const p_dc,
+                        int s, int t, int indent)
+{
+  for (int b = 0; b < BYTE_VALUES; ++b)
+  {
+    if (t != target(p_dc->p_dfa, s, b))
+      continue;
+
+    int last = b;
+    while (last + 1 < BYTE_VALUES && t == target(p_dc->p_dfa, s, last + 1))
+      ++last;
+
+    fprintf(fp, "%*scase ", indent, "");
+    emit_byte(fp, b);
+    if (last > b)
+    {
+      fprintf(fp, " ... ");
+      emit_byte(fp, last);
+    }
+    fprintf(fp, ":\n");
+    b = last;
+  }
+}
+
+static int first_byte (const Dfa * const p_dfa, int s, int t)
+{
+  int b = 0;
+  while (t != target(p_dfa, s, b))
+    ++b;
+  return b;
+}
+
+static bool is_ws_byte (int b)
+{
+  return ' ' == b || '\t' == b || '\r' == b || '\n' == b;
+}
+
+static bool is_ident_byte (int b)
+{
+  return '_' == b || isalnum(b);
+}
+
+static bool is_not_newline_byte (int b)
+{
+  return '\0' != b && '\n' != b;
+}
+
+static bool is_not_star_byte (int b)
+{
+  return '\0' != b && '*' != b;
+}
+
+// Byte sets with a kernel in L_skip.h.
+static const struct
+{
+  const char * name;
+  bool      (* has) (int b);
+} skip_sets [] =
+{
+  { "ws", is_ws_byte },
+  { "ident", is_ident_byte },
+  { "not_newline", is_not_newline_byte },
+  { "not_star", is_not_star_byte },
+};
+
+// The kernel skipping the bytes on which s loops, or NULL.
+static const char * skip_kernel (const Dfa * const p_dfa, int s)
+{
+  for (size_t k = 0; k < sizeof(skip_sets) / sizeof(skip_sets[0]); ++k)
+  {
+    bool same = true;
+    for (int b = 0; same && b < BYTE_VALUES; ++b)
+      same = (s == target(p_dfa, s, b)) == skip_sets[k].has(b);
+    if (same)
+      return skip_sets[k].name;
+  }
+  return NULL;
+}
+
+// The first target other than the dead state, or the dead state.
+static int first_target (const DirectCode * const p_dc, int s)
+{
+  for (int b = 0; b < BYTE_VALUES; ++b)
+    if (p_dc->dead != target(p_dc->p_dfa, s, b))
+      return target(p_dc->p_dfa, s, b);
+  return p_dc->dead;
+}
+
+static void emit_state (FILE *fp, const DirectCode * const p_dc, int s, int depth)
+{
+  const Dfa * const p_dfa = p_dc->p_dfa;
+  const int indent = 2 + 4 * depth;
+
+  if (p_dc->needs_label[s])
+    fprintf(fp, "%*ss%d:\n", indent - 2, "", s);
+  if (NULL != skip_kernel(p_dfa, s))
+    fprintf(fp, "%*sp = lex_skip.%s(p);\n", indent, "", skip_kernel(p_dfa, s));
+  if (NFA_NO_ACCEPT != p_dfa->accept[s])
+    fprintf(fp, "%*sp_end = p;\n%*skind = TOKEN_%s;\n", indent, "", indent, "",
+            p_dc->p_spec->rules[p_dfa->accept[s]].name);
+
+  // A state leading only to the dead state ends the token.
+  if (p_dc->dead == first_target(p_dc, s))
+  {
+    fprintf(fp, "%*sgoto done;\n", indent, "");
+    return;
+  }
+
+  fprintf(fp, "%*sswitch (*p++)\n%*s{\n", indent, "", indent, "");
+  for (int b = 0; b < BYTE_VALUES; ++b)
+  {
+    const int t = target(p_dfa, s, b);
+    if (t == p_dc->dead || first_byte(p_dfa, s, t) != b)
+      continue;
+
+    emit_cases(fp, p_dc, s, t, indent + 2);
+    if (t != s && is_inlined(p_dc, t))
+      emit_state(fp, p_dc, t, depth + 1);
+    else
+      fprintf(fp, "%*sgoto s%d;\n", indent + 4, "", t);
+  }
+  fprintf(fp, "%*sdefault:\n%*sgoto done;\n%*s}\n",
+          indent + 2, "", indent + 4, "", indent, "");
+}
+
+// The sentinel must lead every state to the dead state.
+static bool check_sentinel (const Spec * const p_spec,
+                            const Dfa * const p_dfa,
+                            int dead)
+{
+  for (int s = 0; s < p_dfa->n_states; ++s)
+  {
+    const int t = target(p_dfa, s, 0);
+    if (dead < 0 || t != dead)
+    {
+      const int rule = (dead < 0 || NFA_NO_ACCEPT == p_dfa->accept[t])
+                       ? p_dfa->accept[s] : p_dfa->accept[t];
+      printf("Rule %s reads the NUL byte, no sentinel can be used\n",
+             (NFA_NO_ACCEPT != rule) ? p_spec->rules[rule].name : "?");
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool emit_direct (FILE *fp,
+                         const char *spec_path,
+                         const char *header,
+                         const Spec * const p_spec,
+                         const Dfa * const p_dfa,
+                         const Keywords * const p_kw)
+{
+  const int n = p_dfa->n_states;
+  DirectCode dc = { p_spec, p_dfa, dead_state(p_dfa), NULL, NULL };
+  int *p_last_pred = malloc((size_t)n * sizeof(int));
+  bool ok = check_sentinel(p_spec, p_dfa, dc.dead);
+
+  dc.n_preds = calloc((size_t)n, sizeof(int));
+  dc.needs_label = calloc((size_t)n, sizeof(bool));
+  if (NULL == p_last_pred || NULL == dc.n_preds || NULL == dc.needs_label)
+    ok = false;
+
+  if (ok)
+  {
+    for (int t = 0; t < n; ++t)
+      p_last_pred[t] = -1;
+
+    for (int s = 0; s < n; ++s)
+    {
+      for (int b = 0; b < BYTE_VALUES; ++b)
+      {
+        const int t = target(p_dfa, s, b);
+        if (t == s)
+          dc.needs_label[t] = true;
+        else if (p_last_pred[t] != s)
+          ++dc.n_preds[t];
+        p_last_pred[t] = s;
+      }
+    }
+
+    for (int t = 0; t < n; ++t)
+      if (!is_inlined(&dc, t) && 0 < dc.n_preds[t])
+        dc.needs_label[t] = true;
+
+    fprintf(fp, "/*\n *  Generated by L_lexgen from %s, do not edit.\n */\n\n",
+            spec_path);
+    fprintf(fp, "#include \"%s\"\n", header);
+    fprintf(fp, "#include \"L_skip.h\"\n\n");
+    fprintf(fp, "const unsigned char * lex_scan_direct (const unsigned char *p,\n"
+                "                                       int *p_kind,\n"
+                "                                       const unsigned char **pp_read)\n{\n");
+    if (p_kw->n > 0)
+      fprintf(fp, "  const unsigned char * const p_start = p;\n");
+    fprintf(fp, "  const unsigned char *p_end = p + 1;\n");
+    fprintf(fp, "  int kind = TOKEN_ERROR;\n\n");
+
+    emit_state(fp, &dc, p_dfa->start, 0);
+    for (int s = 0; s < n; ++s)
+    {
+      if (s == p_dfa->start || s == dc.dead || is_inlined(&dc, s))
+        continue;
+      fprintf(fp, "\n");
+      emit_state(fp, &dc, s, 0);
+    }
+
+    fprintf(fp, "\ndone:\n");
+    if (p_kw->n > 0)
+      fprintf(fp, "  if (LEX_KEYWORD_HOST == kind)\n"
+                  "    kind = lex_keyword(p_start, (size_t)(p_end - p_start));\n");
+    fprintf(fp, "  *p_kind = kind;\n  *pp_read = p;\n  return p_end;\n}\n");
+  }
+
+  free(p_last_pred);
+  free(dc.n_preds);
+  free(dc.needs_label);
+  return ok;
+}
+
+static bool write_tables (const char *spec_path,
+                          const char *prefix,
+                          const Spec * const p_spec,
+                          const Dfa * const p_dfa,
+                          const Keywords * const p_kw,
+                          int first_accept)
+{
+  const size_t len = strlen(prefix) + sizeof("_direct.c");
+  char *h_path = malloc(len);
+  char *c_path = malloc(len);
+  char *d_path = malloc(len);
+  bool ok = false;
+
+  if (NULL != h_path && NULL != c_path && NULL != d_path)
+  {
+    snprintf(h_path, len, "%s.h", prefix);
+    snprintf(c_path, len, "%s.c", prefix);
+    snprintf(d_path, len, "%s_direct.c", prefix);
+
+    const char *header = strrchr(h_path, '/');
+    header = (NULL != header) ? header + 1 : h_path;
+
+    const size_t n_entries = (size_t)p_dfa->n_states
+                             * (size_t)p_dfa->classes.n_classes;
+    const char *state_type = (n_entries <= UINT16_MAX) ? "uint16_t" : "uint32_t";
+
+    FILE *fp_h = fopen(h_path, "w");
+    FILE *fp_c = fopen(c_path, "w");
+    FILE *fp_d = fopen(d_path, "w");
+    if (NULL != fp_h && NULL != fp_c && NULL != fp_d)
+    {
+      emit_header(fp_h, spec_path, p_spec, p_dfa, p_kw, first_accept, state_type);
+      emit_source(fp_c, spec_path, header, p_spec, p_dfa, p_kw);
+      ok = emit_direct(fp_d, spec_path, header, p_spec, p_dfa, p_kw);
+    }
+    else
+    {
+      printf("Cannot create file\n");
+    }
+    if (NULL != fp_h)
+      ok = (0 == fclose(fp_h)) && ok;
+    if (NULL != fp_c)
+      ok = (0 == fclose(fp_c)) && ok;
+    if (NULL != fp_d)
+      ok = (0 == fclose(fp_d)) && ok;
+  }
+
+  free(h_path);
+  free(c_path);
+  free(d_path);
+  return ok;
+}
+
+int main (int argc, char **argv)
+{
+  Spec spec;
+  Dfa dfa;
+  Keywords keywords;
+
+  // Input checks.
+  if (argc != 3)
+  {
+    printf("Wrong number of command-line arguments: ");
+    printf("%d arguments found, %d expected\n", argc -1, 2);
+    printf("Usage: L_lexgen <spec> <prefix>\n");
+    return 1;
+  }
+
+  memset(&dfa, 0, sizeof(Dfa));
+  bool ok = spec_read(argv[1], &spec) && build_dfa(&spec, &dfa)
+            && build_keywords(&spec, &dfa, &keywords);
+  const int first_accept = ok ? order_states(&dfa) : -1;
+  if (first_accept >= 0)
+  {
+    printf("%d rules, %d keywords, %d states, %d byte classes\n",
+           spec.n_rules, keywords.n, dfa.n_states, dfa.classes.n_classes);
+    ok = write_tables(argv[1], argv[2], &spec, &dfa, &keywords, first_accept);
+  }
+  else
+  {
+    ok = false;
+  }
+
+  dfa_free(&dfa);
+  spec_free(&spec);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+/*
+ *  Command-line front end of the L lexer.
+ *
+ *  Usage:
+ *  L_lexer <file>       Print the tokens of the file, one per line.
+ *  L_lexer -q <file>    Only count the tokens and report the throughput.
+ *  L_lexer -j N ...     Lex with N threads.
+ *  L_lexer -d ...       Use the direct-coded scanner, the default.
+ *  L_lexer -t ...       Use the table-driven scanner, on one thread.
+ */
+
+#include "L_interner.h"
+#include "L_lexer.h"
+#include "L_parallel_lex.h"
+#include "L_source.h"
+#include "L_token_stream.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Same stream as token_stream_lex, with the table-driven scanner.
+static bool lex_with_tables (TokenStream * const p_ts,
+                             const char *src,
+                             size_t len)
+{
+  Lexer lexer;
+  Token token;
+
+  p_ts->n = 0;
+  p_ts->n_lookahead = 0;
+  lexer_init(&lexer, src, len);
+  do
+  {
+    token = lexer_next(&lexer);
+    if (!token_is_trivia(token.kind)
+        && !token_stream_push(p_ts, token.kind, (uint32_t)token.start,
+                              (uint32_t)token.len))
+      return false;
+  } while (TOKEN_EOF != token.kind);
+
+  return true;
+}
+
+int main (int argc, char **argv)
+{
+  // Input checks.
+  bool quiet = false;
+  bool tables = false;
+  int n_threads = 1;
+  int arg = 1;
+  for (; arg < argc - 1; ++arg)
+  {
+    if (0 == strcmp(argv[arg], "-q"))
+      quiet = true;
+    else if (0 == strcmp(argv[arg], "-d"))
+      tables = false;
+    else if (0 == strcmp(argv[arg], "-t"))
+      tables = true;
+    else if (0 == strcmp(argv[arg], "-j") && arg + 2 < argc)
+      n_threads = atoi(argv[++arg]);
+    else
+      break;
+  }
+  if (arg != argc - 1 || n_threads < 1 || (tables && 1 < n_threads))
+  {
+    printf("Wrong command-line arguments\n");
+    printf("Usage: L_lexer [-q] [-d | -t] [-j threads] <file>\n");
+    return 1;
+  }
+
+  Source source;
+  if (!source_open(argv[argc - 1], &source))
+  {
+    printf("Cannot read '%s'\n", argv[argc - 1]);
+    return 1;
+  }
+
+  TokenStream ts;
+  struct timespec t0, t1;
+
+  token_stream_init(&ts);
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  const bool ok = tables ? lex_with_tables(&ts, source.data, source.len)
+                        : token_stream_lex_parallel(&ts, source.data,
+                                                    source.len, n_threads);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  if (!ok)
+  {
+    printf("Out of memory\n");
+    token_stream_free(&ts);
+    source_close(&source);
+    return 1;
+  }
+
+  Interner * const p_interner = interner_new();
+  size_t n_errors = 0;
+  for (size_t i = 0; i < ts.n; ++i)
+  {
+    n_errors += (TOKEN_ERROR == ts.kinds[i]);
+    if (TOKEN_IDENT == ts.kinds[i] && NULL != p_interner)
+      intern(p_interner, source.data + ts.starts[i], ts.lens[i]);
+    if (!quiet && TOKEN_EOF != ts.kinds[i])
+      printf("%u %s '%.*s'\n", ts.starts[i], token_names[ts.kinds[i]],
+             (int)ts.lens[i], source.data + ts.starts[i]);
+  }
+
+  if (quiet)
+  {
+    const double seconds = (double)(t1.tv_sec - t0.tv_sec)
+                           + 1e-9 * (double)(t1.tv_nsec - t0.tv_nsec);
+    printf("%zu bytes, %zu tokens, %u identifiers, %zu errors, %.1f MB/s\n",
+           source.len, ts.n - 1,
+           (NULL != p_interner) ? interner_count(p_interner) : 0, n_errors,
+           (seconds > 0) ? (double)source.len / seconds / 1e6 : 0.0);
+  }
+
+  interner_free(p_interner);
+  token_stream_free(&ts);
+  source_close(&source);
+  return (0 == n_errors) ? 0 : 2;
+}
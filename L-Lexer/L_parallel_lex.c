@@ -0,0 +1,258 @@
+/*
+ *  Parallel lexing of large L sources.
+ */
+
+#define _GNU_SOURCE // memmem
+
+#include "L_parallel_lex.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum
+{
+  GUESS_NORMAL,
+  GUESS_BLOCK_COMMENT,
+  GUESS_STRING,
+  GUESS_LINE_COMMENT,
+  N_GUESSES
+} Guess;
+
+typedef struct
+{
+  TokenStream tokens;
+  size_t      end;  // End of the last token lexed.
+  size_t      join; // Index of the normal guess where this one meets it.
+} GuessResult;
+
+typedef struct
+{
+  const char  * src;
+  size_t        from;
+  size_t        to;
+  GuessResult   guesses [N_GUESSES];
+  bool          ok;
+} Chunk;
+
+// Index of the token starting at pos, or SIZE_MAX.
+static size_t find_start (const TokenStream * const p_ts, size_t pos)
+{
+  size_t lo = 0;
+  size_t hi = p_ts->n;
+
+  while (lo < hi)
+  {
+    const size_t mid = lo + (hi - lo) / 2;
+    if (p_ts->starts[mid] < pos)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return (lo < p_ts->n && p_ts->starts[lo] == pos) ? lo : SIZE_MAX;
+}
+
+// Where lexing resumes if the chunk starts inside the construct, or SIZE_MAX
+// when the construct does not close within the chunk: the join then relexes
+// the chunk sequentially.
+static size_t resume_offset (const Chunk * const p_chunk, Guess guess)
+{
+  const char * const p = p_chunk->src + p_chunk->from;
+  const size_t n = p_chunk->to - p_chunk->from;
+  const char *p_close = NULL;
+
+  switch (guess)
+  {
+    case GUESS_BLOCK_COMMENT:
+      p_close = memmem(p, n, "*/", 2);
+      return (NULL != p_close) ? (size_t)(p_close + 2 - p_chunk->src) : SIZE_MAX;
+    case GUESS_STRING:
+      for (p_close = memchr(p, '"', n); NULL != p_close;
+           p_close = memchr(p_close + 1, '"', n - (size_t)(p_close + 1 - p)))
+        if (p_close == p || '\\' != p_close[-1])
+          return (size_t)(p_close + 1 - p_chunk->src);
+      return SIZE_MAX;
+    case GUESS_LINE_COMMENT:
+      p_close = memchr(p, '\n', n);
+      return (NULL != p_close) ? (size_t)(p_close - p_chunk->src) : SIZE_MAX;
+    default:
+      return p_chunk->from;
+  }
+}
+
+// Lex an alternative guess until it meets the normal one.
+static bool lex_guess (Chunk * const p_chunk, Guess guess)
+{
+  GuessResult * const p_guess = &p_chunk->guesses[guess];
+  const TokenStream * const p_normal = &p_chunk->guesses[GUESS_NORMAL].tokens;
+  size_t pos = resume_offset(p_chunk, guess);
+
+  p_guess->join = SIZE_MAX;
+  p_guess->end = pos;
+  if (SIZE_MAX == pos)
+    return true;
+
+  while (pos < p_chunk->to)
+  {
+    int kind;
+    const size_t end = token_stream_scan(&p_guess->tokens, p_chunk->src, pos,
+                                         &kind);
+    if (SIZE_MAX == end)
+      return false;
+
+    if (!token_is_trivia(kind))
+    {
+      p_guess->join = find_start(p_normal, pos);
+      if (SIZE_MAX != p_guess->join)
+        break;
+      if (!token_stream_push(&p_guess->tokens, kind, (uint32_t)pos,
+                             (uint32_t)(end - pos)))
+        return false;
+    }
+    pos = end;
+  }
+
+  p_guess->end = pos;
+  return true;
+}
+
+static void * lex_chunk (void *p_arg)
+{
+  Chunk * const p_chunk = p_arg;
+  GuessResult * const p_normal = &p_chunk->guesses[GUESS_NORMAL];
+
+  p_normal->join = SIZE_MAX;
+  p_normal->end = token_stream_append(&p_normal->tokens, p_chunk->src,
+                                      p_chunk->from, p_chunk->to);
+  p_chunk->ok = SIZE_MAX != p_normal->end;
+
+  // The first chunk starts at a token for sure.
+  for (Guess guess = GUESS_BLOCK_COMMENT;
+       p_chunk->ok && 0 != p_chunk->from && guess < N_GUESSES; ++guess)
+    p_chunk->ok = lex_guess(p_chunk, guess);
+
+  return NULL;
+}
+
+// Copy the guess that starts a token at pos, if any.  *p_end receives the
+// end of the copied tokens.
+static bool join_guess (TokenStream * const p_ts,
+                        const Chunk * const p_chunk,
+                        size_t pos,
+                        size_t *p_end,
+                        bool *p_ok)
+{
+  const GuessResult * const p_normal = &p_chunk->guesses[GUESS_NORMAL];
+
+  for (Guess guess = GUESS_NORMAL; guess < N_GUESSES; ++guess)
+  {
+    const GuessResult * const p_guess = &p_chunk->guesses[guess];
+    const size_t first = find_start(&p_guess->tokens, pos);
+    if (SIZE_MAX == first)
+      continue;
+
+    *p_ok = token_stream_concat(p_ts, &p_guess->tokens, first);
+    *p_end = p_guess->end;
+    if (GUESS_NORMAL != guess && SIZE_MAX != p_guess->join)
+    {
+      *p_ok = *p_ok && token_stream_concat(p_ts, &p_normal->tokens,
+                                           p_guess->join);
+      *p_end = p_normal->end;
+    }
+    return true;
+  }
+
+  return false;
+}
+
+// Relex from the exact end of the previous chunks until a guess agrees.
+static bool join_chunks (TokenStream * const p_ts,
+                         const Chunk *p_chunks,
+                         int n_chunks,
+                         const char *src,
+                         size_t len)
+{
+  size_t pos = 0;
+  bool ok = true;
+
+  p_ts->n = 0;
+  p_ts->n_lookahead = 0;
+  for (int c = 0; ok && c < n_chunks; ++c)
+  {
+    const Chunk * const p_chunk = &p_chunks[c];
+    bool joined = false;
+
+    while (ok && !joined && pos < p_chunk->to)
+    {
+      int kind;
+      const size_t end = token_stream_scan(p_ts, src, pos, &kind);
+
+      if (SIZE_MAX == end)
+        ok = false;
+      else if (token_is_trivia(kind))
+        pos = end;
+      else if (!(joined = join_guess(p_ts, p_chunk, pos, &pos, &ok)))
+      {
+        ok = token_stream_push(p_ts, kind, (uint32_t)pos, (uint32_t)(end - pos));
+        pos = end;
+      }
+    }
+  }
+
+  return ok && token_stream_push(p_ts, TOKEN_EOF, (uint32_t)len, 0);
+}
+
+bool token_stream_lex_parallel (TokenStream * const p_ts,
+                                const char *src,
+                                size_t len,
+                                int n_threads)
+{
+  const size_t max_chunks = len / PARALLEL_MIN_CHUNK;
+  const int n_chunks = ((size_t)n_threads < max_chunks) ? n_threads : (int)max_chunks;
+
+  if (n_chunks <= 1 || len > UINT32_MAX)
+    return token_stream_lex(p_ts, src, len);
+
+  Chunk *p_chunks = calloc((size_t)n_chunks, sizeof(Chunk));
+  pthread_t *p_threads = calloc((size_t)n_chunks, sizeof(pthread_t));
+  bool *p_started = calloc((size_t)n_chunks, sizeof(bool));
+  bool ok = NULL != p_chunks && NULL != p_threads && NULL != p_started;
+
+  for (int c = 0; ok && c < n_chunks; ++c)
+  {
+    Chunk * const p_chunk = &p_chunks[c];
+    p_chunk->src = src;
+    p_chunk->from = len * (size_t)c / (size_t)n_chunks;
+    p_chunk->to = len * (size_t)(c + 1) / (size_t)n_chunks;
+    for (Guess guess = GUESS_NORMAL; guess < N_GUESSES; ++guess)
+      token_stream_init(&p_chunk->guesses[guess].tokens);
+  }
+
+  // The calling thread lexes the first chunk.
+  for (int c = 1; ok && c < n_chunks; ++c)
+    p_started[c] = 0 == pthread_create(&p_threads[c], NULL, lex_chunk,
+                                       &p_chunks[c]);
+  if (ok)
+    lex_chunk(&p_chunks[0]);
+
+  for (int c = 0; ok && c < n_chunks; ++c)
+  {
+    if (0 != c && p_started[c])
+      pthread_join(p_threads[c], NULL);
+    else if (0 != c)
+      lex_chunk(&p_chunks[c]);
+  }
+  for (int c = 0; ok && c < n_chunks; ++c)
+    ok = p_chunks[c].ok;
+
+  ok = ok && join_chunks(p_ts, p_chunks, n_chunks, src, len);
+
+  for (int c = 0; NULL != p_chunks && c < n_chunks; ++c)
+    for (Guess guess = GUESS_NORMAL; guess < N_GUESSES; ++guess)
+      token_stream_free(&p_chunks[c].guesses[guess].tokens);
+  free(p_chunks);
+  free(p_threads);
+  free(p_started);
+  return ok;
+}
@@ -0,0 +1,28 @@
+/*
+ *  Parallel lexing of large L sources.
+ *
+ *  The source is cut into one chunk per thread.  Lexing a chunk from its
+ *  first byte as if a token started there is a guess: the byte may be
+ *  inside a token, a comment or a string.  Besides that normal guess, each
+ *  chunk is lexed from the end of the block comment, string or line comment
+ *  it may start in, until that guess reaches a token where the normal one
+ *  has one too: from there both agree.
+ *
+ *  The chunks are then joined in order.  The tokens of the previous chunks
+ *  end exactly at some offset e; the source is relexed from e until it
+ *  reaches a token that one of the guesses also starts, and that guess is
+ *  copied from there.  A DFA lexer resynchronizes within a few tokens, so
+ *  the sequential part stays short.
+ */
+
+#pragma once
+
+#include "L_token_stream.h"
+
+#define PARALLEL_MIN_CHUNK (1 << 20) // Smaller sources are lexed in one go.
+
+// Same result as token_stream_lex, src[len] must be '\0'.
+bool token_stream_lex_parallel (TokenStream * const p_ts,
+                                const char *src,
+                                size_t len,
+                                int n_threads);
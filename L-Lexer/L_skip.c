@@ -0,0 +1,215 @@
+/*
+ *  Kernels skipping runs of whitespace, identifier characters and comment
+ *  bodies.
+ */
+
+#include "L_skip.h"
+
+#include <immintrin.h>
+#include <stdint.h>
+
+// The vector loads read before p and after the sentinel, within the
+// aligned block: the address sanitizer would report them.
+#define KERNEL __attribute__((no_sanitize_address))
+
+/**** Scalar. ****/
+
+static bool is_ws (unsigned char c)
+{
+  return ' ' == c || '\t' == c || '\r' == c || '\n' == c;
+}
+
+static bool is_ident (unsigned char c)
+{
+  return '_' == c || (c >= '0' && c <= '9')
+         || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+}
+
+static const unsigned char * skip_ws_scalar (const unsigned char *p)
+{
+  while (is_ws(*p))
+    ++p;
+  return p;
+}
+
+static const unsigned char * skip_ident_scalar (const unsigned char *p)
+{
+  while (is_ident(*p))
+    ++p;
+  return p;
+}
+
+static const unsigned char * skip_not_newline_scalar (const unsigned char *p)
+{
+  while ('\n' != *p && '\0' != *p)
+    ++p;
+  return p;
+}
+
+static const unsigned char * skip_not_star_scalar (const unsigned char *p)
+{
+  while ('*' != *p && '\0' != *p)
+    ++p;
+  return p;
+}
+
+/**** Vector kernels. ****/
+
+// Loop over the aligned blocks from the one holding p, until a byte at or
+// after p stops the run.  stop(q) returns the mask of the bytes of block q
+// that are not in the set.
+#define SKIP_KERNEL(name, isa, width, stop)                                  \
+  __attribute__((target(isa))) KERNEL                                        \
+  static const unsigned char * name (const unsigned char *p)                 \
+  {                                                                          \
+    const unsigned char *q =                                                 \
+      (const unsigned char *)((uintptr_t)p & ~(uintptr_t)((width) - 1));     \
+    uint32_t mask = stop(q) & (~0u << (p - q));                              \
+    while (0 == mask)                                                        \
+    {                                                                        \
+      q += (width);                                                          \
+      mask = stop(q);                                                        \
+    }                                                                        \
+    return q + __builtin_ctz(mask);                                          \
+  }
+
+/**** SSE4.2. ****/
+
+#define SSE42_MASK(set, n, mode, q)                                          \
+  (uint32_t)_mm_cvtsi128_si32(_mm_cmpestrm(                                  \
+    (set), (n), _mm_load_si128((const __m128i *)(q)), 16,                    \
+    _SIDD_UBYTE_OPS | (mode) | _SIDD_BIT_MASK))
+
+__attribute__((target("sse4.2"))) KERNEL
+static inline uint32_t stop_ws_sse42 (const unsigned char *q)
+{
+  const __m128i set = _mm_setr_epi8(' ', '\t', '\r', '\n',
+                                    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  return SSE42_MASK(set, 4, _SIDD_CMP_EQUAL_ANY | _SIDD_NEGATIVE_POLARITY, q);
+}
+
+__attribute__((target("sse4.2"))) KERNEL
+static inline uint32_t stop_ident_sse42 (const unsigned char *q)
+{
+  const __m128i ranges = _mm_setr_epi8('0', '9', 'A', 'Z', 'a', 'z', '_', '_',
+                                       0, 0, 0, 0, 0, 0, 0, 0);
+  return SSE42_MASK(ranges, 8, _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY, q);
+}
+
+__attribute__((target("sse4.2"))) KERNEL
+static inline uint32_t stop_newline_sse42 (const unsigned char *q)
+{
+  const __m128i set = _mm_setr_epi8('\n', 0, 0, 0, 0, 0, 0, 0,
+                                    0, 0, 0, 0, 0, 0, 0, 0);
+  return SSE42_MASK(set, 2, _SIDD_CMP_EQUAL_ANY, q);
+}
+
+__attribute__((target("sse4.2"))) KERNEL
+static inline uint32_t stop_star_sse42 (const unsigned char *q)
+{
+  const __m128i set = _mm_setr_epi8('*', 0, 0, 0, 0, 0, 0, 0,
+                                    0, 0, 0, 0, 0, 0, 0, 0);
+  return SSE42_MASK(set, 2, _SIDD_CMP_EQUAL_ANY, q);
+}
+
+SKIP_KERNEL(skip_ws_sse42, "sse4.2", 16, stop_ws_sse42)
+SKIP_KERNEL(skip_ident_sse42, "sse4.2", 16, stop_ident_sse42)
+SKIP_KERNEL(skip_not_newline_sse42, "sse4.2", 16, stop_newline_sse42)
+SKIP_KERNEL(skip_not_star_sse42, "sse4.2", 16, stop_star_sse42)
+
+/**** AVX2. ****/
+
+#define AVX2_LOAD(q) _mm256_load_si256((const __m256i *)(q))
+#define AVX2_EQ(v, c) _mm256_cmpeq_epi8((v), _mm256_set1_epi8(c))
+#define AVX2_MASK(v) (uint32_t)_mm256_movemask_epi8(v)
+
+// Bytes of v within [lo, hi].
+__attribute__((target("avx2")))
+static inline __m256i in_range (__m256i v, char lo, char hi)
+{
+  const __m256i t = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8((char)(hi - lo))), t);
+}
+
+__attribute__((target("avx2"))) KERNEL
+static inline uint32_t stop_ws_avx2 (const unsigned char *q)
+{
+  const __m256i v = AVX2_LOAD(q);
+  return ~AVX2_MASK(_mm256_or_si256(_mm256_or_si256(AVX2_EQ(v, ' '), AVX2_EQ(v, '\t')),
+                                    _mm256_or_si256(AVX2_EQ(v, '\r'), AVX2_EQ(v, '\n'))));
+}
+
+__attribute__((target("avx2"))) KERNEL
+static inline uint32_t stop_ident_avx2 (const unsigned char *q)
+{
+  const __m256i v = AVX2_LOAD(q);
+  const __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  return ~AVX2_MASK(_mm256_or_si256(_mm256_or_si256(in_range(v, '0', '9'),
+                                                    in_range(lower, 'a', 'z')),
+                                    AVX2_EQ(v, '_')));
+}
+
+__attribute__((target("avx2"))) KERNEL
+static inline uint32_t stop_newline_avx2 (const unsigned char *q)
+{
+  const __m256i v = AVX2_LOAD(q);
+  return AVX2_MASK(_mm256_or_si256(AVX2_EQ(v, '\n'), AVX2_EQ(v, '\0')));
+}
+
+__attribute__((target("avx2"))) KERNEL
+static inline uint32_t stop_star_avx2 (const unsigned char *q)
+{
+  const __m256i v = AVX2_LOAD(q);
+  return AVX2_MASK(_mm256_or_si256(AVX2_EQ(v, '*'), AVX2_EQ(v, '\0')));
+}
+
+SKIP_KERNEL(skip_ws_avx2, "avx2", 32, stop_ws_avx2)
+SKIP_KERNEL(skip_ident_avx2, "avx2", 32, stop_ident_avx2)
+SKIP_KERNEL(skip_not_newline_avx2, "avx2", 32, stop_newline_avx2)
+SKIP_KERNEL(skip_not_star_avx2, "avx2", 32, stop_star_avx2)
+
+/**** Dispatch. ****/
+
+static const LexSkip kernels [] =
+{
+  [SKIP_SCALAR] = { skip_ws_scalar, skip_ident_scalar,
+                    skip_not_newline_scalar, skip_not_star_scalar },
+  [SKIP_SSE42]  = { skip_ws_sse42, skip_ident_sse42,
+                    skip_not_newline_sse42, skip_not_star_sse42 },
+  [SKIP_AVX2]   = { skip_ws_avx2, skip_ident_avx2,
+                    skip_not_newline_avx2, skip_not_star_avx2 },
+};
+
+LexSkip lex_skip = { skip_ws_scalar, skip_ident_scalar,
+                     skip_not_newline_scalar, skip_not_star_scalar };
+
+SkipLevel lex_skip_detect (void)
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return SKIP_AVX2;
+  if (__builtin_cpu_supports("sse4.2"))
+    return SKIP_SSE42;
+  return SKIP_SCALAR;
+}
+
+bool lex_skip_select (SkipLevel level)
+{
+  if (level > lex_skip_detect())
+    return false;
+
+  lex_skip = kernels[level];
+  return true;
+}
+
+const char * lex_skip_level_name (SkipLevel level)
+{
+  static const char * const names [] = { "scalar", "sse4.2", "avx2" };
+  return names[level];
+}
+
+__attribute__((constructor))
+static void lex_skip_init (void)
+{
+  lex_skip_select(lex_skip_detect());
+}
@@ -0,0 +1,43 @@
+/*
+ *  Kernels skipping runs of whitespace, identifier characters and comment
+ *  bodies, 16 or 32 bytes at a time.
+ *
+ *  The direct-coded scanner calls them in the states that loop on one of
+ *  these byte sets, so that the DFA only takes one step per token boundary.
+ *  Each kernel returns the first byte at or after p that is not in its set;
+ *  the NUL sentinel is in none of them.  Blocks are read at aligned
+ *  addresses, which never cross a page past the sentinel.
+ *
+ *  The AVX2, SSE4.2 or scalar versions are chosen at startup from CPUID;
+ *  lex_skip_select forces one, for instance to benchmark them.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+typedef enum
+{
+  SKIP_SCALAR,
+  SKIP_SSE42,
+  SKIP_AVX2
+} SkipLevel;
+
+typedef const unsigned char * (*SkipKernel) (const unsigned char *p);
+
+typedef struct
+{
+  SkipKernel ws;          // [ \t\r\n]
+  SkipKernel ident;       // [_0-9A-Za-z]
+  SkipKernel not_newline; // [^\n]
+  SkipKernel not_star;    // [^*]
+} LexSkip;
+
+extern LexSkip lex_skip;
+
+SkipLevel lex_skip_detect (void);
+
+// Not thread-safe: call before any scan.  False when the CPU lacks it.
+bool lex_skip_select (SkipLevel level);
+
+const char * lex_skip_level_name (SkipLevel level);
@@ -0,0 +1,70 @@
+/*
+ *  Source files of L, mapped in memory.
+ */
+
+#include "L_source.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool source_open (const char *path, Source * const p_source)
+{
+  struct stat st;
+
+  memset(p_source, 0, sizeof(Source));
+  p_source->data = "";
+
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  if (0 != fstat(fd, &st) || (uint64_t)st.st_size > UINT32_MAX)
+  {
+    close(fd);
+    return false;
+  }
+  if (0 == st.st_size)
+  {
+    close(fd);
+    return true;
+  }
+
+  // Reserve one more page of zeros, then map the file over the start: the
+  // byte after the file is either in the zeroed tail of its last page or
+  // in the extra page.
+  const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  const size_t len = (size_t)st.st_size;
+  const size_t size = (len / page + 1) * page;
+  void *p_base = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (MAP_FAILED == p_base)
+  {
+    close(fd);
+    return false;
+  }
+
+  void *p_file = mmap(p_base, len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+  close(fd);
+  if (MAP_FAILED == p_file)
+  {
+    munmap(p_base, size);
+    return false;
+  }
+
+  p_source->data = p_base;
+  p_source->len = len;
+  p_source->p_base = p_base;
+  p_source->size = size;
+  return true;
+}
+
+void source_close (Source * const p_source)
+{
+  if (NULL != p_source->p_base)
+    munmap(p_source->p_base, p_source->size);
+  memset(p_source, 0, sizeof(Source));
+  p_source->data = "";
+}
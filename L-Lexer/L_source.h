@@ -0,0 +1,24 @@
+/*
+ *  Source files of L, mapped in memory.
+ *
+ *  The bytes are mapped read-only and followed by a NUL sentinel, as needed
+ *  by the direct-coded scanner.  Sources are limited to UINT32_MAX bytes, so
+ *  that tokens can refer to them with 32-bit offsets.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct
+{
+  const char * data;   // data[len] == '\0'.
+  size_t       len;
+  void       * p_base; // Mapping, NULL for an empty file.
+  size_t       size;   // Mapped bytes.
+} Source;
+
+bool source_open (const char *path, Source * const p_source);
+
+void source_close (Source * const p_source);
@@ -0,0 +1,241 @@
+/*
+ *  Packed token stream of an L source.
+ */
+
+#include "L_token_stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void token_stream_init (TokenStream * const p_ts)
+{
+  memset(p_ts, 0, sizeof(TokenStream));
+}
+
+void token_stream_free (TokenStream * const p_ts)
+{
+  free(p_ts->kinds);
+  free(p_ts->starts);
+  free(p_ts->lens);
+  free(p_ts->lookahead_starts);
+  free(p_ts->lookahead_ends);
+  token_stream_init(p_ts);
+}
+
+bool token_is_trivia (int kind)
+{
+  return TOKEN_WS == kind || TOKEN_LINE_COMMENT == kind
+         || TOKEN_BLOCK_COMMENT == kind;
+}
+
+static bool reserve (TokenStream * const p_ts, size_t cap)
+{
+  if (cap <= p_ts->cap)
+    return true;
+
+  uint8_t *p_kinds = realloc(p_ts->kinds, cap * sizeof(uint8_t));
+  if (NULL != p_kinds)
+    p_ts->kinds = p_kinds;
+  uint32_t *p_starts = realloc(p_ts->starts, cap * sizeof(uint32_t));
+  if (NULL != p_starts)
+    p_ts->starts = p_starts;
+  uint32_t *p_lens = realloc(p_ts->lens, cap * sizeof(uint32_t));
+  if (NULL != p_lens)
+    p_ts->lens = p_lens;
+
+  if (NULL == p_kinds || NULL == p_starts || NULL == p_lens)
+    return false;
+
+  p_ts->cap = cap;
+  return true;
+}
+
+static bool push_lookahead (TokenStream * const p_ts,
+                            uint32_t start,
+                            uint32_t end)
+{
+  if (p_ts->n_lookahead == p_ts->cap_lookahead)
+  {
+    const size_t cap = (0 == p_ts->cap_lookahead) ? 16 : 2 * p_ts->cap_lookahead;
+    uint32_t *p_starts = realloc(p_ts->lookahead_starts, cap * sizeof(uint32_t));
+    if (NULL != p_starts)
+      p_ts->lookahead_starts = p_starts;
+    uint32_t *p_ends = realloc(p_ts->lookahead_ends, cap * sizeof(uint32_t));
+    if (NULL != p_ends)
+      p_ts->lookahead_ends = p_ends;
+    if (NULL == p_starts || NULL == p_ends)
+      return false;
+    p_ts->cap_lookahead = cap;
+  }
+
+  p_ts->lookahead_starts[p_ts->n_lookahead] = start;
+  p_ts->lookahead_ends[p_ts->n_lookahead] = end;
+  ++p_ts->n_lookahead;
+  return true;
+}
+
+bool token_stream_push (TokenStream * const p_ts,
+                        int kind,
+                        uint32_t start,
+                        uint32_t len)
+{
+  if (p_ts->n == p_ts->cap && !reserve(p_ts, (0 == p_ts->cap) ? 64 : 2 * p_ts->cap))
+    return false;
+
+  p_ts->kinds[p_ts->n] = (uint8_t)kind;
+  p_ts->starts[p_ts->n] = start;
+  p_ts->lens[p_ts->n] = len;
+  ++p_ts->n;
+  return true;
+}
+
+// Append the tokens of p_from from index first on.
+bool token_stream_concat (TokenStream * const p_ts,
+                          const TokenStream * const p_from,
+                          size_t first)
+{
+  const size_t n = (first < p_from->n) ? p_from->n - first : 0;
+  size_t cap = (0 == p_ts->cap) ? 64 : p_ts->cap;
+
+  while (cap < p_ts->n + n)
+    cap *= 2;
+  if (!reserve(p_ts, cap))
+    return false;
+
+  memcpy(p_ts->kinds + p_ts->n, p_from->kinds + first, n * sizeof(uint8_t));
+  memcpy(p_ts->starts + p_ts->n, p_from->starts + first, n * sizeof(uint32_t));
+  memcpy(p_ts->lens + p_ts->n, p_from->lens + first, n * sizeof(uint32_t));
+  p_ts->n += n;
+
+  for (size_t i = 0; 0 != n && i < p_from->n_lookahead; ++i)
+    if (p_from->lookahead_starts[i] >= p_from->starts[first]
+        && !push_lookahead(p_ts, p_from->lookahead_starts[i],
+                           p_from->lookahead_ends[i]))
+      return false;
+  return true;
+}
+
+// Replace the tokens of p_ts by those of p_from, lookahead entries included.
+bool token_stream_copy (TokenStream * const p_ts,
+                        const TokenStream * const p_from)
+{
+  p_ts->n = 0;
+  p_ts->n_lookahead = 0;
+  if (!reserve(p_ts, p_from->n))
+    return false;
+
+  memcpy(p_ts->kinds, p_from->kinds, p_from->n * sizeof(uint8_t));
+  memcpy(p_ts->starts, p_from->starts, p_from->n * sizeof(uint32_t));
+  memcpy(p_ts->lens, p_from->lens, p_from->n * sizeof(uint32_t));
+  p_ts->n = p_from->n;
+
+  for (size_t i = 0; i < p_from->n_lookahead; ++i)
+    if (!push_lookahead(p_ts, p_from->lookahead_starts[i],
+                        p_from->lookahead_ends[i]))
+      return false;
+  return true;
+}
+
+// Replace tokens [first, first + n_removed) by those of p_from, for source
+// bytes [from, to) that were replaced: the following ones move by delta.
+bool token_stream_splice (TokenStream * const p_ts,
+                          size_t first,
+                          size_t n_removed,
+                          const TokenStream * const p_from,
+                          size_t from,
+                          size_t to,
+                          int64_t delta)
+{
+  const size_t n = p_ts->n - n_removed + p_from->n;
+  const size_t tail = first + n_removed;
+  size_t cap = (0 == p_ts->cap) ? 64 : p_ts->cap;
+
+  while (cap < n)
+    cap *= 2;
+  if (!reserve(p_ts, cap))
+    return false;
+
+  const size_t n_tail = p_ts->n - tail;
+  const size_t new_tail = first + p_from->n;
+  memmove(p_ts->kinds + new_tail, p_ts->kinds + tail, n_tail * sizeof(uint8_t));
+  memmove(p_ts->starts + new_tail, p_ts->starts + tail, n_tail * sizeof(uint32_t));
+  memmove(p_ts->lens + new_tail, p_ts->lens + tail, n_tail * sizeof(uint32_t));
+  memcpy(p_ts->kinds + first, p_from->kinds, p_from->n * sizeof(uint8_t));
+  memcpy(p_ts->starts + first, p_from->starts, p_from->n * sizeof(uint32_t));
+  memcpy(p_ts->lens + first, p_from->lens, p_from->n * sizeof(uint32_t));
+  for (size_t i = new_tail; i < n; ++i)
+    p_ts->starts[i] += (uint32_t)delta;
+  p_ts->n = n;
+
+  size_t kept = 0;
+  for (size_t i = 0; i < p_ts->n_lookahead; ++i)
+  {
+    const uint32_t start = p_ts->lookahead_starts[i];
+    const uint32_t end = p_ts->lookahead_ends[i];
+    if (start >= from && start < to)
+      continue;
+
+    p_ts->lookahead_starts[kept] = (start < from) ? start : start + (uint32_t)delta;
+    p_ts->lookahead_ends[kept] = (start < from) ? end : end + (uint32_t)delta;
+    ++kept;
+  }
+  p_ts->n_lookahead = kept;
+
+  for (size_t i = 0; i < p_from->n_lookahead; ++i)
+    if (!push_lookahead(p_ts, p_from->lookahead_starts[i],
+                        p_from->lookahead_ends[i]))
+      return false;
+  return true;
+}
+
+// Lex the token of src at pos: returns its end, SIZE_MAX when out of memory.
+size_t token_stream_scan (TokenStream * const p_ts,
+                          const char *src,
+                          size_t pos,
+                          int *p_kind)
+{
+  const unsigned char * const p_src = (const unsigned char *)src;
+  const unsigned char *p_read;
+  const size_t end = (size_t)(lex_scan_direct(p_src + pos, p_kind, &p_read)
+                              - p_src);
+  const size_t read = (size_t)(p_read - p_src);
+
+  if (read > end + 1 && !push_lookahead(p_ts, (uint32_t)pos, (uint32_t)read))
+    return SIZE_MAX;
+  return end;
+}
+
+// Append the tokens of src starting in [from, to), the last one may end
+// after to.  Returns the end of the last token, SIZE_MAX when out of memory.
+size_t token_stream_append (TokenStream * const p_ts,
+                            const char *src,
+                            size_t from,
+                            size_t to)
+{
+  size_t pos = from;
+
+  while (pos < to)
+  {
+    int kind;
+    const size_t end = token_stream_scan(p_ts, src, pos, &kind);
+
+    if (SIZE_MAX == end
+        || (!token_is_trivia(kind)
+            && !token_stream_push(p_ts, kind, (uint32_t)pos,
+                                  (uint32_t)(end - pos))))
+      return SIZE_MAX;
+    pos = end;
+  }
+
+  return pos;
+}
+
+// src[len] must be '\0', see lex_scan_direct.
+bool token_stream_lex (TokenStream * const p_ts, const char *src, size_t len)
+{
+  p_ts->n = 0;
+  p_ts->n_lookahead = 0;
+  return len <= UINT32_MAX && reserve(p_ts, 16 + len / 8)
+         && SIZE_MAX != token_stream_append(p_ts, src, 0, len)
+         && token_stream_push(p_ts, TOKEN_EOF, (uint32_t)len, 0);
+}
@@ -0,0 +1,74 @@
+/*
+ *  Packed token stream of an L source.
+ *
+ *  Tokens are kept as a struct of arrays, 9 bytes per token: the kinds are
+ *  contiguous so that a parser can stream them, and the text of a token is
+ *  the span [start, start + len) of the source, which is never copied.
+ *  Whitespace and comments are dropped, and the stream always ends with a
+ *  TOKEN_EOF of length 0 at the end of the source.
+ *
+ *  The few tokens whose lexing read more than one byte past their end, such
+ *  as a '/' starting an unterminated comment, are listed apart with the end
+ *  of what was read: an edit there may change them (see L_incremental.h).
+ */
+
+#pragma once
+
+#include "L_tables.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+_Static_assert(TOKEN_ERROR <= UINT8_MAX, "token kinds must fit in a byte");
+
+typedef struct
+{
+  uint8_t  * kinds;
+  uint32_t * starts;
+  uint32_t * lens;
+  size_t     n;
+  size_t     cap;
+  uint32_t * lookahead_starts; // Whitespace and comments included.
+  uint32_t * lookahead_ends;
+  size_t     n_lookahead;
+  size_t     cap_lookahead;
+} TokenStream;
+
+void token_stream_init (TokenStream * const p_ts);
+
+void token_stream_free (TokenStream * const p_ts);
+
+bool token_stream_lex (TokenStream * const p_ts, const char *src, size_t len);
+
+bool token_stream_push (TokenStream * const p_ts,
+                        int kind,
+                        uint32_t start,
+                        uint32_t len);
+
+bool token_stream_concat (TokenStream * const p_ts,
+                          const TokenStream * const p_from,
+                          size_t first);
+
+bool token_stream_copy (TokenStream * const p_ts,
+                        const TokenStream * const p_from);
+
+bool token_stream_splice (TokenStream * const p_ts,
+                          size_t first,
+                          size_t n_removed,
+                          const TokenStream * const p_from,
+                          size_t from,
+                          size_t to,
+                          int64_t delta);
+
+size_t token_stream_scan (TokenStream * const p_ts,
+                          const char *src,
+                          size_t pos,
+                          int *p_kind);
+
+size_t token_stream_append (TokenStream * const p_ts,
+                            const char *src,
+                            size_t from,
+                            size_t to);
+
+bool token_is_trivia (int kind);
@@ -0,0 +1,66 @@
+/*
+ *  Arena allocator for the L front end.
+ */
+
+#include "L_arena.h"
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define ARENA_BLOCK (256 * 1024)
+
+struct ArenaBlock
+{
+  ArenaBlock *          p_next;
+  size_t                used;
+  size_t                size;
+  alignas(max_align_t) unsigned char bytes [];
+};
+
+void arena_init (Arena * const p_arena)
+{
+  p_arena->p_blocks = NULL;
+  p_arena->n_bytes = 0;
+}
+
+void arena_free (Arena * const p_arena)
+{
+  ArenaBlock *p_block = p_arena->p_blocks;
+
+  while (NULL != p_block)
+  {
+    ArenaBlock * const p_next = p_block->p_next;
+    free(p_block);
+    p_block = p_next;
+  }
+
+  arena_init(p_arena);
+}
+
+void * arena_alloc (Arena * const p_arena, size_t size)
+{
+  ArenaBlock *p_block = p_arena->p_blocks;
+
+  if (size > SIZE_MAX - alignof(max_align_t) - sizeof(ArenaBlock))
+    return NULL;
+  size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+
+  if (NULL == p_block || p_block->used + size > p_block->size)
+  {
+    const size_t block_size = (size > ARENA_BLOCK) ? size : ARENA_BLOCK;
+    p_block = malloc(sizeof(ArenaBlock) + block_size);
+    if (NULL == p_block)
+      return NULL;
+
+    p_block->p_next = p_arena->p_blocks;
+    p_block->used = 0;
+    p_block->size = block_size;
+    p_arena->p_blocks = p_block;
+  }
+
+  void * const p = p_block->bytes + p_block->used;
+  p_block->used += size;
+  p_arena->n_bytes += size;
+  return p;
+}
@@ -0,0 +1,26 @@
+/*
+ *  Arena allocator for the L front end.
+ *
+ *  Allocations are carved from large blocks and never freed one by one:
+ *  the whole arena is released at once, when the AST it holds is no longer
+ *  needed.  An arena is not shared between threads.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct
+{
+  ArenaBlock * p_blocks; // Current block first.
+  size_t       n_bytes;  // Bytes handed out.
+} Arena;
+
+void arena_init (Arena * const p_arena);
+
+void arena_free (Arena * const p_arena);
+
+// Aligned for any type, NULL when out of memory.
+void * arena_alloc (Arena * const p_arena, size_t size);
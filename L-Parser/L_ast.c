@@ -0,0 +1,222 @@
+/*
+ *  Abstract syntax tree of L.
+ */
+
+#include "L_ast.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define INDENTATION 1 // Child indentation when the tree is printed.
+
+const char * const ast_kind_names [AST_N_KINDS] =
+{
+  "Program", "Fn", "Param", "Type", "Block", "Let", "If", "While", "Return",
+  "ExprStmt", "Assign", "Binary", "Unary", "Call", "Index", "Ident", "Int",
+  "String", "Bool"
+};
+
+/**** Builder. ****/
+
+void ast_builder_init (AstBuilder * const p_builder)
+{
+  memset(p_builder, 0, sizeof(AstBuilder));
+}
+
+void ast_builder_free (AstBuilder * const p_builder)
+{
+  free(p_builder->kinds);
+  free(p_builder->tokens);
+  free(p_builder->sizes);
+  ast_builder_init(p_builder);
+}
+
+static bool reserve (AstBuilder * const p_builder, size_t cap)
+{
+  uint8_t *p_kinds = realloc(p_builder->kinds, cap * sizeof(uint8_t));
+  if (NULL != p_kinds)
+    p_builder->kinds = p_kinds;
+  uint32_t *p_tokens = realloc(p_builder->tokens, cap * sizeof(uint32_t));
+  if (NULL != p_tokens)
+    p_builder->tokens = p_tokens;
+  uint32_t *p_sizes = realloc(p_builder->sizes, cap * sizeof(uint32_t));
+  if (NULL != p_sizes)
+    p_builder->sizes = p_sizes;
+
+  if (NULL == p_kinds || NULL == p_tokens || NULL == p_sizes)
+    return false;
+
+  p_builder->cap = cap;
+  return true;
+}
+
+bool ast_builder_push (AstBuilder * const p_builder,
+                       int kind,
+                       size_t token,
+                       size_t first)
+{
+  if (p_builder->n == p_builder->cap
+      && !reserve(p_builder, (0 == p_builder->cap) ? 256 : 2 * p_builder->cap))
+    return false;
+
+  p_builder->kinds[p_builder->n] = (uint8_t)kind;
+  p_builder->tokens[p_builder->n] = (uint32_t)token;
+  p_builder->sizes[p_builder->n] = (uint32_t)(p_builder->n - first + 1);
+  ++p_builder->n;
+  return true;
+}
+
+// A subtree spans [i - size + 1, i] in post-order, and starts in pre-order
+// at the same index plus its depth, one per ancestor it comes after.  The
+// nodes are visited from the last, as a parent comes before its children,
+// with a stack of the post-order starts of the ancestors.  The builder may
+// hold several trees, laid out one after the other.
+static bool lay_out (const AstBuilder * const p_builder,
+                     uint8_t * const p_kinds,
+                     uint32_t * const p_tokens,
+                     uint32_t * const p_sizes)
+{
+  const size_t n = p_builder->n;
+  uint32_t * const p_stack = malloc(n * sizeof(uint32_t));
+  size_t depth = 0;
+
+  if (NULL == p_stack && 0 != n)
+    return false;
+
+  for (size_t i = n; i-- > 0; )
+  {
+    const uint32_t start = (uint32_t)(i + 1 - p_builder->sizes[i]);
+    while (0 != depth && p_stack[depth - 1] > i)
+      --depth;
+
+    const size_t pre = start + depth;
+    p_kinds[pre] = p_builder->kinds[i];
+    p_tokens[pre] = p_builder->tokens[i];
+    p_sizes[pre] = p_builder->sizes[i];
+    p_stack[depth++] = start;
+  }
+
+  free(p_stack);
+  return true;
+}
+
+bool ast_build (const AstBuilder * const p_builder,
+                Arena * const p_arena,
+                Ast * const p_ast)
+{
+  const size_t n = p_builder->n;
+  uint8_t * const p_kinds = arena_alloc(p_arena, n * sizeof(uint8_t));
+  uint32_t * const p_tokens = arena_alloc(p_arena, n * sizeof(uint32_t));
+  uint32_t * const p_sizes = arena_alloc(p_arena, n * sizeof(uint32_t));
+
+  if (NULL == p_kinds || NULL == p_tokens || NULL == p_sizes
+      || !lay_out(p_builder, p_kinds, p_tokens, p_sizes))
+    return false;
+
+  p_ast->kinds = p_kinds;
+  p_ast->tokens = p_tokens;
+  p_ast->sizes = p_sizes;
+  p_ast->n = n;
+  return true;
+}
+
+// The nodes before from are copied as they are, but for the sizes of parent
+// and its ancestors, the nodes from to on with their tokens moved by delta.
+bool ast_splice (const Ast * const p_old,
+                 uint32_t parent,
+                 uint32_t from,
+                 uint32_t to,
+                 const AstBuilder * const p_builder,
+                 int64_t delta,
+                 Arena * const p_arena,
+                 Ast * const p_ast)
+{
+  const size_t n = p_old->n - (to - from) + p_builder->n;
+  const uint32_t end = from + (uint32_t)p_builder->n;
+  uint8_t * const p_kinds = arena_alloc(p_arena, n * sizeof(uint8_t));
+  uint32_t * const p_tokens = arena_alloc(p_arena, n * sizeof(uint32_t));
+  uint32_t * const p_sizes = arena_alloc(p_arena, n * sizeof(uint32_t));
+
+  if (NULL == p_kinds || NULL == p_tokens || NULL == p_sizes
+      || !lay_out(p_builder, p_kinds + from, p_tokens + from, p_sizes + from))
+    return false;
+
+  memcpy(p_kinds, p_old->kinds, from * sizeof(uint8_t));
+  memcpy(p_tokens, p_old->tokens, from * sizeof(uint32_t));
+  memcpy(p_sizes, p_old->sizes, from * sizeof(uint32_t));
+
+  // The ancestors are the nodes up to parent whose subtree holds parent's.
+  for (uint32_t i = 0; i <= parent; ++i)
+    if (i + p_old->sizes[i] >= parent + p_old->sizes[parent])
+      p_sizes[i] = p_old->sizes[i] - (to - from) + (uint32_t)p_builder->n;
+
+  memcpy(p_kinds + end, p_old->kinds + to, (p_old->n - to) * sizeof(uint8_t));
+  memcpy(p_sizes + end, p_old->sizes + to, (p_old->n - to) * sizeof(uint32_t));
+  for (size_t i = to; i < p_old->n; ++i)
+    p_tokens[end + i - to] = (uint32_t)((int64_t)p_old->tokens[i] + delta);
+
+  p_ast->kinds = p_kinds;
+  p_ast->tokens = p_tokens;
+  p_ast->sizes = p_sizes;
+  p_ast->n = n;
+  return true;
+}
+
+/**** Iteration. ****/
+
+uint32_t ast_n_children (const Ast * const p_ast, uint32_t i)
+{
+  uint32_t n = 0;
+  AST_FOR_CHILDREN(p_ast, i, child)
+    ++n;
+  return n;
+}
+
+uint32_t ast_child (const Ast * const p_ast, uint32_t i, uint32_t k)
+{
+  AST_FOR_CHILDREN(p_ast, i, child)
+    if (0 == k--)
+      return child;
+  return UINT32_MAX;
+}
+
+// Kinds whose token is worth printing.
+static bool has_text (int kind)
+{
+  return AST_PROGRAM != kind && AST_BLOCK != kind && AST_IF != kind
+         && AST_WHILE != kind && AST_RETURN != kind && AST_EXPR_STMT != kind;
+}
+
+// The depth of a node is the number of open subtrees, kept by their ends.
+bool ast_print (const Ast * const p_ast,
+                const TokenStream * const p_ts,
+                const char *src,
+                FILE *fp)
+{
+  uint32_t * const p_ends = malloc(p_ast->n * sizeof(uint32_t));
+  size_t depth = 0;
+
+  if (NULL == p_ends && 0 != p_ast->n)
+    return false;
+
+  for (uint32_t i = 0; i < p_ast->n; ++i)
+  {
+    while (0 != depth && p_ends[depth - 1] <= i)
+      --depth;
+
+    for (size_t j = 0; j < depth * INDENTATION; ++j)
+      fputs("-", fp);
+
+    const uint32_t token = p_ast->tokens[i];
+    if (has_text(p_ast->kinds[i]))
+      fprintf(fp, "%s '%.*s'\n", ast_kind_names[p_ast->kinds[i]],
+              (int)p_ts->lens[token], src + p_ts->starts[token]);
+    else
+      fprintf(fp, "%s\n", ast_kind_names[p_ast->kinds[i]]);
+
+    p_ends[depth++] = i + p_ast->sizes[i];
+  }
+
+  free(p_ends);
+  return true;
+}
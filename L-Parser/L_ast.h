@@ -0,0 +1,128 @@
+/*
+ *  Abstract syntax tree of L.
+ *
+ *  The tree is flat: nodes are stored in pre-order in three arrays, so that
+ *  a traversal is a linear scan and a copy is a memcpy.  A node is its kind,
+ *  the index of its main token in the token stream and the size of its
+ *  subtree, 9 bytes in all: its first child follows it, and its next sibling
+ *  follows its subtree.  The token is the name of a function, parameter or
+ *  variable, the operator of an expression, the first token of a statement.
+ *  The root, node 0, is the AST_PROGRAM.
+ *
+ *  Children by kind ([] is optional, * repeated):
+ *  AST_PROGRAM    AST_FN*
+ *  AST_FN         AST_PARAM* [AST_TYPE] AST_BLOCK     token: name
+ *  AST_PARAM      [AST_TYPE]                          token: name
+ *  AST_TYPE                                           token: name
+ *  AST_BLOCK      statement*
+ *  AST_LET        [AST_TYPE] expression               token: name
+ *  AST_IF         expression AST_BLOCK [AST_BLOCK | AST_IF]
+ *  AST_WHILE      expression AST_BLOCK
+ *  AST_RETURN     [expression]
+ *  AST_EXPR_STMT  expression
+ *  AST_ASSIGN     expression expression               token: '='
+ *  AST_BINARY     expression expression               token: operator
+ *  AST_UNARY      expression                          token: operator
+ *  AST_CALL       expression expression*              token: '('
+ *  AST_INDEX      expression expression               token: '['
+ *  AST_IDENT, AST_INT, AST_STRING, AST_BOOL           token: the literal
+ */
+
+#pragma once
+
+#include "L_arena.h"
+#include "L_token_stream.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum
+{
+  AST_PROGRAM,
+  AST_FN,
+  AST_PARAM,
+  AST_TYPE,
+  AST_BLOCK,
+  AST_LET,
+  AST_IF,
+  AST_WHILE,
+  AST_RETURN,
+  AST_EXPR_STMT,
+  AST_ASSIGN,
+  AST_BINARY,
+  AST_UNARY,
+  AST_CALL,
+  AST_INDEX,
+  AST_IDENT,
+  AST_INT,
+  AST_STRING,
+  AST_BOOL,
+  AST_N_KINDS
+} AstKind;
+
+// Arrays in an arena, or in a mapped file.
+typedef struct
+{
+  const uint8_t  * kinds;
+  const uint32_t * tokens;
+  const uint32_t * sizes;  // Nodes in the subtree, the node included.
+  size_t           n;
+} Ast;
+
+// AST being built by the parser in post-order: a node comes right after its
+// children, once they are known.
+typedef struct
+{
+  uint8_t  * kinds;
+  uint32_t * tokens;
+  uint32_t * sizes;
+  size_t     n;
+  size_t     cap;
+} AstBuilder;
+
+// Children of node i, first to last.
+#define AST_FOR_CHILDREN(p_ast, i, child)                                     \
+  for (uint32_t child = (i) + 1; child < (i) + (p_ast)->sizes[i];             \
+       child += (p_ast)->sizes[child])
+
+extern const char * const ast_kind_names [AST_N_KINDS];
+
+void ast_builder_init (AstBuilder * const p_builder);
+
+void ast_builder_free (AstBuilder * const p_builder);
+
+// Append a node whose children are the nodes from first on.
+bool ast_builder_push (AstBuilder * const p_builder,
+                       int kind,
+                       size_t token,
+                       size_t first);
+
+// Lay the nodes out in pre-order, in p_arena.
+bool ast_build (const AstBuilder * const p_builder,
+                Arena * const p_arena,
+                Ast * const p_ast);
+
+// Copy p_old in p_arena, with its nodes [from, to), children of node parent,
+// replaced by the trees of p_builder, and the tokens of the nodes from to on
+// moved by delta.
+bool ast_splice (const Ast * const p_old,
+                 uint32_t parent,
+                 uint32_t from,
+                 uint32_t to,
+                 const AstBuilder * const p_builder,
+                 int64_t delta,
+                 Arena * const p_arena,
+                 Ast * const p_ast);
+
+uint32_t ast_n_children (const Ast * const p_ast, uint32_t i);
+
+// k-th child of node i, UINT32_MAX if there are fewer children.
+uint32_t ast_child (const Ast * const p_ast, uint32_t i, uint32_t k);
+
+// One node per line, children indented with '-', as node_print does.
+bool ast_print (const Ast * const p_ast,
+                const TokenStream * const p_ts,
+                const char *src,
+                FILE *fp);
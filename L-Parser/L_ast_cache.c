@@ -0,0 +1,216 @@
+/*
+ *  On-disk cache of the tokens and syntax trees of L sources.
+ */
+
+#include "L_ast_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEY_MAGIC "L-AST"
+
+typedef struct
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t n_token_kinds;
+  uint32_t n_ast_kinds;
+  uint32_t front_end_hash;
+  uint64_t tables_hash;
+  uint64_t len;
+  uint64_t hash;
+} Key;
+
+// The value is the counts, the 32-bit arrays, then the 8-bit ones, so that
+// every array is aligned in the mapped entry.
+typedef struct
+{
+  uint64_t n_tokens;
+  uint64_t n_lookahead;
+  uint64_t n_nodes;
+} Counts;
+
+// Hash of the scanner tables and token names, the same for every key.
+static uint64_t tables_hash (void)
+{
+  uint64_t h = hash_bytes(lex_class_of, sizeof(lex_class_of), 0);
+  h = hash_bytes(lex_trans, sizeof(lex_trans), h);
+  h = hash_bytes(lex_accept, sizeof(lex_accept), h);
+  for (int kind = 0; kind <= TOKEN_ERROR; ++kind)
+    h = hash_bytes(token_names[kind], strlen(token_names[kind]) + 1, h);
+  return h;
+}
+
+static void make_key (const Source * const p_source, Key * const p_key)
+{
+  memset(p_key, 0, sizeof(Key));
+  memcpy(p_key->magic, KEY_MAGIC, sizeof(KEY_MAGIC));
+  p_key->version = AST_CACHE_VERSION;
+  p_key->n_token_kinds = TOKEN_ERROR + 1;
+  p_key->n_ast_kinds = AST_N_KINDS;
+  p_key->front_end_hash = L_FRONT_END_HASH;
+  p_key->tables_hash = tables_hash();
+  p_key->len = p_source->len;
+  p_key->hash = hash_bytes(p_source->data, p_source->len, 0);
+}
+
+// With counts of at most UINT32_MAX, as tokens and nodes are indexed with 32
+// bits, the size does not wrap.
+static uint64_t value_size (const Counts * const p_counts)
+{
+  return sizeof(Counts)
+         + 2 * (p_counts->n_tokens + p_counts->n_lookahead + p_counts->n_nodes)
+           * sizeof(uint32_t)
+         + (p_counts->n_tokens + p_counts->n_nodes) * sizeof(uint8_t);
+}
+
+// Entries are checked before use, as a corrupt or forged file must not send
+// the front end out of its arrays: the tokens must lie in the source, end with
+// TOKEN_EOF, and the nodes refer to tokens and lie in the tree.
+static bool valid_entry (const Source * const p_source,
+                         const TokenStream * const p_ts,
+                         const Ast * const p_ast)
+{
+  if (TOKEN_EOF != p_ts->kinds[p_ts->n - 1])
+    return false;
+  for (size_t i = 0; i < p_ts->n; ++i)
+    if (TOKEN_ERROR < p_ts->kinds[i] || p_ts->starts[i] > p_source->len
+        || p_ts->lens[i] > p_source->len - p_ts->starts[i])
+      return false;
+  for (size_t i = 0; i < p_ts->n_lookahead; ++i)
+    if (p_ts->lookahead_starts[i] > p_ts->lookahead_ends[i]
+        || p_ts->lookahead_ends[i] > p_source->len)
+      return false;
+
+  if (AST_PROGRAM != p_ast->kinds[0] || p_ast->n != p_ast->sizes[0])
+    return false;
+  for (size_t i = 0; i < p_ast->n; ++i)
+    if (AST_N_KINDS <= p_ast->kinds[i] || p_ast->tokens[i] >= p_ts->n
+        || 0 == p_ast->sizes[i] || p_ast->sizes[i] > p_ast->n - i)
+      return false;
+  return true;
+}
+
+bool ast_cache_open_default (DiskCache * const p_cache)
+{
+  const char *dir = getenv("L_CACHE_DIR");
+  const char *max = getenv("L_CACHE_MAX_BYTES");
+  const uint64_t max_bytes = (NULL != max) ? strtoull(max, NULL, 10)
+                                           : AST_CACHE_DEFAULT_MAX_BYTES;
+  char path[4096];
+
+  memset(p_cache, 0, sizeof(DiskCache));
+  if (NULL != dir)
+    snprintf(path, sizeof(path), "%s", dir);
+  else if (NULL != (dir = getenv("XDG_CACHE_HOME")))
+    snprintf(path, sizeof(path), "%s/L_parser", dir);
+  else if (NULL != (dir = getenv("HOME")))
+    snprintf(path, sizeof(path), "%s/.cache/L_parser", dir);
+  else
+    return false;
+
+  return disk_cache_open(p_cache, path, max_bytes);
+}
+
+bool ast_cache_get (DiskCache * const p_cache,
+                    const Source * const p_source,
+                    TokenStream * const p_ts,
+                    Ast * const p_ast,
+                    DiskCacheEntry * const p_entry)
+{
+  Key key;
+  make_key(p_source, &key);
+  if (!disk_cache_get(p_cache, &key, sizeof(key), p_entry))
+    return false;
+
+  // Entries of another layout, or not valid, are taken as misses.
+  Counts counts;
+  if (p_entry->value_size < sizeof(Counts))
+  {
+    disk_cache_release(p_entry);
+    return false;
+  }
+  memcpy(&counts, p_entry->p_value, sizeof(Counts));
+  if (0 == counts.n_tokens || UINT32_MAX < counts.n_tokens
+      || UINT32_MAX < counts.n_lookahead || 0 == counts.n_nodes
+      || UINT32_MAX < counts.n_nodes
+      || value_size(&counts) != p_entry->value_size)
+  {
+    disk_cache_release(p_entry);
+    return false;
+  }
+
+  uint32_t * const p_words = (uint32_t *)((const Counts *)p_entry->p_value + 1);
+  uint8_t * const p_bytes = (uint8_t *)(p_words + 2 * (counts.n_tokens
+                                                       + counts.n_lookahead
+                                                       + counts.n_nodes));
+  const TokenStream mapped =
+  {
+    .kinds = p_bytes,
+    .starts = p_words,
+    .lens = p_words + counts.n_tokens,
+    .n = counts.n_tokens,
+    .lookahead_starts = p_words + 2 * counts.n_tokens,
+    .lookahead_ends = p_words + 2 * counts.n_tokens + counts.n_lookahead,
+    .n_lookahead = counts.n_lookahead
+  };
+
+  const uint32_t * const p_nodes = p_words + 2 * (counts.n_tokens
+                                                  + counts.n_lookahead);
+  const Ast ast =
+  {
+    .kinds = p_bytes + counts.n_tokens,
+    .tokens = p_nodes,
+    .sizes = p_nodes + counts.n_nodes,
+    .n = counts.n_nodes
+  };
+
+  if (!valid_entry(p_source, &mapped, &ast) || !token_stream_copy(p_ts, &mapped))
+  {
+    disk_cache_release(p_entry);
+    return false;
+  }
+
+  *p_ast = ast;
+  return true;
+}
+
+bool ast_cache_put (DiskCache * const p_cache,
+                    const Source * const p_source,
+                    const TokenStream * const p_ts,
+                    const Ast * const p_ast)
+{
+  const Counts counts = { p_ts->n, p_ts->n_lookahead, p_ast->n };
+  const uint64_t size = value_size(&counts);
+  Key key;
+
+  // An entry over the limit would be evicted right away.
+  Counts * const p_value = (size <= p_cache->max_bytes) ? malloc(size) : NULL;
+  if (NULL == p_value)
+    return false;
+
+  *p_value = counts;
+  uint32_t *p_words = (uint32_t *)(p_value + 1);
+  memcpy(p_words, p_ts->starts, p_ts->n * sizeof(uint32_t));
+  p_words += p_ts->n;
+  memcpy(p_words, p_ts->lens, p_ts->n * sizeof(uint32_t));
+  p_words += p_ts->n;
+  memcpy(p_words, p_ts->lookahead_starts, p_ts->n_lookahead * sizeof(uint32_t));
+  p_words += p_ts->n_lookahead;
+  memcpy(p_words, p_ts->lookahead_ends, p_ts->n_lookahead * sizeof(uint32_t));
+  p_words += p_ts->n_lookahead;
+  memcpy(p_words, p_ast->tokens, p_ast->n * sizeof(uint32_t));
+  p_words += p_ast->n;
+  memcpy(p_words, p_ast->sizes, p_ast->n * sizeof(uint32_t));
+  p_words += p_ast->n;
+
+  uint8_t * const p_bytes = (uint8_t *)p_words;
+  memcpy(p_bytes, p_ts->kinds, p_ts->n * sizeof(uint8_t));
+  memcpy(p_bytes + p_ts->n, p_ast->kinds, p_ast->n * sizeof(uint8_t));
+
+  make_key(p_source, &key);
+  const bool ok = disk_cache_put(p_cache, &key, sizeof(key), p_value, size);
+  free(p_value);
+  return ok;
+}
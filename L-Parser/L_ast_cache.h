@@ -0,0 +1,44 @@
+/*
+ *  On-disk cache of the tokens and syntax trees of L sources.
+ *
+ *  Most files do not change between two runs.  Their token stream and flat
+ *  AST are stored in a disk cache (see RE_cache.h) under a key made of the
+ *  entry layout, of the front end that built them and of the length and a
+ *  hash of the source bytes, so that renamed or copied files hit too.  The
+ *  front end is told by a hash of the scanner tables and by a checksum of
+ *  L.tokens and of the parser sources, L_FRONT_END_HASH, that the Makefile
+ *  passes: a new lexer or parser misses the entries of the old one.  A hit maps the
+ *  entry instead of lexing and parsing: the tokens are copied to the stream,
+ *  and the AST is used in place until the entry is released.
+ */
+
+#pragma once
+
+#include "L_ast.h"
+#include "L_source.h"
+#include "L_token_stream.h"
+#include "RE_cache.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Bump when the layout of the entries changes.
+#define AST_CACHE_VERSION 2
+
+#define AST_CACHE_DEFAULT_MAX_BYTES ((uint64_t)256 << 20)
+
+// The directory is $L_CACHE_DIR, or L_parser in $XDG_CACHE_HOME or in
+// ~/.cache.  The size limit is $L_CACHE_MAX_BYTES.
+bool ast_cache_open_default (DiskCache * const p_cache);
+
+// On a hit, p_ast points into p_entry, to be released after its last use.
+bool ast_cache_get (DiskCache * const p_cache,
+                    const Source * const p_source,
+                    TokenStream * const p_ts,
+                    Ast * const p_ast,
+                    DiskCacheEntry * const p_entry);
+
+bool ast_cache_put (DiskCache * const p_cache,
+                    const Source * const p_source,
+                    const TokenStream * const p_ts,
+                    const Ast * const p_ast);
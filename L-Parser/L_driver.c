@@ -0,0 +1,205 @@
+/*
+ *  Parallel front end for many L files.
+ */
+
+#define _GNU_SOURCE // qsort_r
+
+#include "L_driver.h"
+#include "L_pool.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+typedef struct
+{
+  FrontEnd * p_front_end;
+  size_t   * order; // Files by decreasing size.
+  off_t    * sizes;
+} Run;
+
+static double now (void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + 1e-9 * (double)t.tv_nsec;
+}
+
+static bool intern_identifiers (Interner * const p_interner,
+                                const FrontEndFile * const p_file)
+{
+  const TokenStream * const p_ts = &p_file->tokens;
+
+  for (size_t i = 0; i < p_ts->n; ++i)
+    if (TOKEN_IDENT == p_ts->kinds[i]
+        && INTERN_NONE == intern(p_interner, p_file->source.data + p_ts->starts[i],
+                                 p_ts->lens[i]))
+      return false;
+  return true;
+}
+
+static void process_file (void *p_context, size_t task, int worker)
+{
+  const Run * const p_run = p_context;
+  FrontEnd * const p_front_end = p_run->p_front_end;
+  FrontEndFile * const p_file = &p_front_end->files[p_run->order[task]];
+  const double t0 = now();
+
+  p_file->worker = worker;
+  if (!source_open(p_file->path, &p_file->source))
+  {
+    p_file->status = FILE_UNREADABLE;
+    return;
+  }
+
+  DiskCache * const p_cache = (NULL != p_front_end->caches)
+                              ? &p_front_end->caches[worker] : NULL;
+  if (NULL != p_cache
+      && ast_cache_get(p_cache, &p_file->source, &p_file->tokens, &p_file->ast,
+                       &p_file->cache_entry))
+  {
+    const double t1 = now();
+    p_file->cached = true;
+    p_file->status = intern_identifiers(p_front_end->p_interner, p_file)
+                     ? FILE_PARSED : FILE_OUT_OF_MEMORY;
+    p_file->lex_seconds = t1 - t0;
+    p_file->parse_seconds = now() - t1;
+    return;
+  }
+
+  if (!token_stream_lex(&p_file->tokens, p_file->source.data, p_file->source.len))
+  {
+    p_file->status = FILE_OUT_OF_MEMORY;
+    return;
+  }
+
+  const double t1 = now();
+  if (parse_program(&p_file->tokens, &p_front_end->arenas[worker], &p_file->ast,
+                    &p_file->error))
+    p_file->status = intern_identifiers(p_front_end->p_interner, p_file)
+                     ? FILE_PARSED : FILE_OUT_OF_MEMORY;
+  else
+    p_file->status = (NULL != p_file->error.expected) ? FILE_SYNTAX_ERROR
+                                                      : FILE_OUT_OF_MEMORY;
+
+  // A failed store only costs the next run a parse.
+  if (NULL != p_cache && FILE_PARSED == p_file->status)
+    ast_cache_put(p_cache, &p_file->source, &p_file->tokens, &p_file->ast);
+
+  p_file->lex_seconds = t1 - t0;
+  p_file->parse_seconds = now() - t1;
+}
+
+static void open_caches (FrontEnd * const p_front_end)
+{
+  const int n_workers = p_front_end->n_workers;
+  p_front_end->caches = calloc((size_t)n_workers, sizeof(DiskCache));
+  if (NULL == p_front_end->caches)
+    return;
+
+  for (int w = 0; w < n_workers; ++w)
+    if (!ast_cache_open_default(&p_front_end->caches[w]))
+    {
+      while (w-- > 0)
+        disk_cache_close(&p_front_end->caches[w]);
+      free(p_front_end->caches);
+      p_front_end->caches = NULL;
+      return;
+    }
+  p_front_end->use_cache = true;
+}
+
+// Closing a handle adds its counters to the stats file of the directory.
+static void close_caches (FrontEnd * const p_front_end)
+{
+  DiskCacheStats * const p_stats = &p_front_end->cache_stats;
+
+  for (int w = 0; NULL != p_front_end->caches && w < p_front_end->n_workers; ++w)
+  {
+    const DiskCacheStats * const p_worker = &p_front_end->caches[w].stats;
+    p_stats->hits += p_worker->hits;
+    p_stats->misses += p_worker->misses;
+    p_stats->stores += p_worker->stores;
+    p_stats->evictions += p_worker->evictions;
+    disk_cache_close(&p_front_end->caches[w]);
+  }
+  free(p_front_end->caches);
+  p_front_end->caches = NULL;
+}
+
+static int compare_sizes (const void *p_a, const void *p_b, void *p_sizes)
+{
+  const off_t a = ((const off_t *)p_sizes)[*(const size_t *)p_a];
+  const off_t b = ((const off_t *)p_sizes)[*(const size_t *)p_b];
+  return (a < b) - (a > b);
+}
+
+bool front_end_run (FrontEnd * const p_front_end,
+                    char **paths,
+                    size_t n_files,
+                    int n_workers,
+                    bool use_cache)
+{
+  const double t0 = now();
+  Run run = { p_front_end, malloc(n_files * sizeof(size_t)),
+              malloc(n_files * sizeof(off_t)) };
+
+  memset(p_front_end, 0, sizeof(FrontEnd));
+  p_front_end->files = calloc(n_files, sizeof(FrontEndFile));
+  p_front_end->arenas = calloc((size_t)n_workers, sizeof(Arena));
+  p_front_end->p_interner = interner_new();
+  if (NULL == run.order || NULL == run.sizes || NULL == p_front_end->files
+      || NULL == p_front_end->arenas || NULL == p_front_end->p_interner)
+  {
+    free(run.order);
+    free(run.sizes);
+    front_end_free(p_front_end);
+    return false;
+  }
+
+  p_front_end->n_files = n_files;
+  p_front_end->n_workers = n_workers;
+  for (int w = 0; w < n_workers; ++w)
+    arena_init(&p_front_end->arenas[w]);
+  if (use_cache)
+    open_caches(p_front_end);
+
+  for (size_t i = 0; i < n_files; ++i)
+  {
+    struct stat st;
+    FrontEndFile * const p_file = &p_front_end->files[i];
+
+    p_file->path = paths[i];
+    token_stream_init(&p_file->tokens);
+    run.order[i] = i;
+    run.sizes[i] = (0 == stat(paths[i], &st)) ? st.st_size : 0;
+  }
+  qsort_r(run.order, n_files, sizeof(size_t), compare_sizes, run.sizes);
+
+  pool_run(process_file, &run, n_files, n_workers);
+  close_caches(p_front_end);
+
+  free(run.order);
+  free(run.sizes);
+  p_front_end->seconds = now() - t0;
+  return true;
+}
+
+void front_end_free (FrontEnd * const p_front_end)
+{
+  for (size_t i = 0; NULL != p_front_end->files && i < p_front_end->n_files; ++i)
+  {
+    token_stream_free(&p_front_end->files[i].tokens);
+    if (p_front_end->files[i].cached)
+      disk_cache_release(&p_front_end->files[i].cache_entry);
+    source_close(&p_front_end->files[i].source);
+  }
+  for (int w = 0; NULL != p_front_end->arenas && w < p_front_end->n_workers; ++w)
+    arena_free(&p_front_end->arenas[w]);
+
+  free(p_front_end->files);
+  free(p_front_end->arenas);
+  interner_free(p_front_end->p_interner);
+  memset(p_front_end, 0, sizeof(FrontEnd));
+}
@@ -0,0 +1,74 @@
+/*
+ *  Parallel front end for many L files.
+ *
+ *  Each file is mapped, lexed and parsed as one task of a work-stealing
+ *  pool, the largest files first.  A worker allocates the ASTs of its files
+ *  in its own arena, and the identifiers of every file are interned in one
+ *  shared interner.  The sources, tokens and ASTs are kept for later passes
+ *  until front_end_free.
+ *
+ *  With the cache, the tokens and AST of a file already parsed in a previous
+ *  run are mapped from the entry of its bytes (see L_ast_cache.h), and the
+ *  ones of the files parsed are stored.  Each worker has its own handle on
+ *  the cache directory.
+ */
+
+#pragma once
+
+#include "L_arena.h"
+#include "L_ast.h"
+#include "L_ast_cache.h"
+#include "L_interner.h"
+#include "L_parser.h"
+#include "L_source.h"
+#include "L_token_stream.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum
+{
+  FILE_PARSED,
+  FILE_UNREADABLE,
+  FILE_SYNTAX_ERROR,
+  FILE_OUT_OF_MEMORY
+} FileStatus;
+
+typedef struct
+{
+  const char     * path;
+  FileStatus       status;
+  Source           source;
+  TokenStream      tokens;
+  Ast              ast;
+  ParseError       error;
+  bool             cached;
+  DiskCacheEntry   cache_entry;   // Holds the AST of a cached file.
+  int              worker;
+  double           lex_seconds;   // Mapping included, or the cache lookup.
+  double           parse_seconds; // Interning included.
+} FrontEndFile;
+
+typedef struct
+{
+  FrontEndFile   * files;
+  size_t           n_files;
+  Arena          * arenas;  // One per worker.
+  int              n_workers;
+  Interner       * p_interner;
+  DiskCache      * caches;  // One per worker during the run.
+  bool             use_cache;
+  DiskCacheStats   cache_stats;
+  double           seconds; // Wall time of the whole run.
+} FrontEnd;
+
+// False when out of memory before any file could be processed: the status
+// of each file tells how it went otherwise.  When the cache directory cannot
+// be opened, the files are processed without it and use_cache is false.
+bool front_end_run (FrontEnd * const p_front_end,
+                    char **paths,
+                    size_t n_files,
+                    int n_workers,
+                    bool use_cache);
+
+void front_end_free (FrontEnd * const p_front_end);
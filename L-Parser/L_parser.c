@@ -0,0 +1,534 @@
+/*
+ *  Parser for the language L.
+ */
+
+#include "L_parser.h"
+
+typedef struct
+{
+  const TokenStream * p_ts;
+  AstBuilder        * p_builder;
+  size_t              pos;   // Current token, TOKEN_EOF is never passed.
+  int                 depth;
+  ParseError        * p_error;
+  bool                failed;
+} Parser;
+
+// Binding powers of the infix and postfix operators, 0 for other tokens.
+enum
+{
+  BP_NONE,
+  BP_ASSIGN,
+  BP_OR,
+  BP_AND,
+  BP_EQUALITY,
+  BP_COMPARISON,
+  BP_SUM,
+  BP_PRODUCT,
+  BP_PREFIX,
+  BP_POSTFIX
+};
+
+static int infix_power (int kind)
+{
+  switch (kind)
+  {
+    case TOKEN_ASSIGN:
+      return BP_ASSIGN;
+    case TOKEN_OR:
+      return BP_OR;
+    case TOKEN_AND:
+      return BP_AND;
+    case TOKEN_EQ: case TOKEN_NE:
+      return BP_EQUALITY;
+    case TOKEN_LT: case TOKEN_LE: case TOKEN_GT: case TOKEN_GE:
+      return BP_COMPARISON;
+    case TOKEN_PLUS: case TOKEN_MINUS:
+      return BP_SUM;
+    case TOKEN_STAR: case TOKEN_SLASH: case TOKEN_PERCENT:
+      return BP_PRODUCT;
+    case TOKEN_LPAREN: case TOKEN_LBRACKET:
+      return BP_POSTFIX;
+    default:
+      return BP_NONE;
+  }
+}
+
+/**** Tokens. ****/
+
+static int peek (const Parser * const p_parser)
+{
+  return p_parser->p_ts->kinds[p_parser->pos];
+}
+
+static size_t advance (Parser * const p_parser)
+{
+  const size_t token = p_parser->pos;
+  if (TOKEN_EOF != p_parser->p_ts->kinds[token])
+    ++p_parser->pos;
+  return token;
+}
+
+static bool accept (Parser * const p_parser, int kind)
+{
+  if (peek(p_parser) != kind)
+    return false;
+  advance(p_parser);
+  return true;
+}
+
+// Only the first error is kept.
+static bool fail (Parser * const p_parser, const char *expected)
+{
+  if (!p_parser->failed)
+  {
+    p_parser->failed = true;
+    p_parser->p_error->token = p_parser->pos;
+    p_parser->p_error->expected = expected;
+  }
+  return false;
+}
+
+static bool expect (Parser * const p_parser, int kind, const char *expected)
+{
+  return accept(p_parser, kind) || fail(p_parser, expected);
+}
+
+/**** Nodes. ****/
+
+// Nodes are appended in post-order: a node comes right after its children,
+// from the node at index first on.
+static bool node (Parser * const p_parser, AstKind kind, size_t token,
+                  size_t first)
+{
+  return ast_builder_push(p_parser->p_builder, kind, token, first)
+         || fail(p_parser, NULL);
+}
+
+static size_t mark (const Parser * const p_parser)
+{
+  return p_parser->p_builder->n;
+}
+
+static bool enter (Parser * const p_parser)
+{
+  return ++p_parser->depth <= PARSE_MAX_DEPTH
+         || fail(p_parser, "fewer nested blocks and parentheses");
+}
+
+/**** Expressions. ****/
+
+static bool expression (Parser * const p_parser, int min_power);
+
+// [expression (',' expression)*] ')', after '('.
+static bool arguments (Parser * const p_parser)
+{
+  if (accept(p_parser, TOKEN_RPAREN))
+    return true;
+
+  do
+  {
+    if (!expression(p_parser, BP_ASSIGN))
+      return false;
+  } while (accept(p_parser, TOKEN_COMMA));
+
+  return expect(p_parser, TOKEN_RPAREN, "',' or ')'");
+}
+
+static bool prefix (Parser * const p_parser)
+{
+  const size_t first = mark(p_parser);
+  const size_t token = p_parser->pos;
+
+  switch (peek(p_parser))
+  {
+    case TOKEN_IDENT:
+      return node(p_parser, AST_IDENT, advance(p_parser), first);
+    case TOKEN_INT:
+      return node(p_parser, AST_INT, advance(p_parser), first);
+    case TOKEN_STRING:
+      return node(p_parser, AST_STRING, advance(p_parser), first);
+    case TOKEN_TRUE: case TOKEN_FALSE:
+      return node(p_parser, AST_BOOL, advance(p_parser), first);
+    case TOKEN_LPAREN:
+      advance(p_parser);
+      return expression(p_parser, BP_ASSIGN)
+             && expect(p_parser, TOKEN_RPAREN, "')'");
+    case TOKEN_MINUS: case TOKEN_NOT:
+      advance(p_parser);
+      return expression(p_parser, BP_PREFIX)
+             && node(p_parser, AST_UNARY, token, first);
+    default:
+      return fail(p_parser, "an expression");
+  }
+}
+
+// Operators binding at least as tight as min_power.  The left operand is
+// already in place when an operator is met: its node just follows the right
+// operand.
+static bool expression (Parser * const p_parser, int min_power)
+{
+  const size_t first = mark(p_parser);
+
+  if (!enter(p_parser) || !prefix(p_parser))
+    return false;
+
+  while (infix_power(peek(p_parser)) >= min_power)
+  {
+    const int kind = peek(p_parser);
+    const int power = infix_power(kind);
+    const size_t token = advance(p_parser);
+    bool ok = false;
+
+    // '=' is right associative, the other ones left associative.
+    if (TOKEN_LPAREN == kind)
+      ok = arguments(p_parser) && node(p_parser, AST_CALL, token, first);
+    else if (TOKEN_LBRACKET == kind)
+      ok = expression(p_parser, BP_ASSIGN)
+           && expect(p_parser, TOKEN_RBRACKET, "']'")
+           && node(p_parser, AST_INDEX, token, first);
+    else if (TOKEN_ASSIGN == kind)
+      ok = expression(p_parser, power)
+           && node(p_parser, AST_ASSIGN, token, first);
+    else
+      ok = expression(p_parser, power + 1)
+           && node(p_parser, AST_BINARY, token, first);
+
+    if (!ok)
+      return false;
+  }
+
+  --p_parser->depth;
+  return true;
+}
+
+/**** Statements. ****/
+
+static bool block (Parser * const p_parser);
+
+static bool type (Parser * const p_parser)
+{
+  const size_t first = mark(p_parser);
+  const size_t token = p_parser->pos;
+  return expect(p_parser, TOKEN_IDENT, "a type")
+         && node(p_parser, AST_TYPE, token, first);
+}
+
+// IDENT [':' type] '=' expression ';', after 'let'.
+static bool let (Parser * const p_parser, size_t first)
+{
+  const size_t name = p_parser->pos;
+  return expect(p_parser, TOKEN_IDENT, "a variable name")
+         && (!accept(p_parser, TOKEN_COLON) || type(p_parser))
+         && expect(p_parser, TOKEN_ASSIGN, "'='")
+         && expression(p_parser, BP_ASSIGN)
+         && expect(p_parser, TOKEN_SEMICOLON, "';'")
+         && node(p_parser, AST_LET, name, first);
+}
+
+// expression block ['else' (block | if)], after 'if'.
+static bool if_statement (Parser * const p_parser, size_t token, size_t first)
+{
+  if (!expression(p_parser, BP_ASSIGN) || !block(p_parser))
+    return false;
+
+  if (accept(p_parser, TOKEN_ELSE))
+  {
+    const size_t else_first = mark(p_parser);
+    if (TOKEN_LBRACE == peek(p_parser))
+    {
+      if (!block(p_parser))
+        return false;
+    }
+    else if (TOKEN_IF != peek(p_parser))
+    {
+      return fail(p_parser, "'{' or 'if'");
+    }
+    else if (!if_statement(p_parser, advance(p_parser), else_first))
+    {
+      return false;
+    }
+  }
+
+  return node(p_parser, AST_IF, token, first);
+}
+
+static bool statement (Parser * const p_parser)
+{
+  const size_t first = mark(p_parser);
+  const size_t token = p_parser->pos;
+
+  switch (peek(p_parser))
+  {
+    case TOKEN_LBRACE:
+      return block(p_parser);
+    case TOKEN_LET:
+      advance(p_parser);
+      return let(p_parser, first);
+    case TOKEN_IF:
+      advance(p_parser);
+      return if_statement(p_parser, token, first);
+    case TOKEN_WHILE:
+      advance(p_parser);
+      return expression(p_parser, BP_ASSIGN) && block(p_parser)
+             && node(p_parser, AST_WHILE, token, first);
+    case TOKEN_RETURN:
+      advance(p_parser);
+      return (TOKEN_SEMICOLON == peek(p_parser)
+              || expression(p_parser, BP_ASSIGN))
+             && expect(p_parser, TOKEN_SEMICOLON, "';'")
+             && node(p_parser, AST_RETURN, token, first);
+    default:
+      return expression(p_parser, BP_ASSIGN)
+             && expect(p_parser, TOKEN_SEMICOLON, "';'")
+             && node(p_parser, AST_EXPR_STMT, token, first);
+  }
+}
+
+// '{' statement* '}'.
+static bool block (Parser * const p_parser)
+{
+  const size_t first = mark(p_parser);
+  const size_t token = p_parser->pos;
+
+  if (!expect(p_parser, TOKEN_LBRACE, "'{'") || !enter(p_parser))
+    return false;
+
+  while (!accept(p_parser, TOKEN_RBRACE))
+  {
+    if (TOKEN_EOF == peek(p_parser))
+      return fail(p_parser, "'}'");
+    if (!statement(p_parser))
+      return false;
+  }
+
+  --p_parser->depth;
+  return node(p_parser, AST_BLOCK, token, first);
+}
+
+// IDENT [':' type].
+static bool param (Parser * const p_parser)
+{
+  const size_t first = mark(p_parser);
+  const size_t name = p_parser->pos;
+
+  return expect(p_parser, TOKEN_IDENT, "a parameter name")
+         && (!accept(p_parser, TOKEN_COLON) || type(p_parser))
+         && node(p_parser, AST_PARAM, name, first);
+}
+
+// 'fn' IDENT '(' [param (',' param)*] ')' ['->' type] block.
+static bool fn (Parser * const p_parser)
+{
+  const size_t first = mark(p_parser);
+
+  if (!expect(p_parser, TOKEN_FN, "'fn'"))
+    return false;
+
+  const size_t name = p_parser->pos;
+  if (!expect(p_parser, TOKEN_IDENT, "a function name")
+      || !expect(p_parser, TOKEN_LPAREN, "'('"))
+    return false;
+
+  if (!accept(p_parser, TOKEN_RPAREN))
+  {
+    do
+    {
+      if (!param(p_parser))
+        return false;
+    } while (accept(p_parser, TOKEN_COMMA));
+
+    if (!expect(p_parser, TOKEN_RPAREN, "',' or ')'"))
+      return false;
+  }
+
+  return (!accept(p_parser, TOKEN_ARROW) || type(p_parser))
+         && block(p_parser)
+         && node(p_parser, AST_FN, name, first);
+}
+
+bool parse_program (const TokenStream * const p_ts,
+                    Arena * const p_arena,
+                    Ast * const p_ast,
+                    ParseError * const p_error)
+{
+  AstBuilder builder;
+  Parser parser = { p_ts, &builder, 0, 0, p_error, false };
+  bool ok = true;
+
+  p_error->token = 0;
+  p_error->expected = NULL;
+  ast_builder_init(&builder);
+
+  while (ok && TOKEN_EOF != peek(&parser))
+    ok = fn(&parser);
+
+  ok = ok && node(&parser, AST_PROGRAM, 0, 0)
+       && (ast_build(&builder, p_arena, p_ast) || fail(&parser, NULL));
+
+  ast_builder_free(&builder);
+  return ok;
+}
+
+/**** Incremental reparse. ****/
+
+// The statements, or functions, parsed again: the children [from, to) of
+// node parent, whose tokens are [start, stop) before the edit.
+typedef struct
+{
+  uint32_t parent;
+  uint32_t from;
+  uint32_t to;
+  size_t   start;
+  size_t   stop;
+  int      depth;  // Blocks around the children.
+} Damaged;
+
+// First token of a statement or function: 'let' and 'fn' come before the
+// name their node points to.
+static size_t first_token (const Ast * const p_ast, uint32_t i)
+{
+  const int kind = p_ast->kinds[i];
+  return p_ast->tokens[i] - (AST_LET == kind || AST_FN == kind);
+}
+
+// Find the children of parent around the damage.  False when the damage
+// reaches the '}' of the block parent, whose index is unknown.  *p_child is
+// the child the damage starts in, UINT32_MAX if it starts before them.
+static bool damaged_children (const Ast * const p_ast,
+                              const TokenDamage * const p_damage,
+                              size_t old_eof,
+                              Damaged * const p_range,
+                              uint32_t * const p_child)
+{
+  const uint32_t parent = p_range->parent;
+  const size_t damage_end = p_damage->first + p_damage->n_removed;
+  uint32_t previous = UINT32_MAX;
+  uint32_t first = UINT32_MAX;
+
+  p_range->from = parent + 1;
+  p_range->start = (0 == parent) ? 0 : p_ast->tokens[parent] + 1;
+  p_range->to = parent + p_ast->sizes[parent];
+  p_range->stop = (0 == parent) ? old_eof : SIZE_MAX;
+
+  AST_FOR_CHILDREN(p_ast, parent, child)
+  {
+    const size_t start = first_token(p_ast, child);
+    if (start >= damage_end)
+    {
+      p_range->to = child;
+      p_range->stop = start;
+      break;
+    }
+    if (start <= p_damage->first)
+    {
+      previous = first;
+      first = child;
+    }
+  }
+
+  if (0 != parent && SIZE_MAX == p_range->stop)
+    return false;
+
+  // An 'if' looks at the token after it for an 'else'.
+  *p_child = first;
+  if (UINT32_MAX != previous && AST_IF == p_ast->kinds[previous])
+    first = previous;
+  if (UINT32_MAX != first)
+  {
+    p_range->from = first;
+    p_range->start = first_token(p_ast, first);
+  }
+
+  return true;
+}
+
+// The innermost block, or the program, whose children bound the damage.
+static void find_damaged (const Ast * const p_ast,
+                          const TokenDamage * const p_damage,
+                          size_t old_eof,
+                          Damaged * const p_range)
+{
+  Damaged range = { 0, 0, 0, 0, 0, 0 };
+  uint32_t child = UINT32_MAX;
+
+  while (damaged_children(p_ast, p_damage, old_eof, &range, &child))
+  {
+    *p_range = range;
+
+    // Go down when the damage is within one child, after the '{' of one of
+    // its blocks.
+    if (UINT32_MAX == child || child + p_ast->sizes[child] != range.to)
+      return;
+
+    uint32_t block = UINT32_MAX;
+    for (uint32_t i = child; i < child + p_ast->sizes[child]; )
+    {
+      if (AST_BLOCK != p_ast->kinds[i])
+      {
+        ++i;
+        continue;
+      }
+      if (p_ast->tokens[i] < p_damage->first)
+        block = i;
+      i += p_ast->sizes[i];
+    }
+    if (UINT32_MAX == block)
+      return;
+
+    range.parent = block;
+    ++range.depth;
+  }
+}
+
+// Parse [range.start, range.stop + delta) of the new tokens as the children
+// of range.parent.
+static bool reparse_children (const TokenStream * const p_ts,
+                              const Damaged * const p_range,
+                              int64_t delta,
+                              AstBuilder * const p_builder)
+{
+  ParseError error;
+  Parser parser = { p_ts, p_builder, p_range->start, p_range->depth, &error,
+                    false };
+  const size_t stop = (size_t)((int64_t)p_range->stop + delta);
+  bool ok = true;
+
+  while (ok && parser.pos < stop)
+    ok = (0 == p_range->parent) ? fn(&parser) : statement(&parser);
+
+  return ok && stop == parser.pos;
+}
+
+bool reparse_program (const TokenStream * const p_ts,
+                      const Ast * const p_old,
+                      const TokenDamage * const p_damage,
+                      Arena * const p_arena,
+                      Ast * const p_ast,
+                      ParseError * const p_error,
+                      bool * const p_incremental)
+{
+  const int64_t delta = (int64_t)p_damage->n_inserted
+                        - (int64_t)p_damage->n_removed;
+  const size_t old_eof = (size_t)((int64_t)p_ts->n - 1 - delta);
+  AstBuilder builder;
+  Damaged range;
+
+  p_error->token = 0;
+  p_error->expected = NULL;
+  find_damaged(p_old, p_damage, old_eof, &range);
+  ast_builder_init(&builder);
+  *p_incremental = reparse_children(p_ts, &range, delta, &builder);
+
+  // A syntax error is reported by the full parse, so that it is the same.
+  bool ok = *p_incremental;
+  if (ok && !ast_splice(p_old, range.parent, range.from, range.to, &builder,
+                        delta, p_arena, p_ast))
+  {
+    ok = false;
+    *p_incremental = false;
+  }
+
+  ast_builder_free(&builder);
+  return ok || parse_program(p_ts, p_arena, p_ast, p_error);
+}
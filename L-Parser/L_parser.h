@@ -0,0 +1,77 @@
+/*
+ *  Parser for the language L.
+ *
+ *  Grammar ('[]' is optional, '*' repeated, quoted tokens are literal):
+ *  program    ::= fn*
+ *  fn         ::= 'fn' IDENT '(' [param (',' param)*] ')' ['->' type] block
+ *  param      ::= IDENT [':' type]
+ *  type       ::= IDENT
+ *  block      ::= '{' statement* '}'
+ *  statement  ::= 'let' IDENT [':' type] '=' expression ';'
+ *               | 'if' expression block ['else' (block | if)]
+ *               | 'while' expression block
+ *               | 'return' [expression] ';'
+ *               | block
+ *               | expression ';'
+ *
+ *  Expressions, from the loosest to the tightest binding:
+ *  '=' (right associative), '||', '&&', '==' '!=', '<' '<=' '>' '>=',
+ *  '+' '-', '*' '/' '%', prefix '-' '!', then calls f(a, b) and indexing
+ *  a[i], on identifiers, integers, strings, 'true', 'false' and ( e ).
+ *
+ *  Statements are parsed by predictive recursive descent, one token of
+ *  lookahead choosing the rule, and expressions by Pratt parsing: an
+ *  operator node is added once both operands are parsed.  Nodes are added
+ *  in post-order, so that every node added is part of the tree, then laid
+ *  out in pre-order (see L_ast.h): the parse is linear in the number of
+ *  tokens.  The first syntax error stops the parse.
+ *
+ *  After an edit, reparse_program parses again only the statements around
+ *  the damaged tokens (see token_stream_edit), in the innermost block, or
+ *  the program, where they are bounded by statements, or functions, the edit
+ *  left alone.  A statement starts at the token of its node, or the one
+ *  before for 'let' and 'fn', so the bounds are known from the old tree:
+ *  the statements parsed again must end exactly at the first one left
+ *  alone, shifted.  The end of a block is not in the tree, and damage that
+ *  reaches its last statement is handled by the block around it.  An 'if'
+ *  before the damage is parsed again too, as it looks at the next token for
+ *  an 'else'.
+ */
+
+#pragma once
+
+#include "L_arena.h"
+#include "L_ast.h"
+#include "L_incremental.h"
+#include "L_token_stream.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PARSE_MAX_DEPTH 1000 // Nesting of blocks and expressions.
+
+typedef struct
+{
+  size_t       token;    // Index of the offending token.
+  const char * expected; // What was expected instead.
+} ParseError;
+
+// Returns false on a syntax error, with *p_error set, or when out of memory,
+// with p_error->expected NULL.  The nodes of p_ast live in p_arena.
+bool parse_program (const TokenStream * const p_ts,
+                    Arena * const p_arena,
+                    Ast * const p_ast,
+                    ParseError * const p_error);
+
+// p_ts is the stream edited by token_stream_edit, p_old the tree of the
+// stream before, *p_damage what the edit changed.  The tree is copied in
+// p_arena with the new statements in place of the damaged ones, or parsed
+// again from scratch, *p_incremental false, when they do not end where the
+// next one left alone starts.  Returns as parse_program.
+bool reparse_program (const TokenStream * const p_ts,
+                      const Ast * const p_old,
+                      const TokenDamage * const p_damage,
+                      Arena * const p_arena,
+                      Ast * const p_ast,
+                      ParseError * const p_error,
+                      bool * const p_incremental);
@@ -0,0 +1,250 @@
+/*
+ *  Command-line front end of the L parser.
+ *
+ *  Usage:
+ *  L_parser <file>           Print the syntax tree of the file.
+ *  L_parser <file>...        Report the sizes and timings of each file.
+ *  L_parser -q <file>...     Only report the totals.
+ *  L_parser -j N ...         Process the files with N threads.
+ *  L_parser -c ...           Reuse the trees of unchanged files from the cache
+ *                            directory, $L_CACHE_DIR by default.
+ *  L_parser -e <offset> <delete_len> <text> <file>
+ *                            Replace delete_len bytes of the file at offset
+ *                            by text, reparse, and print the new tree.
+ */
+
+#include "L_driver.h"
+#include "L_incremental.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void print_error (const char * const path,
+                         const TokenStream * const p_ts,
+                         const char * const data,
+                         const ParseError * const p_error)
+{
+  const size_t offset = p_ts->starts[p_error->token];
+  size_t line = 1;
+  size_t column = 1;
+
+  for (size_t i = 0; i < offset; ++i)
+  {
+    column = ('\n' == data[i]) ? 1 : column + 1;
+    line += ('\n' == data[i]);
+  }
+
+  if (TOKEN_EOF == p_ts->kinds[p_error->token])
+    printf("%s:%zu:%zu: expected %s at the end of the file\n", path, line,
+           column, p_error->expected);
+  else
+    printf("%s:%zu:%zu: expected %s, found '%.*s'\n", path, line, column,
+           p_error->expected, (int)p_ts->lens[p_error->token], data + offset);
+}
+
+static void print_file (const FrontEndFile * const p_file)
+{
+  switch (p_file->status)
+  {
+    case FILE_PARSED:
+      if (p_file->cached)
+        printf("%s: %zu bytes, %zu tokens, %zu nodes, worker %d, "
+               "cached %.3f ms\n", p_file->path, p_file->source.len,
+               p_file->tokens.n - 1, p_file->ast.n, p_file->worker,
+               1e3 * (p_file->lex_seconds + p_file->parse_seconds));
+      else
+        printf("%s: %zu bytes, %zu tokens, %zu nodes, worker %d, "
+               "lex %.3f ms, parse %.3f ms\n", p_file->path,
+               p_file->source.len, p_file->tokens.n - 1, p_file->ast.n,
+               p_file->worker, 1e3 * p_file->lex_seconds,
+               1e3 * p_file->parse_seconds);
+      break;
+    case FILE_UNREADABLE:
+      printf("Cannot read '%s'\n", p_file->path);
+      break;
+    case FILE_SYNTAX_ERROR:
+      print_error(p_file->path, &p_file->tokens, p_file->source.data,
+                  &p_file->error);
+      break;
+    default:
+      printf("%s: out of memory\n", p_file->path);
+      break;
+  }
+}
+
+// Parse the file, apply the edit and reparse what it damaged.
+static int edit_file (const char * const path, const TextEdit * const p_edit)
+{
+  Source source;
+  if (!source_open(path, &source))
+  {
+    printf("Cannot read '%s'\n", path);
+    return 1;
+  }
+  if (p_edit->offset > source.len
+      || p_edit->delete_len > source.len - p_edit->offset)
+  {
+    printf("The edit is out of '%s'\n", path);
+    source_close(&source);
+    return 1;
+  }
+
+  // The edit needs a malloc'ed copy, with the sentinel.
+  size_t len = source.len;
+  char *p_src = malloc(len + 1);
+  if (NULL != p_src)
+    memcpy(p_src, source.data, len + 1);
+  source_close(&source);
+
+  TokenStream ts;
+  Arena old_arena;
+  Arena arena;
+  Ast old;
+  Ast ast;
+  ParseError error;
+  TokenDamage damage;
+  bool incremental = false;
+  int status = 1;
+
+  token_stream_init(&ts);
+  arena_init(&old_arena);
+  arena_init(&arena);
+  if (NULL == p_src || !token_stream_lex(&ts, p_src, len))
+  {
+    printf("Out of memory\n");
+  }
+  else if (!parse_program(&ts, &old_arena, &old, &error))
+  {
+    if (NULL == error.expected)
+      printf("Out of memory\n");
+    else
+      print_error(path, &ts, p_src, &error);
+    status = 2;
+  }
+  else if (!token_stream_edit(&ts, &p_src, &len, p_edit, &damage))
+  {
+    printf("Out of memory\n");
+  }
+  else if (!reparse_program(&ts, &old, &damage, &arena, &ast, &error,
+                            &incremental))
+  {
+    if (NULL == error.expected)
+      printf("Out of memory\n");
+    else
+      print_error(path, &ts, p_src, &error);
+    status = 2;
+  }
+  else
+  {
+    printf("%s reparse, tokens %zu to %zu\n",
+           incremental ? "incremental" : "full", damage.first,
+           damage.first + damage.n_inserted);
+    status = ast_print(&ast, &ts, p_src, stdout) ? 0 : 1;
+    if (0 != status)
+      printf("Out of memory\n");
+  }
+
+  arena_free(&arena);
+  arena_free(&old_arena);
+  token_stream_free(&ts);
+  free(p_src);
+  return status;
+}
+
+int main (int argc, char **argv)
+{
+  // Input checks.
+  bool quiet = false;
+  bool use_cache = false;
+  int n_threads = 1;
+  int arg = 1;
+  if (6 == argc && 0 == strcmp(argv[1], "-e"))
+  {
+    const TextEdit edit = { strtoull(argv[2], NULL, 10),
+                            strtoull(argv[3], NULL, 10), argv[4],
+                            strlen(argv[4]) };
+    return edit_file(argv[5], &edit);
+  }
+  for (; arg < argc; ++arg)
+  {
+    if (0 == strcmp(argv[arg], "-q"))
+      quiet = true;
+    else if (0 == strcmp(argv[arg], "-c"))
+      use_cache = true;
+    else if (0 == strcmp(argv[arg], "-j") && arg + 1 < argc)
+      n_threads = atoi(argv[++arg]);
+    else
+      break;
+  }
+  if (arg == argc || n_threads < 1)
+  {
+    printf("Wrong command-line arguments\n");
+    printf("Usage: L_parser [-q] [-c] [-j threads] <file>...\n");
+    printf("       L_parser -e <offset> <delete_len> <text> <file>\n");
+    return 1;
+  }
+
+  FrontEnd front_end;
+  const size_t n_files = (size_t)(argc - arg);
+  if (!front_end_run(&front_end, &argv[arg], n_files, n_threads,
+                     use_cache))
+  {
+    printf("Out of memory\n");
+    return 1;
+  }
+
+  size_t n_bytes = 0;
+  size_t n_tokens = 0;
+  size_t n_nodes = 0;
+  size_t n_failed = 0;
+  double cpu_seconds = 0;
+  for (size_t i = 0; i < n_files; ++i)
+  {
+    const FrontEndFile * const p_file = &front_end.files[i];
+
+    if (1 == n_files && !quiet && FILE_PARSED == p_file->status)
+    {
+      if (!ast_print(&p_file->ast, &p_file->tokens, p_file->source.data, stdout))
+        printf("Out of memory\n");
+    }
+    else if (!quiet || FILE_PARSED != p_file->status)
+    {
+      print_file(p_file);
+    }
+
+    n_bytes += p_file->source.len;
+    n_tokens += (0 != p_file->tokens.n) ? p_file->tokens.n - 1 : 0;
+    n_nodes += (FILE_PARSED == p_file->status) ? p_file->ast.n : 0;
+    n_failed += (FILE_PARSED != p_file->status);
+    cpu_seconds += p_file->lex_seconds + p_file->parse_seconds;
+  }
+
+  if (use_cache && !front_end.use_cache)
+    printf("Cannot open the cache directory\n");
+
+  if (quiet || 1 < n_files)
+  {
+    size_t arena_bytes = 0;
+    for (int w = 0; w < front_end.n_workers; ++w)
+      arena_bytes += front_end.arenas[w].n_bytes;
+
+    printf("%zu files, %zu bytes, %zu tokens, %zu nodes, %zu arena bytes, "
+           "%u identifiers, %zu failed\n", n_files, n_bytes, n_tokens, n_nodes,
+           arena_bytes, interner_count(front_end.p_interner), n_failed);
+    printf("%d threads, wall %.1f ms, files %.1f ms, %.1f MB/s\n", n_threads,
+           1e3 * front_end.seconds, 1e3 * cpu_seconds,
+           (front_end.seconds > 0) ? (double)n_bytes / front_end.seconds / 1e6
+                                   : 0.0);
+    if (front_end.use_cache)
+      printf("cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " stores, "
+             "%" PRIu64 " evictions\n", front_end.cache_stats.hits,
+             front_end.cache_stats.misses, front_end.cache_stats.stores,
+             front_end.cache_stats.evictions);
+  }
+
+  front_end_free(&front_end);
+  return (0 == n_failed) ? 0 : 2;
+}
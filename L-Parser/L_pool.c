@@ -0,0 +1,137 @@
+/*
+ *  Work-stealing pool for independent tasks.
+ */
+
+#include "L_pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+// Tasks first, first + stride, ... up to last, excluded.
+typedef struct
+{
+  pthread_mutex_t lock;
+  size_t          first;
+  size_t          last;
+  size_t          stride;
+} Deque;
+
+typedef struct
+{
+  PoolTask   run;
+  void     * p_context;
+  Deque    * deques;
+  int        n_workers;
+} Pool;
+
+typedef struct
+{
+  Pool * p_pool;
+  int    worker;
+} Worker;
+
+static bool pop_front (Deque * const p_deque, size_t *p_task)
+{
+  pthread_mutex_lock(&p_deque->lock);
+  const bool found = p_deque->first < p_deque->last;
+  if (found)
+  {
+    *p_task = p_deque->first;
+    p_deque->first += p_deque->stride;
+  }
+  pthread_mutex_unlock(&p_deque->lock);
+  return found;
+}
+
+static bool pop_back (Deque * const p_deque, size_t *p_task)
+{
+  pthread_mutex_lock(&p_deque->lock);
+  const bool found = p_deque->first < p_deque->last;
+  if (found)
+  {
+    p_deque->last -= p_deque->stride;
+    *p_task = p_deque->last;
+  }
+  pthread_mutex_unlock(&p_deque->lock);
+  return found;
+}
+
+static void * work (void *p_arg)
+{
+  const Worker * const p_worker = p_arg;
+  Pool * const p_pool = p_worker->p_pool;
+  const int n = p_pool->n_workers;
+  size_t task;
+
+  for (;;)
+  {
+    bool found = pop_front(&p_pool->deques[p_worker->worker], &task);
+    for (int i = 1; !found && i < n; ++i)
+      found = pop_back(&p_pool->deques[(p_worker->worker + i) % n], &task);
+
+    // No task is ever added: once every deque is empty, the work is done.
+    if (!found)
+      return NULL;
+    p_pool->run(p_pool->p_context, task, p_worker->worker);
+  }
+}
+
+bool pool_run (PoolTask run, void *p_context, size_t n_tasks, int n_workers)
+{
+  if (0 == n_tasks)
+    return true;
+
+  const int n = (n_workers < 1) ? 1
+                : ((size_t)n_workers > n_tasks) ? (int)n_tasks : n_workers;
+  Pool pool = { run, p_context, calloc((size_t)n, sizeof(Deque)), n };
+  pthread_t *p_threads = calloc((size_t)n, sizeof(pthread_t));
+  Worker *p_workers = calloc((size_t)n, sizeof(Worker));
+  bool *p_started = calloc((size_t)n, sizeof(bool));
+  bool ok = NULL != pool.deques && NULL != p_threads && NULL != p_workers
+            && NULL != p_started;
+
+  if (!ok)
+  {
+    for (size_t task = 0; task < n_tasks; ++task)
+      run(p_context, task, 0);
+  }
+  else
+  {
+    // Deque w holds the tasks w, w + n, w + 2n ...
+    for (int w = 0; w < n; ++w)
+    {
+      Deque * const p_deque = &pool.deques[w];
+      const size_t n_owned = (n_tasks - (size_t)w + (size_t)n - 1) / (size_t)n;
+
+      pthread_mutex_init(&p_deque->lock, NULL);
+      p_deque->first = (size_t)w;
+      p_deque->last = (size_t)w + n_owned * (size_t)n;
+      p_deque->stride = (size_t)n;
+      p_workers[w].p_pool = &pool;
+      p_workers[w].worker = w;
+    }
+
+    for (int w = 1; w < n; ++w)
+      p_started[w] = 0 == pthread_create(&p_threads[w], NULL, work,
+                                         &p_workers[w]);
+
+    // The tasks of a worker that did not start are stolen by the others.
+    work(&p_workers[0]);
+    for (int w = 1; w < n; ++w)
+    {
+      if (p_started[w])
+        pthread_join(p_threads[w], NULL);
+      else
+        ok = false;
+    }
+
+    for (int w = 0; w < n; ++w)
+      pthread_mutex_destroy(&pool.deques[w].lock);
+  }
+
+  free(pool.deques);
+  free(p_threads);
+  free(p_workers);
+  free(p_started);
+  return ok;
+}
@@ -0,0 +1,20 @@
+/*
+ *  Work-stealing pool for independent tasks.
+ *
+ *  Tasks 0 .. n_tasks - 1 are dealt round-robin to the deques of the
+ *  workers.  A worker takes its own tasks in order, and when it has none
+ *  left, steals the last task of the first busy worker after it, so that
+ *  a worker stuck on a large file does not hold the others back.  The
+ *  calling thread is worker 0.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef void (*PoolTask) (void *p_context, size_t task, int worker);
+
+// Returns false when the workers cannot be created: the tasks run then on
+// the calling thread, which always runs them all.
+bool pool_run (PoolTask run, void *p_context, size_t n_tasks, int n_workers);
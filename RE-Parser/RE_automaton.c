@@ -0,0 +1,913 @@
+/*
+ *  Finite automata for the regular expressions accepted by the parser: NFA
+ *  construction from the parse tree, byte classes and lazy determinization.
+ */
+
+#include "RE_automaton.h"
+#include "RE_trace.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CAPACITY 16
+#define HASH_EMPTY (-1)
+
+/**** Byte sets and byte classes. ****/
+
+void byte_set_clear (ByteSet * const p_set)
+{
+  memset(p_set->bits, 0, sizeof(p_set->bits));
+}
+
+void byte_set_add (ByteSet * const p_set, unsigned char c)
+{
+  p_set->bits[c >> 5] |= (uint32_t)1 << (c & 31);
+}
+
+bool byte_set_has (const ByteSet * const p_set, unsigned char c)
+{
+  return 0 != (p_set->bits[c >> 5] & ((uint32_t)1 << (c & 31)));
+}
+
+// Refine the partition of the bytes with every set used by the NFAs: two
+// bytes end up in the same class iff no transition tells them apart.
+void byte_classes_compute (const Nfa * const * pp_nfas,
+                           int n_nfas,
+                           ByteClasses * const p_classes)
+{
+  int n_classes = 1;
+  memset(p_classes->class_of, 0, sizeof(p_classes->class_of));
+
+  for (int k = 0; k < n_nfas; ++k)
+  {
+    const Nfa * const p_nfa = pp_nfas[k];
+    for (int s = 0; s < p_nfa->n_sets; ++s)
+    {
+      int split_to[BYTE_VALUES];  // New class for the bytes inside the set.
+      for (int c = 0; c < n_classes; ++c)
+        split_to[c] = -1;
+
+      bool has_outside[BYTE_VALUES] = { false };
+      for (int b = 0; b < BYTE_VALUES; ++b)
+        if (!byte_set_has(&p_nfa->sets[s], (unsigned char)b))
+          has_outside[p_classes->class_of[b]] = true;
+
+      for (int b = 0; b < BYTE_VALUES; ++b)
+      {
+        const int c = p_classes->class_of[b];
+        if (byte_set_has(&p_nfa->sets[s], (unsigned char)b) && has_outside[c])
+        {
+          if (split_to[c] < 0)
+            split_to[c] = n_classes++;
+          p_classes->class_of[b] = (unsigned char)split_to[c];
+        }
+      }
+    }
+  }
+
+  p_classes->n_classes = n_classes;
+  for (int b = BYTE_VALUES - 1; b >= 0; --b)
+    p_classes->rep[p_classes->class_of[b]] = (unsigned char)b;
+}
+
+/**** Thompson NFA. ****/
+
+// A fragment has one entry state and one exit state, the exit is always an
+// NFA_EPSILON state whose moves are not set yet.
+typedef struct
+{
+  int start;
+  int end;
+} Fragment;
+
+static bool grow (void **pp_data, int *p_cap, int needed, size_t elem_size)
+{
+  if (needed <= *p_cap)
+    return true;
+
+  int cap = (*p_cap > 0) ? *p_cap : INITIAL_CAPACITY;
+  while (cap < needed)
+    cap *= 2;
+
+  void *p_new = realloc(*pp_data, (size_t)cap * elem_size);
+  if (NULL == p_new)
+    return false;
+
+  *pp_data = p_new;
+  *p_cap = cap;
+  return true;
+}
+
+static int nfa_new_state (Nfa * const p_nfa, NfaKind kind)
+{
+  if (!grow((void **)&p_nfa->states, &p_nfa->cap_states,
+            p_nfa->n_states + 1, sizeof(NfaState)))
+    return -1;
+
+  NfaState * const p_state = &p_nfa->states[p_nfa->n_states];
+  p_state->kind   = kind;
+  p_state->out[0] = -1;
+  p_state->out[1] = -1;
+  p_state->set    = -1;
+  p_state->tag    = -1;
+  p_state->accept = NFA_NO_ACCEPT;
+
+  return p_nfa->n_states++;
+}
+
+static int nfa_new_set (Nfa * const p_nfa, const ByteSet * const p_set)
+{
+  for (int i = 0; i < p_nfa->n_sets; ++i)
+    if (0 == memcmp(&p_nfa->sets[i], p_set, sizeof(ByteSet)))
+      return i;
+
+  if (!grow((void **)&p_nfa->sets, &p_nfa->cap_sets,
+            p_nfa->n_sets + 1, sizeof(ByteSet)))
+    return -1;
+
+  p_nfa->sets[p_nfa->n_sets] = *p_set;
+  return p_nfa->n_sets++;
+}
+
+void nfa_init (Nfa * const p_nfa)
+{
+  memset(p_nfa, 0, sizeof(Nfa));
+  p_nfa->start = -1;
+}
+
+void nfa_free (Nfa * const p_nfa)
+{
+  free(p_nfa->states);
+  free(p_nfa->sets);
+  nfa_init(p_nfa);
+}
+
+static bool frag_epsilon (Nfa * const p_nfa, Fragment * const p_frag)
+{
+  const int s = nfa_new_state(p_nfa, NFA_EPSILON);
+  p_frag->start = s;
+  p_frag->end = s;
+  return s >= 0;
+}
+
+static bool frag_set (Nfa * const p_nfa,
+                      const ByteSet * const p_set,
+                      Fragment * const p_frag)
+{
+  const int set = nfa_new_set(p_nfa, p_set);
+  const int s = nfa_new_state(p_nfa, NFA_SET);
+  const int e = nfa_new_state(p_nfa, NFA_EPSILON);
+  if (set < 0 || s < 0 || e < 0)
+    return false;
+
+  p_nfa->states[s].set = set;
+  p_nfa->states[s].out[0] = e;
+  p_frag->start = s;
+  p_frag->end = e;
+  return true;
+}
+
+static bool frag_tag (Nfa * const p_nfa, int tag, Fragment * const p_frag)
+{
+  const int s = nfa_new_state(p_nfa, NFA_TAG);
+  const int e = nfa_new_state(p_nfa, NFA_EPSILON);
+  if (s < 0 || e < 0)
+    return false;
+
+  p_nfa->states[s].tag = tag;
+  p_nfa->states[s].out[0] = e;
+  p_frag->start = s;
+  p_frag->end = e;
+  return true;
+}
+
+static void frag_concat (Nfa * const p_nfa,
+                         Fragment * const p_left,
+                         const Fragment * const p_right)
+{
+  p_nfa->states[p_left->end].out[0] = p_right->start;
+  p_left->end = p_right->end;
+}
+
+static bool frag_union (Nfa * const p_nfa,
+                        Fragment * const p_left,
+                        const Fragment * const p_right)
+{
+  const int s = nfa_new_state(p_nfa, NFA_EPSILON);
+  const int e = nfa_new_state(p_nfa, NFA_EPSILON);
+  if (s < 0 || e < 0)
+    return false;
+
+  p_nfa->states[s].out[0] = p_left->start;
+  p_nfa->states[s].out[1] = p_right->start;
+  p_nfa->states[p_left->end].out[0] = e;
+  p_nfa->states[p_right->end].out[0] = e;
+  p_left->start = s;
+  p_left->end = e;
+  return true;
+}
+
+static bool frag_star (Nfa * const p_nfa, Fragment * const p_frag)
+{
+  const int s = nfa_new_state(p_nfa, NFA_EPSILON);
+  const int e = nfa_new_state(p_nfa, NFA_EPSILON);
+  if (s < 0 || e < 0)
+    return false;
+
+  p_nfa->states[s].out[0] = p_frag->start;
+  p_nfa->states[s].out[1] = e;
+  p_nfa->states[p_frag->end].out[0] = p_frag->start;
+  p_nfa->states[p_frag->end].out[1] = e;
+  p_frag->start = s;
+  p_frag->end = e;
+  return true;
+}
+
+static bool lower_RE (Nfa * const p_nfa,
+                      const Node * const p_RE,
+                      Fragment * const p_frag);
+
+static unsigned char unescape (char c)
+{
+  switch (c)
+  {
+    case 'n': return '\n';
+    case 't': return '\t';
+    case 'r': return '\r';
+    default:  return (unsigned char)c;
+  }
+}
+
+// Read one byte of a class, escaped or not, and move past it.
+static unsigned char class_byte (const char **pp)
+{
+  const char *p = *pp;
+
+  if ('\\' == p[0])
+  {
+    *pp = p + 2;
+    return unescape(p[1]);
+  }
+
+  *pp = p + 1;
+  return (unsigned char)p[0];
+}
+
+// Bytes of a class [...] or [^...].  A negated class never holds NUL.
+static void class_set (const char *content, ByteSet * const p_set)
+{
+  const char *p = content + 1;
+  const bool negate = ('^' == *p);
+
+  if (negate)
+    ++p;
+
+  while (']' != *p)
+  {
+    const unsigned char lo = class_byte(&p);
+    unsigned char hi = lo;
+    if ('-' == p[0] && ']' != p[1])
+    {
+      ++p;
+      hi = class_byte(&p);
+    }
+    for (int b = lo; b <= hi; ++b)
+      byte_set_add(p_set, (unsigned char)b);
+  }
+
+  if (negate)
+  {
+    for (int w = 0; w < BYTE_VALUES / 32; ++w)
+      p_set->bits[w] = ~p_set->bits[w];
+    p_set->bits[0] &= ~(uint32_t)1;
+  }
+}
+
+// Lower the symbol stored in a leaf of the parse tree.
+static bool lower_symbol (Nfa * const p_nfa,
+                          const char *content,
+                          Fragment * const p_frag)
+{
+  ByteSet set;
+  byte_set_clear(&set);
+
+  if ('\\' == content[0])
+    byte_set_add(&set, unescape(content[1]));
+  else if ('[' == content[0])
+    class_set(content, &set);
+  else
+    byte_set_add(&set, (unsigned char)content[0]);
+
+  return frag_set(p_nfa, &set, p_frag);
+}
+
+// Apply the tail RE' to the left operand in p_frag.
+static bool lower_RE_prime (Nfa * const p_nfa,
+                            const Node * const p_RE_prime,
+                            Fragment * const p_frag)
+{
+  const Node * const p_first = node_child(p_RE_prime, 0);
+  const Node * p_tail;
+  Fragment right;
+
+  if (0 == strcmp(node_content(p_first), "+"))
+  {
+    // RE' -> + RE | + RE RE'.
+    if (!lower_RE(p_nfa, node_child(p_RE_prime, 1), &right)
+        || !frag_union(p_nfa, p_frag, &right))
+      return false;
+    p_tail = node_child(p_RE_prime, 2);
+  }
+  else if (0 == strcmp(node_content(p_first), "*"))
+  {
+    // RE' -> * | * RE'.
+    if (!frag_star(p_nfa, p_frag))
+      return false;
+    p_tail = node_child(p_RE_prime, 1);
+  }
+  else
+  {
+    // RE' -> RE | RE RE'.
+    if (!lower_RE(p_nfa, p_first, &right))
+      return false;
+    frag_concat(p_nfa, p_frag, &right);
+    p_tail = node_child(p_RE_prime, 1);
+  }
+
+  return (NULL == p_tail) || lower_RE_prime(p_nfa, p_tail, p_frag);
+}
+
+static bool lower_RE (Nfa * const p_nfa,
+                      const Node * const p_RE,
+                      Fragment * const p_frag)
+{
+  const Node * const p_first = node_child(p_RE, 0);
+  const Node * p_tail;
+
+  if (0 == strcmp(node_content(p_first), "(") && p_nfa->tagged)
+  {
+    // RE -> ( RE ) | ( RE ) RE', with the group bounds recorded.
+    const int group = ++p_nfa->n_groups;
+    Fragment inner, close;
+    if (!frag_tag(p_nfa, 2 * group, p_frag)
+        || !lower_RE(p_nfa, node_child(p_RE, 1), &inner)
+        || !frag_tag(p_nfa, 2 * group + 1, &close))
+      return false;
+    frag_concat(p_nfa, p_frag, &inner);
+    frag_concat(p_nfa, p_frag, &close);
+    p_tail = node_child(p_RE, 3);
+  }
+  else if (0 == strcmp(node_content(p_first), "("))
+  {
+    // RE -> ( RE ) | ( RE ) RE'.
+    if (!lower_RE(p_nfa, node_child(p_RE, 1), p_frag))
+      return false;
+    p_tail = node_child(p_RE, 3);
+  }
+  else if (0 == strcmp(node_content(p_first), "#"))
+  {
+    // RE -> # | # RE'.
+    if (!frag_epsilon(p_nfa, p_frag))
+      return false;
+    p_tail = node_child(p_RE, 1);
+  }
+  else
+  {
+    // RE -> symbol | symbol RE'.
+    if (!lower_symbol(p_nfa, node_content(p_first), p_frag))
+      return false;
+    p_tail = node_child(p_RE, 1);
+  }
+
+  return (NULL == p_tail) || lower_RE_prime(p_nfa, p_tail, p_frag);
+}
+
+// Add the expression parsed in p_root to the NFA, accepting it as 'rule'.
+// Rules added earlier have priority over the ones added later.
+bool nfa_add_rule (Nfa * const p_nfa, const Node * const p_root, int rule)
+{
+  Fragment frag;
+
+  if (!lower_RE(p_nfa, node_child(p_root, 0), &frag))
+    return false;
+
+  p_nfa->states[frag.end].accept = rule;
+
+  if (p_nfa->start < 0)
+  {
+    p_nfa->start = frag.start;
+    return true;
+  }
+
+  const int s = nfa_new_state(p_nfa, NFA_EPSILON);
+  if (s < 0)
+    return false;
+
+  p_nfa->states[s].out[0] = p_nfa->start;
+  p_nfa->states[s].out[1] = frag.start;
+  p_nfa->start = s;
+  return true;
+}
+
+bool nfa_from_tree (Nfa * const p_nfa, const Node * const p_root)
+{
+  const uint64_t t = trace_begin();
+  nfa_init(p_nfa);
+  const bool ok = nfa_add_rule(p_nfa, p_root, 0);
+  trace_end(TRACE_LOWER, t);
+  return ok;
+}
+
+bool nfa_from_tree_tagged (Nfa * const p_nfa, const Node * const p_root)
+{
+  const uint64_t t = trace_begin();
+  nfa_init(p_nfa);
+  p_nfa->tagged = true;
+  const bool ok = nfa_add_rule(p_nfa, p_root, 0);
+  trace_end(TRACE_LOWER, t);
+  return ok;
+}
+
+// Copy the states of p_src at the end of p_dst.
+static bool nfa_append (Nfa * const p_dst, const Nfa * const p_src)
+{
+  const int offset = p_dst->n_states;
+
+  for (int i = 0; i < p_src->n_states; ++i)
+  {
+    const NfaState * const p_from = &p_src->states[i];
+    const int s = nfa_new_state(p_dst, p_from->kind);
+    if (s < 0)
+      return false;
+
+    NfaState * const p_to = &p_dst->states[s];
+    p_to->accept = p_from->accept;
+    p_to->tag = p_from->tag;
+    for (int k = 0; k < 2; ++k)
+      p_to->out[k] = (p_from->out[k] < 0) ? -1 : p_from->out[k] + offset;
+    if (NFA_SET == p_from->kind)
+    {
+      p_to->set = nfa_new_set(p_dst, &p_src->sets[p_from->set]);
+      if (p_to->set < 0)
+        return false;
+    }
+  }
+
+  return true;
+}
+
+// p_dst accepts the union of the languages of p_a and p_b.
+bool nfa_union (Nfa * const p_dst, const Nfa * const p_a, const Nfa * const p_b)
+{
+  nfa_init(p_dst);
+
+  const int offset_b = p_a->n_states;
+  if (!nfa_append(p_dst, p_a) || !nfa_append(p_dst, p_b))
+    return false;
+
+  const int s = nfa_new_state(p_dst, NFA_EPSILON);
+  if (s < 0)
+    return false;
+
+  p_dst->states[s].out[0] = p_a->start;
+  p_dst->states[s].out[1] = p_b->start + offset_b;
+  p_dst->start = s;
+  return true;
+}
+
+/**** Lazy DFA. ****/
+
+static unsigned hash_set (const int *p_set, int len)
+{
+  unsigned h = 2166136261u; // FNV-1a.
+  for (int i = 0; i < len; ++i)
+  {
+    h ^= (unsigned)p_set[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static int compare_ints (const void *p_a, const void *p_b)
+{
+  const int a = *(const int *)p_a;
+  const int b = *(const int *)p_b;
+  return (a > b) - (a < b);
+}
+
+bool lazy_dfa_init (LazyDfa * const p_dfa,
+                    const Nfa * const p_nfa,
+                    const ByteClasses * const p_classes)
+{
+  memset(p_dfa, 0, sizeof(LazyDfa));
+  p_dfa->p_nfa = p_nfa;
+
+  if (NULL != p_classes)
+    p_dfa->classes = *p_classes;
+  else
+    byte_classes_compute(&p_nfa, 1, &p_dfa->classes);
+
+  p_dfa->cap_hash = INITIAL_CAPACITY;
+  p_dfa->hash = malloc((size_t)p_dfa->cap_hash * sizeof(int));
+  p_dfa->stack = malloc((size_t)(p_nfa->n_states + 1) * sizeof(int));
+  p_dfa->scratch = malloc((size_t)(p_nfa->n_states + 1) * sizeof(int));
+  p_dfa->mark = calloc((size_t)p_nfa->n_states + 1, sizeof(unsigned));
+
+  if (NULL == p_dfa->hash || NULL == p_dfa->stack
+      || NULL == p_dfa->scratch || NULL == p_dfa->mark)
+  {
+    lazy_dfa_free(p_dfa);
+    return false;
+  }
+
+  for (int i = 0; i < p_dfa->cap_hash; ++i)
+    p_dfa->hash[i] = HASH_EMPTY;
+
+  return true;
+}
+
+void lazy_dfa_free (LazyDfa * const p_dfa)
+{
+  free(p_dfa->trans);
+  free(p_dfa->accept);
+  free(p_dfa->set_start);
+  free(p_dfa->set_len);
+  free(p_dfa->set_data);
+  free(p_dfa->hash);
+  free(p_dfa->stack);
+  free(p_dfa->mark);
+  free(p_dfa->scratch);
+  memset(p_dfa, 0, sizeof(LazyDfa));
+}
+
+// Mark the states reachable through epsilon moves from the 'n' states in
+// p_dfa->stack, and store them sorted in p_dfa->scratch.  Returns their count.
+static int closure (LazyDfa * const p_dfa, int n)
+{
+  const Nfa * const p_nfa = p_dfa->p_nfa;
+  int n_out = 0;
+
+  for (int i = 0; i < n; ++i)
+    p_dfa->mark[p_dfa->stack[i]] = p_dfa->generation;
+
+  while (n > 0)
+  {
+    const int s = p_dfa->stack[--n];
+    p_dfa->scratch[n_out++] = s;
+
+    if (NFA_SET != p_nfa->states[s].kind)
+    {
+      for (int k = 0; k < 2; ++k)
+      {
+        const int t = p_nfa->states[s].out[k];
+        if (t >= 0 && p_dfa->mark[t] != p_dfa->generation)
+        {
+          p_dfa->mark[t] = p_dfa->generation;
+          p_dfa->stack[n++] = t;
+        }
+      }
+    }
+  }
+
+  qsort(p_dfa->scratch, (size_t)n_out, sizeof(int), compare_ints);
+  return n_out;
+}
+
+static bool rehash (LazyDfa * const p_dfa)
+{
+  const int cap = p_dfa->cap_hash * 2;
+  int *p_hash = malloc((size_t)cap * sizeof(int));
+  if (NULL == p_hash)
+    return false;
+
+  for (int i = 0; i < cap; ++i)
+    p_hash[i] = HASH_EMPTY;
+
+  for (int d = 0; d < p_dfa->n_states; ++d)
+  {
+    unsigned h = hash_set(&p_dfa->set_data[p_dfa->set_start[d]],
+                          p_dfa->set_len[d]);
+    while (HASH_EMPTY != p_hash[h & (unsigned)(cap - 1)])
+      ++h;
+    p_hash[h & (unsigned)(cap - 1)] = d;
+  }
+
+  free(p_dfa->hash);
+  p_dfa->hash = p_hash;
+  p_dfa->cap_hash = cap;
+  return true;
+}
+
+// Find or create the DFA state for the NFA set in p_dfa->scratch.
+static int intern_state (LazyDfa * const p_dfa, int len)
+{
+  const int *p_set = p_dfa->scratch;
+  const unsigned mask = (unsigned)(p_dfa->cap_hash - 1);
+  unsigned h = hash_set(p_set, len);
+
+  for (; HASH_EMPTY != p_dfa->hash[h & mask]; ++h)
+  {
+    const int d = p_dfa->hash[h & mask];
+    if (p_dfa->set_len[d] == len
+        && 0 == memcmp(&p_dfa->set_data[p_dfa->set_start[d]], p_set,
+                       (size_t)len * sizeof(int)))
+      return d;
+  }
+
+  const int d = p_dfa->n_states;
+  const int n_classes = p_dfa->classes.n_classes;
+  int cap = p_dfa->cap_states;
+  if (d + 1 > cap)
+  {
+    cap = (cap > 0) ? cap * 2 : INITIAL_CAPACITY;
+    int *p_trans = realloc(p_dfa->trans,
+                           (size_t)cap * (size_t)n_classes * sizeof(int));
+    if (NULL != p_trans)
+      p_dfa->trans = p_trans;
+    int *p_accept = realloc(p_dfa->accept, (size_t)cap * sizeof(int));
+    if (NULL != p_accept)
+      p_dfa->accept = p_accept;
+    int *p_start = realloc(p_dfa->set_start, (size_t)cap * sizeof(int));
+    if (NULL != p_start)
+      p_dfa->set_start = p_start;
+    int *p_len = realloc(p_dfa->set_len, (size_t)cap * sizeof(int));
+    if (NULL != p_len)
+      p_dfa->set_len = p_len;
+    if (NULL == p_trans || NULL == p_accept || NULL == p_start || NULL == p_len)
+      return DFA_UNKNOWN;
+    p_dfa->cap_states = cap;
+  }
+
+  if (!grow((void **)&p_dfa->set_data, &p_dfa->cap_set_data,
+            p_dfa->n_set_data + len, sizeof(int)))
+    return DFA_UNKNOWN;
+
+  memcpy(&p_dfa->set_data[p_dfa->n_set_data], p_set, (size_t)len * sizeof(int));
+  p_dfa->set_start[d] = p_dfa->n_set_data;
+  p_dfa->set_len[d] = len;
+  p_dfa->n_set_data += len;
+
+  int accept = NFA_NO_ACCEPT;
+  for (int i = 0; i < len; ++i)
+  {
+    const int rule = p_dfa->p_nfa->states[p_set[i]].accept;
+    if (NFA_NO_ACCEPT != rule && (NFA_NO_ACCEPT == accept || rule < accept))
+      accept = rule;
+  }
+  p_dfa->accept[d] = accept;
+
+  for (int c = 0; c < n_classes; ++c)
+    p_dfa->trans[(size_t)d * (size_t)n_classes + (size_t)c] = DFA_UNKNOWN;
+
+  p_dfa->hash[h & mask] = d;
+  ++p_dfa->n_states;
+
+  if (2 * p_dfa->n_states > p_dfa->cap_hash && !rehash(p_dfa))
+    return DFA_UNKNOWN;
+
+  return d;
+}
+
+int lazy_dfa_start (LazyDfa * const p_dfa)
+{
+  if (p_dfa->p_nfa->start < 0)
+    return DFA_UNKNOWN;
+
+  ++p_dfa->generation;
+  p_dfa->stack[0] = p_dfa->p_nfa->start;
+  return intern_state(p_dfa, closure(p_dfa, 1));
+}
+
+int lazy_dfa_next (LazyDfa * const p_dfa, int state, int byte_class)
+{
+  const size_t idx = (size_t)state * (size_t)p_dfa->classes.n_classes
+                     + (size_t)byte_class;
+  if (DFA_UNKNOWN != p_dfa->trans[idx])
+    return p_dfa->trans[idx];
+
+  const Nfa * const p_nfa = p_dfa->p_nfa;
+  const unsigned char byte = p_dfa->classes.rep[byte_class];
+  const int start = p_dfa->set_start[state];
+  const int len = p_dfa->set_len[state];
+  int n = 0;
+
+  ++p_dfa->generation;
+  for (int i = 0; i < len; ++i)
+  {
+    const NfaState * const p_s = &p_nfa->states[p_dfa->set_data[start + i]];
+    if (NFA_SET == p_s->kind
+        && byte_set_has(&p_nfa->sets[p_s->set], byte)
+        && p_dfa->mark[p_s->out[0]] != p_dfa->generation)
+    {
+      p_dfa->mark[p_s->out[0]] = p_dfa->generation;
+      p_dfa->stack[n++] = p_s->out[0];
+    }
+  }
+
+  const int next = intern_state(p_dfa, closure(p_dfa, n));
+  if (DFA_UNKNOWN != next)
+    p_dfa->trans[idx] = next; // The table may have moved while interning.
+
+  return next;
+}
+
+bool lazy_dfa_match (LazyDfa * const p_dfa, const char *s, size_t len)
+{
+  int state = lazy_dfa_start(p_dfa);
+
+  for (size_t i = 0; i < len && DFA_UNKNOWN != state; ++i)
+    state = lazy_dfa_next(p_dfa, state,
+                          p_dfa->classes.class_of[(unsigned char)s[i]]);
+
+  return DFA_UNKNOWN != state && NFA_NO_ACCEPT != p_dfa->accept[state];
+}
+
+/**** Full DFA. ****/
+
+bool dfa_build (Dfa * const p_dfa, const Nfa * const p_nfa)
+{
+  const uint64_t t = trace_begin();
+  LazyDfa lazy;
+
+  memset(p_dfa, 0, sizeof(Dfa));
+  if (!lazy_dfa_init(&lazy, p_nfa, NULL))
+    return false;
+
+  // States are interned in discovery order, so this is a breadth-first walk.
+  bool ok = DFA_UNKNOWN != lazy_dfa_start(&lazy);
+  for (int d = 0; ok && d < lazy.n_states; ++d)
+    for (int c = 0; ok && c < lazy.classes.n_classes; ++c)
+      ok = DFA_UNKNOWN != lazy_dfa_next(&lazy, d, c);
+
+  if (ok)
+  {
+    p_dfa->classes = lazy.classes;
+    p_dfa->n_states = lazy.n_states;
+    p_dfa->start = 0;
+    p_dfa->trans = lazy.trans;
+    p_dfa->accept = lazy.accept;
+    lazy.trans = NULL;
+    lazy.accept = NULL;
+  }
+
+  lazy_dfa_free(&lazy);
+  trace_end(TRACE_DETERMINIZE, t);
+  return ok;
+}
+
+void dfa_free (Dfa * const p_dfa)
+{
+  free(p_dfa->trans);
+  free(p_dfa->accept);
+  memset(p_dfa, 0, sizeof(Dfa));
+}
+
+// Give each state the block of the first state with the same signature,
+// returns the number of blocks.
+static int refine (const int *p_signatures,
+                   int width,
+                   int n_states,
+                   int *p_block,
+                   int *p_hash,
+                   int cap_hash)
+{
+  const unsigned mask = (unsigned)(cap_hash - 1);
+  int n_blocks = 0;
+
+  for (int i = 0; i < cap_hash; ++i)
+    p_hash[i] = HASH_EMPTY;
+
+  for (int s = 0; s < n_states; ++s)
+  {
+    const int *p_sig = &p_signatures[(size_t)s * (size_t)width];
+    unsigned h = hash_set(p_sig, width);
+
+    for (; HASH_EMPTY != p_hash[h & mask]; ++h)
+    {
+      const int r = p_hash[h & mask];
+      if (0 == memcmp(&p_signatures[(size_t)r * (size_t)width], p_sig,
+                      (size_t)width * sizeof(int)))
+        break;
+    }
+
+    if (HASH_EMPTY == p_hash[h & mask])
+    {
+      p_hash[h & mask] = s;
+      p_block[s] = n_blocks++;
+    }
+    else
+    {
+      p_block[s] = p_block[p_hash[h & mask]];
+    }
+  }
+
+  return n_blocks;
+}
+
+bool dfa_minimize (Dfa * const p_dfa)
+{
+  const uint64_t t = trace_begin();
+  const int n = p_dfa->n_states;
+  const int n_classes = p_dfa->classes.n_classes;
+  const int width = n_classes + 1;
+  int cap_hash = INITIAL_CAPACITY;
+  while (cap_hash < 2 * n)
+    cap_hash *= 2;
+
+  int *p_signatures = malloc((size_t)n * (size_t)width * sizeof(int));
+  int *p_block = malloc((size_t)n * sizeof(int));
+  int *p_next = malloc((size_t)n * sizeof(int));
+  int *p_hash = malloc((size_t)cap_hash * sizeof(int));
+  int *p_trans = NULL;
+  int *p_accept = NULL;
+  bool ok = NULL != p_signatures && NULL != p_block
+            && NULL != p_next && NULL != p_hash;
+
+  if (ok)
+  {
+    // Initial partition: one block per accepted rule.
+    for (int s = 0; s < n; ++s)
+    {
+      p_signatures[(size_t)s * (size_t)width] = p_dfa->accept[s];
+      for (int c = 0; c < n_classes; ++c)
+        p_signatures[(size_t)s * (size_t)width + 1 + (size_t)c] = 0;
+    }
+    int n_blocks = refine(p_signatures, width, n, p_block, p_hash, cap_hash);
+
+    for (;;)
+    {
+      for (int s = 0; s < n; ++s)
+      {
+        int *p_sig = &p_signatures[(size_t)s * (size_t)width];
+        p_sig[0] = p_block[s];
+        for (int c = 0; c < n_classes; ++c)
+          p_sig[1 + c] = p_block[p_dfa->trans[(size_t)s * (size_t)n_classes
+                                              + (size_t)c]];
+      }
+
+      const int n_new = refine(p_signatures, width, n, p_next, p_hash, cap_hash);
+      int *p_tmp = p_block;
+      p_block = p_next;
+      p_next = p_tmp;
+
+      if (n_new == n_blocks)
+        break;
+      n_blocks = n_new;
+    }
+
+    // Number the blocks in breadth-first order from the start state, for
+    // locality of the tables.  p_next maps blocks to their new number, and
+    // p_hash lists one state of each block in that order.
+    for (int b = 0; b < n_blocks; ++b)
+      p_next[b] = -1;
+    for (int s = n - 1; s >= 0; --s)
+      p_signatures[p_block[s]] = s; // Any state of the block.
+
+    p_trans = malloc((size_t)n_blocks * (size_t)n_classes * sizeof(int));
+    p_accept = malloc((size_t)n_blocks * sizeof(int));
+    ok = NULL != p_trans && NULL != p_accept;
+
+    if (ok)
+    {
+      int n_numbered = 0;
+      p_next[p_block[p_dfa->start]] = n_numbered;
+      p_hash[n_numbered++] = p_signatures[p_block[p_dfa->start]];
+
+      for (int d = 0; d < n_numbered; ++d)
+      {
+        const int s = p_hash[d];
+        p_accept[d] = p_dfa->accept[s];
+        for (int c = 0; c < n_classes; ++c)
+        {
+          const int b = p_block[p_dfa->trans[(size_t)s * (size_t)n_classes
+                                             + (size_t)c]];
+          if (p_next[b] < 0)
+          {
+            p_next[b] = n_numbered;
+            p_hash[n_numbered++] = p_signatures[b];
+          }
+          p_trans[(size_t)d * (size_t)n_classes + (size_t)c] = p_next[b];
+        }
+      }
+
+      free(p_dfa->trans);
+      free(p_dfa->accept);
+      p_dfa->trans = p_trans;
+      p_dfa->accept = p_accept;
+      p_dfa->n_states = n_numbered;
+      p_dfa->start = 0;
+      p_trans = NULL;
+      p_accept = NULL;
+    }
+  }
+
+  free(p_signatures);
+  free(p_block);
+  free(p_next);
+  free(p_hash);
+  free(p_trans);
+  free(p_accept);
+  trace_end(TRACE_MINIMIZE, t);
+  return ok;
+}
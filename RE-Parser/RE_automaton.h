@@ -0,0 +1,157 @@
+/*
+ *  Finite automata for the regular expressions accepted by the parser.
+ *
+ *  The parse tree is lowered to a Thompson NFA reading bytes.  Transitions
+ *  are labelled with byte sets, and the bytes of the alphabet are grouped in
+ *  classes of bytes that no transition can tell apart, so that DFA tables
+ *  have one column per class instead of one per byte.
+ *
+ *  The tree built by parse() is right-nested: RE' holds the tail of the
+ *  expression that follows its left operand.  Only RE' -> * RE' binds to
+ *  the left operand alone, the star of which is continued by RE'.  Union
+ *  and concatenation take the whole tail as their right operand, and so
+ *  group to the right with the same precedence: RE' -> + RE RE' is the
+ *  union of the left operand with RE RE', and RE' -> RE RE' its
+ *  concatenation with RE RE'.  ab*c is a((b*)c), ab+c is a(b+c) and a+bc+d
+ *  is a+(b(c+d)): (ab)+c needs the group.
+ *
+ *  A tagged NFA also records where each group ( RE ) starts and ends: group
+ *  k, numbered from 1 in the order of the '(', writes capture slots 2k and
+ *  2k + 1.  Slots 0 and 1 are left for the whole match.
+ *
+ *  The lazy DFA determinizes the NFA on demand: a state is built the first
+ *  time a transition reaches it, so only the reachable part of the DFA that
+ *  is actually explored is ever materialised.  The full DFA explores all of
+ *  it, and can then be minimized (Moore's partition refinement, starting
+ *  from one block per accepted rule).
+ */
+
+#pragma once
+
+#include "RE_parser.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define NFA_NO_ACCEPT (-1) // Accept value of a non-accepting state.
+#define DFA_UNKNOWN   (-1) // Lazy DFA transition not computed yet.
+#define BYTE_VALUES   256  // Size of the input alphabet.
+
+/**** Byte sets and byte classes. ****/
+
+typedef struct
+{
+  uint32_t bits[BYTE_VALUES / 32];
+} ByteSet;
+
+void byte_set_clear (ByteSet * const p_set);
+
+void byte_set_add (ByteSet * const p_set, unsigned char c);
+
+bool byte_set_has (const ByteSet * const p_set, unsigned char c);
+
+typedef struct
+{
+  int           n_classes;
+  unsigned char class_of [BYTE_VALUES]; // Class of each byte.
+  unsigned char rep      [BYTE_VALUES]; // Smallest byte of each class.
+} ByteClasses;
+
+/**** Thompson NFA. ****/
+
+typedef enum
+{
+  NFA_EPSILON, // Up to two epsilon moves, out[1] is -1 when unused.
+  NFA_SET,     // Reads one byte of sets[set], then moves to out[0].
+  NFA_TAG      // Epsilon move to out[0] that records the position in tag.
+} NfaKind;
+
+typedef struct
+{
+  NfaKind kind;
+  int     out [2];
+  int     set;
+  int     tag;    // Capture slot written by NFA_TAG states.
+  int     accept; // Rule accepted in this state, or NFA_NO_ACCEPT.
+} NfaState;
+
+typedef struct
+{
+  NfaState * states;
+  int        n_states;
+  int        cap_states;
+  ByteSet  * sets;
+  int        n_sets;
+  int        cap_sets;
+  int        start;    // -1 while the NFA has no rule.
+  bool       tagged;   // Groups are lowered with NFA_TAG states.
+  int        n_groups; // Groups ( RE ) met while lowering.
+} Nfa;
+
+void nfa_init (Nfa * const p_nfa);
+
+void nfa_free (Nfa * const p_nfa);
+
+bool nfa_add_rule (Nfa * const p_nfa, const Node * const p_root, int rule);
+
+bool nfa_from_tree (Nfa * const p_nfa, const Node * const p_root);
+
+bool nfa_from_tree_tagged (Nfa * const p_nfa, const Node * const p_root);
+
+bool nfa_union (Nfa * const p_dst, const Nfa * const p_a, const Nfa * const p_b);
+
+void byte_classes_compute (const Nfa * const * pp_nfas,
+                           int n_nfas,
+                           ByteClasses * const p_classes);
+
+/**** Lazy DFA. ****/
+
+typedef struct
+{
+  const Nfa * p_nfa;
+  ByteClasses classes;
+  int       * trans;      // n_states * classes.n_classes entries.
+  int       * accept;     // Highest priority rule of each state.
+  int       * set_start;  // Offset of each state's NFA set in set_data.
+  int       * set_len;
+  int       * set_data;
+  int         n_states;
+  int         cap_states;
+  int         n_set_data;
+  int         cap_set_data;
+  int       * hash;       // Open addressing table of state ids.
+  int         cap_hash;
+  int       * stack;      // Scratch space for epsilon closures.
+  unsigned  * mark;
+  unsigned    generation;
+  int       * scratch;
+} LazyDfa;
+
+bool lazy_dfa_init (LazyDfa * const p_dfa,
+                    const Nfa * const p_nfa,
+                    const ByteClasses * const p_classes);
+
+void lazy_dfa_free (LazyDfa * const p_dfa);
+
+int lazy_dfa_start (LazyDfa * const p_dfa);
+
+int lazy_dfa_next (LazyDfa * const p_dfa, int state, int byte_class);
+
+bool lazy_dfa_match (LazyDfa * const p_dfa, const char *s, size_t len);
+
+/**** Full DFA. ****/
+
+typedef struct
+{
+  ByteClasses classes;
+  int         n_states;
+  int         start;
+  int       * trans;  // n_states * classes.n_classes entries.
+  int       * accept; // Highest priority rule of each state.
+} Dfa;
+
+bool dfa_build (Dfa * const p_dfa, const Nfa * const p_nfa);
+
+bool dfa_minimize (Dfa * const p_dfa);
+
+void dfa_free (Dfa * const p_dfa);
@@ -0,0 +1,334 @@
+/*
+ *  Batch compilation of many expressions on worker threads.
+ */
+
+#include "RE_batch.h"
+#include "RE_automaton.h"
+#include "RE_compiled.h"
+#include "RE_trace.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char * const status_names [] =
+{
+  "compiled", "syntax error", "over budget", "out of memory"
+};
+
+static double now (void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + 1e-9 * (double)t.tv_nsec;
+}
+
+/**** Input. ****/
+
+static bool read_file (const char *path, char **p_data)
+{
+  FILE *fp = fopen(path, "rb");
+  if (NULL == fp)
+    return false;
+
+  long size = -1;
+  if (0 == fseek(fp, 0, SEEK_END))
+    size = ftell(fp);
+  rewind(fp);
+
+  char * const data = (size >= 0) ? malloc((size_t)size + 1) : NULL;
+  const bool ok = NULL != data
+                  && (size_t)size == fread(data, 1, (size_t)size, fp);
+  fclose(fp);
+  if (!ok)
+  {
+    free(data);
+    return false;
+  }
+
+  data[size] = '\0';
+  *p_data = data;
+  return true;
+}
+
+// Split the line in place at its tabs.
+static bool split_fields (char *line, BatchEntry * const p_entry)
+{
+  int n = 1;
+  for (const char *p = line; '\0' != *p; ++p)
+    n += ('\t' == *p);
+
+  p_entry->fields = malloc((size_t)n * sizeof(char *));
+  if (NULL == p_entry->fields)
+    return false;
+
+  p_entry->n_fields = 0;
+  for (char *p = line; NULL != p; )
+  {
+    char * const p_tab = strchr(p, '\t');
+    if (NULL != p_tab)
+      *p_tab = '\0';
+    p_entry->fields[p_entry->n_fields++] = p;
+    p = (NULL != p_tab) ? p_tab + 1 : NULL;
+  }
+
+  return true;
+}
+
+bool batch_read (Batch * const p_batch, const char *path)
+{
+  const uint64_t t = trace_begin();
+
+  memset(p_batch, 0, sizeof(Batch));
+  if (!read_file(path, &p_batch->data))
+    return false;
+
+  int n_lines = 1;
+  for (const char *p = p_batch->data; '\0' != *p; ++p)
+    n_lines += ('\n' == *p);
+
+  p_batch->entries = calloc((size_t)n_lines, sizeof(BatchEntry));
+  if (NULL == p_batch->entries)
+  {
+    batch_free(p_batch);
+    return false;
+  }
+
+  for (char *line = p_batch->data; NULL != line; )
+  {
+    char * const p_newline = strchr(line, '\n');
+    if (NULL != p_newline)
+      *p_newline = '\0';
+
+    const size_t len = strlen(line);
+    if (len > 0 && '\r' == line[len - 1])
+      line[len - 1] = '\0';
+
+    if ('\0' != line[0])
+    {
+      if (!split_fields(line, &p_batch->entries[p_batch->n_entries]))
+      {
+        batch_free(p_batch);
+        return false;
+      }
+      ++p_batch->n_entries;
+    }
+
+    line = (NULL != p_newline) ? p_newline + 1 : NULL;
+  }
+
+  trace_end(TRACE_READ, t);
+  return true;
+}
+
+/**** Workers. ****/
+
+typedef struct
+{
+  Batch      * p_batch;
+  atomic_int * p_next;   // Next entry to take.
+  int          worker;
+  pthread_t    thread;
+  ParseStats   stats;    // Counters of the thread once its work is done.
+} Worker;
+
+static void match_entry (BatchEntry * const p_entry,
+                         const Compiled * const p_compiled)
+{
+  const uint64_t t = trace_begin();
+
+  p_entry->status = BATCH_COMPILED;
+  p_entry->n_states = (int)p_compiled->view.p_header->dfa_n_states;
+  for (int i = 1; i < p_entry->n_fields; ++i)
+    p_entry->n_matched += compiled_match(&p_compiled->view, p_entry->fields[i],
+                                         strlen(p_entry->fields[i]));
+
+  trace_end(TRACE_MATCH, t);
+}
+
+static void run_entry (BatchEntry * const p_entry,
+                       Parser * const p_parser,
+                       RegexCache * const p_cache)
+{
+  const Compiled *p_cached = NULL;
+
+  if (NULL != p_cache)
+    p_cached = regex_cache_get(p_cache, p_entry->fields[0]);
+  if (NULL != p_cached)
+  {
+    p_entry->cached = true;
+    match_entry(p_entry, p_cached);
+    regex_cache_release(p_cache, p_cached);
+    return;
+  }
+
+  Node * const p_tree = node_new();
+  Nfa nfa;
+  Compiled compiled;
+
+  if (NULL == p_tree)
+  {
+    p_entry->status = BATCH_OUT_OF_MEMORY;
+    return;
+  }
+
+  nfa_init(&nfa);
+  p_entry->parse_status = parser_parse(p_parser, p_entry->fields[0], p_tree,
+                                       NULL);
+  parser_profile(p_parser, &p_entry->profile);
+  if (PARSE_SYNTAX_ERROR == p_entry->parse_status)
+    p_entry->status = BATCH_SYNTAX_ERROR;
+  else if (PARSE_OUT_OF_MEMORY == p_entry->parse_status)
+    p_entry->status = BATCH_OUT_OF_MEMORY;
+  else if (PARSE_OK != p_entry->parse_status)
+    p_entry->status = BATCH_OVER_BUDGET;
+  else if (!nfa_from_tree(&nfa, p_tree) || !compiled_from_nfa(&nfa, &compiled))
+    p_entry->status = BATCH_OUT_OF_MEMORY;
+  else if (NULL == p_cache)
+  {
+    match_entry(p_entry, &compiled);
+    compiled_free(&compiled);
+  }
+  else
+  {
+    p_cached = regex_cache_put(p_cache, p_entry->fields[0], &compiled);
+    if (NULL != p_cached)
+    {
+      match_entry(p_entry, p_cached);
+      regex_cache_release(p_cache, p_cached);
+    }
+    else
+    {
+      p_entry->status = BATCH_OUT_OF_MEMORY;
+    }
+  }
+
+  nfa_free(&nfa);
+  node_free(p_tree);
+}
+
+static void * work (void *p_arg)
+{
+  Worker * const p_worker = p_arg;
+  Batch * const p_batch = p_worker->p_batch;
+  Parser * const p_parser = parser_new();
+
+  if (NULL != p_parser)
+    parser_set_budget(p_parser, &p_batch->budget);
+
+  // Without a parser, the entries this worker takes are reported out of
+  // memory instead of being left with the status of a compiled one.
+  for (int i = atomic_fetch_add(p_worker->p_next, 1); i < p_batch->n_entries;
+       i = atomic_fetch_add(p_worker->p_next, 1))
+  {
+    BatchEntry * const p_entry = &p_batch->entries[i];
+    const double t0 = now();
+
+    if (NULL != p_parser)
+      run_entry(p_entry, p_parser, p_batch->p_cache);
+    else
+      p_entry->status = BATCH_OUT_OF_MEMORY;
+    p_entry->worker = p_worker->worker;
+    p_entry->seconds = now() - t0;
+  }
+
+  parser_free(p_parser);
+  parse_stats_get(&p_worker->stats);
+  return NULL;
+}
+
+bool batch_run (Batch * const p_batch, int n_workers)
+{
+  Worker * const workers = malloc((size_t)n_workers * sizeof(Worker));
+  atomic_int next = 0;
+  int n_started = 0;
+
+  if (NULL == workers)
+    return false;
+
+  // The calling thread is worker 0.
+  for (int w = 0; w < n_workers; ++w)
+  {
+    workers[w].p_batch = p_batch;
+    workers[w].p_next = &next;
+    workers[w].worker = w;
+  }
+  for (int w = 1; w < n_workers; ++w)
+  {
+    if (0 != pthread_create(&workers[w].thread, NULL, work, &workers[w]))
+      break;
+    ++n_started;
+  }
+
+  work(&workers[0]);
+  for (int w = 1; w <= n_started; ++w)
+  {
+    pthread_join(workers[w].thread, NULL);
+    parse_stats_add(&p_batch->stats, &workers[w].stats);
+  }
+
+  free(workers);
+  return true;
+}
+
+/**** Output. ****/
+
+void batch_print (const Batch * const p_batch, FILE *fp)
+{
+  const uint64_t t = trace_begin();
+  AllocProfile total;
+  int n_compiled = 0;
+  int n_over_budget = 0;
+  double seconds = 0;
+
+  memset(&total, 0, sizeof(AllocProfile));
+
+  for (int i = 0; i < p_batch->n_entries; ++i)
+  {
+    const BatchEntry * const p_entry = &p_batch->entries[i];
+
+    fprintf(fp, "%s: %s", p_entry->fields[0], status_names[p_entry->status]);
+    if (BATCH_COMPILED == p_entry->status)
+    {
+      fprintf(fp, ", %d states, %d/%d matched%s", p_entry->n_states,
+              p_entry->n_matched, p_entry->n_fields - 1,
+              p_entry->cached ? ", cached" : "");
+      ++n_compiled;
+    }
+    else if (BATCH_OVER_BUDGET == p_entry->status)
+    {
+      fprintf(fp, " (%s)", parse_status_name(p_entry->parse_status));
+      ++n_over_budget;
+    }
+    fprintf(fp, ", %" PRIu64 " nodes allocated, %" PRId64 " bytes peak"
+            ", worker %d, %.3f ms\n", p_entry->profile.n_allocs,
+            p_entry->profile.peak_bytes, p_entry->worker,
+            1e3 * p_entry->seconds);
+    alloc_profile_add(&total, &p_entry->profile);
+    seconds += p_entry->seconds;
+  }
+
+  fprintf(fp, "%d expressions, %d compiled, %d over budget, %.3f ms\n",
+          p_batch->n_entries, n_compiled, n_over_budget, 1e3 * seconds);
+  alloc_profile_print(&total, fp);
+  if (NULL != p_batch->p_cache)
+  {
+    RegexCacheStats stats;
+    regex_cache_stats(p_batch->p_cache, &stats);
+    regex_cache_stats_print(&stats, fp);
+  }
+  trace_end(TRACE_OUTPUT, t);
+}
+
+void batch_free (Batch * const p_batch)
+{
+  for (int i = 0; NULL != p_batch->entries && i < p_batch->n_entries; ++i)
+    free(p_batch->entries[i].fields);
+
+  free(p_batch->entries);
+  free(p_batch->data);
+  memset(p_batch, 0, sizeof(Batch));
+}
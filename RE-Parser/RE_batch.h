@@ -0,0 +1,68 @@
+/*
+ *  Batch compilation of many expressions on worker threads.
+ *
+ *  A batch file has one expression per line, optionally followed by strings
+ *  to match with it, separated by tabs.  The workers take the lines in
+ *  order from a shared counter, and each line is parsed, lowered to an NFA,
+ *  compiled and matched on the worker that took it.  The results are kept
+ *  per line and printed in the order of the file, with the node allocations
+ *  of each parse, then the totals of the batch.
+ *
+ *  Each parse has a budget (see ParseBudget), so that a hostile expression
+ *  is reported as over budget instead of holding its worker.  With a regex
+ *  cache, an expression already compiled by the batch, or by an earlier
+ *  user of the cache, is neither parsed nor compiled again.
+ */
+
+#pragma once
+
+#include "RE_parser.h"
+#include "RE_regex_cache.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#define BATCH_DEFAULT_MAX_STEPS   10000000
+#define BATCH_DEFAULT_MAX_NODES   1000000
+#define BATCH_DEFAULT_MAX_SECONDS 1.0
+
+typedef enum
+{
+  BATCH_COMPILED,
+  BATCH_SYNTAX_ERROR,
+  BATCH_OVER_BUDGET,
+  BATCH_OUT_OF_MEMORY
+} BatchStatus;
+
+typedef struct
+{
+  char        ** fields;    // Expression, then the strings to match.
+  int            n_fields;
+  BatchStatus    status;
+  ParseStatus    parse_status;
+  int            n_states;  // Of the minimal DFA.
+  int            n_matched;
+  AllocProfile   profile;   // Of the parse, zeros when cached.
+  bool           cached;    // Found in the regex cache.
+  int            worker;
+  double         seconds;
+} BatchEntry;
+
+typedef struct
+{
+  char       * data;      // Contents of the file, split in place.
+  BatchEntry * entries;   // One per non-empty line.
+  int          n_entries;
+  ParseBudget  budget;    // Of each parse, no limit until set.
+  RegexCache * p_cache;   // Of the compiled expressions, none when NULL.
+  ParseStats   stats;     // Parser counters of the threads started by
+                          // batch_run, the calling thread keeps its own.
+} Batch;
+
+bool batch_read (Batch * const p_batch, const char *path);
+
+bool batch_run (Batch * const p_batch, int n_workers);
+
+void batch_print (const Batch * const p_batch, FILE *fp);
+
+void batch_free (Batch * const p_batch);
@@ -0,0 +1,429 @@
+/*
+ *  Benchmark of parse() on families of adversarial expressions.
+ *
+ *  Each family is a pattern generator parameterized by n, its number of
+ *  symbols: a+a+...+a, a*a*...a*, ((...(a)...)), aa...a, and random valid
+ *  expressions.  The points of a family are measured for n = 1, 2, ... until
+ *  max_n, or until the median parse time exceeds the budget, as the parser
+ *  backtracks exponentially.
+ *
+ *  Each point runs in a child process, so that its peak RSS is its own and a
+ *  hung or crashing parse only ends its family.  The allocations of one parse
+ *  are counted by wrapping malloc, calloc and realloc at link time
+ *  (-Wl,--wrap=malloc,...).  The results are printed as CSV, one line per
+ *  point, with the median and 99th percentile of the parse times.
+ *
+ *  With a corpus directory, such as the one RE_hunt saves its inputs in, each
+ *  file is then replayed as one more point, named after the file.
+ *
+ *  Usage: RE_bench [runs] [max_n] [budget_ms] [corpus dir]
+ */
+
+#include "RE_parser.h"
+
+#include <dirent.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_RUNS      21
+#define DEFAULT_MAX_N     64
+#define DEFAULT_BUDGET_MS 100
+#define TIMEOUT_SECONDS   60 // Per point, all runs included.
+
+/**** Allocations. ****/
+
+void * __real_malloc (size_t size);
+void * __real_calloc (size_t n, size_t size);
+void * __real_realloc (void *p, size_t size);
+
+static bool     counting = false;
+static uint64_t n_allocs = 0;
+static uint64_t n_alloc_bytes = 0;
+
+static void count (size_t size)
+{
+  if (counting)
+  {
+    ++n_allocs;
+    n_alloc_bytes += size;
+  }
+}
+
+void * __wrap_malloc (size_t size)
+{
+  count(size);
+  return __real_malloc(size);
+}
+
+void * __wrap_calloc (size_t n, size_t size)
+{
+  count(n * size);
+  return __real_calloc(n, size);
+}
+
+void * __wrap_realloc (void *p, size_t size)
+{
+  count(size);
+  return __real_realloc(p, size);
+}
+
+/**** Patterns. ****/
+
+typedef struct
+{
+  char     * data;
+  size_t     len;
+  size_t     cap;
+  uint64_t   seed;
+} Pattern;
+
+static uint32_t pattern_random (Pattern * const p_pattern, uint32_t n)
+{
+  // xorshift64*.
+  p_pattern->seed ^= p_pattern->seed >> 12;
+  p_pattern->seed ^= p_pattern->seed << 25;
+  p_pattern->seed ^= p_pattern->seed >> 27;
+  return (uint32_t)((p_pattern->seed * 2685821657736338717ULL) >> 32) % n;
+}
+
+static void pattern_add (Pattern * const p_pattern, char c)
+{
+  if (p_pattern->len + 1 < p_pattern->cap)
+    p_pattern->data[p_pattern->len++] = c;
+}
+
+// Random expression of n symbols: concatenations and unions of groups and
+// starred symbols.
+static void pattern_add_random (Pattern * const p_pattern, int n)
+{
+  if (1 == n)
+  {
+    pattern_add(p_pattern, (char)('a' + pattern_random(p_pattern, 26)));
+    if (0 == pattern_random(p_pattern, 4))
+      pattern_add(p_pattern, '*');
+    return;
+  }
+
+  const bool group = 0 == pattern_random(p_pattern, 4);
+  const int left = 1 + (int)pattern_random(p_pattern, (uint32_t)n - 1);
+
+  if (group)
+    pattern_add(p_pattern, '(');
+  pattern_add_random(p_pattern, left);
+  if (0 == pattern_random(p_pattern, 2))
+    pattern_add(p_pattern, '+');
+  pattern_add_random(p_pattern, n - left);
+  if (group)
+  {
+    pattern_add(p_pattern, ')');
+    if (0 == pattern_random(p_pattern, 2))
+      pattern_add(p_pattern, '*');
+  }
+}
+
+typedef enum
+{
+  FAMILY_PLUS,
+  FAMILY_STAR,
+  FAMILY_NESTED,
+  FAMILY_CONCAT,
+  FAMILY_RANDOM,
+  N_FAMILIES
+} Family;
+
+static const char * const family_names [N_FAMILIES] =
+{
+  "plus", "star", "nested", "concat", "random"
+};
+
+static bool pattern_generate (Pattern * const p_pattern, Family family, int n)
+{
+  p_pattern->cap = 8 * (size_t)n + 1;
+  p_pattern->len = 0;
+  p_pattern->seed = 0x9e3779b97f4a7c15ULL + (uint64_t)n;
+  p_pattern->data = malloc(p_pattern->cap);
+  if (NULL == p_pattern->data)
+    return false;
+
+  for (int i = 0; i < n; ++i)
+  {
+    switch (family)
+    {
+      case FAMILY_PLUS:
+        if (0 != i)
+          pattern_add(p_pattern, '+');
+        pattern_add(p_pattern, 'a');
+        break;
+      case FAMILY_STAR:
+        pattern_add(p_pattern, 'a');
+        pattern_add(p_pattern, '*');
+        break;
+      case FAMILY_NESTED:
+        pattern_add(p_pattern, '(');
+        break;
+      default:
+        pattern_add(p_pattern, 'a');
+        break;
+    }
+  }
+
+  if (FAMILY_NESTED == family)
+  {
+    pattern_add(p_pattern, 'a');
+    for (int i = 0; i < n; ++i)
+      pattern_add(p_pattern, ')');
+  }
+  else if (FAMILY_RANDOM == family)
+  {
+    p_pattern->len = 0;
+    pattern_add_random(p_pattern, n);
+  }
+
+  p_pattern->data[p_pattern->len] = '\0';
+  return true;
+}
+
+/**** Measures. ****/
+
+typedef struct
+{
+  double   median;
+  double   p99;
+  uint64_t allocs;
+  uint64_t alloc_bytes;
+  bool     ok;
+} Point;
+
+static double now (void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + 1e-9 * (double)t.tv_nsec;
+}
+
+static int compare_doubles (const void *p_a, const void *p_b)
+{
+  const double a = *(const double *)p_a;
+  const double b = *(const double *)p_b;
+  return (a > b) - (a < b);
+}
+
+// The allocations are counted on the first run, they are the same each time.
+// An expression rejected is measured all the same, as corpus inputs can be.
+static void measure (const Pattern * const p_pattern, int n_runs,
+                     Point * const p_point)
+{
+  double seconds[n_runs];
+
+  memset(p_point, 0, sizeof(Point));
+  p_point->ok = true;
+  for (int i = 0; i < n_runs; ++i)
+  {
+    Node * const p_tree = node_new();
+    if (NULL == p_tree)
+    {
+      p_point->ok = false;
+      n_runs = i;
+      break;
+    }
+
+    counting = (0 == i);
+    const double t0 = now();
+    p_point->ok = parse(p_pattern->data, p_tree);
+    seconds[i] = now() - t0;
+    counting = false;
+    node_free(p_tree);
+  }
+
+  qsort(seconds, (size_t)n_runs, sizeof(double), compare_doubles);
+  p_point->median = seconds[n_runs / 2];
+  p_point->p99 = seconds[(99 * n_runs + 99) / 100 - 1];
+  p_point->allocs = n_allocs;
+  p_point->alloc_bytes = n_alloc_bytes;
+}
+
+// Measure in a child process, which sends its Point through a pipe.  Returns
+// the status of the point, and its peak RSS in *p_rss_kb.
+static const char * measure_apart (const Pattern * const p_pattern,
+                                   int n_runs,
+                                   Point * const p_point,
+                                   long *p_rss_kb)
+{
+  int fds[2];
+  struct rusage usage;
+  int status = 0;
+
+  fflush(stdout);
+  if (0 != pipe(fds))
+    return "error";
+
+  const pid_t pid = fork();
+  if (pid < 0)
+  {
+    close(fds[0]);
+    close(fds[1]);
+    return "error";
+  }
+
+  if (0 == pid)
+  {
+    close(fds[0]);
+    alarm(TIMEOUT_SECONDS);
+    measure(p_pattern, n_runs, p_point);
+    const bool sent = sizeof(Point) == write(fds[1], p_point, sizeof(Point));
+    _exit(sent ? 0 : 1);
+  }
+
+  close(fds[1]);
+  const bool received = sizeof(Point) == read(fds[0], p_point, sizeof(Point));
+  close(fds[0]);
+  if (pid != wait4(pid, &status, 0, &usage))
+    return "error";
+
+  *p_rss_kb = usage.ru_maxrss;
+  if (WIFSIGNALED(status))
+    return (SIGALRM == WTERMSIG(status)) ? "timeout" : "crash";
+  if (!received || !WIFEXITED(status) || 0 != WEXITSTATUS(status))
+    return "error";
+  return p_point->ok ? "ok" : "rejected";
+}
+
+/**** Corpus. ****/
+
+static bool pattern_read (Pattern * const p_pattern, const char *path)
+{
+  FILE *fp = fopen(path, "rb");
+  if (NULL == fp)
+    return false;
+
+  memset(p_pattern, 0, sizeof(Pattern));
+  p_pattern->cap = 4096;
+  p_pattern->data = malloc(p_pattern->cap);
+  if (NULL != p_pattern->data)
+    p_pattern->len = fread(p_pattern->data, 1, p_pattern->cap - 1, fp);
+  const bool ok = NULL != p_pattern->data && !ferror(fp);
+  fclose(fp);
+  if (!ok)
+  {
+    free(p_pattern->data);
+    return false;
+  }
+
+  // One expression per file, a final newline is not part of it.
+  while (p_pattern->len > 0 && ('\n' == p_pattern->data[p_pattern->len - 1]
+                                || '\r' == p_pattern->data[p_pattern->len - 1]))
+    --p_pattern->len;
+  p_pattern->data[p_pattern->len] = '\0';
+  return true;
+}
+
+static int skip_hidden (const struct dirent *p_entry)
+{
+  return '.' != p_entry->d_name[0];
+}
+
+static bool replay_corpus (const char *dir, int n_runs)
+{
+  struct dirent **entries;
+  const int n_entries = scandir(dir, &entries, skip_hidden, alphasort);
+  bool ok = n_entries >= 0;
+
+  for (int e = 0; e < n_entries; ++e)
+  {
+    char path[4096];
+    Pattern pattern;
+    Point point;
+    long rss_kb = 0;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, entries[e]->d_name);
+    if (ok && pattern_read(&pattern, path))
+    {
+      memset(&point, 0, sizeof(Point));
+      const char * const status = measure_apart(&pattern, n_runs, &point,
+                                                &rss_kb);
+      printf("%s,%zu,%zu,%d,%.3f,%.3f,%" PRIu64 ",%" PRIu64 ",%ld,%s\n",
+             entries[e]->d_name, pattern.len, pattern.len, n_runs,
+             1e6 * point.median, 1e6 * point.p99, point.allocs,
+             point.alloc_bytes, rss_kb, status);
+      free(pattern.data);
+    }
+    else if (ok)
+    {
+      printf("Cannot read '%s'\n", path);
+      ok = false;
+    }
+    free(entries[e]);
+  }
+
+  if (n_entries >= 0)
+    free(entries);
+  return ok;
+}
+
+int main (int argc, char **argv)
+{
+  // Input checks.
+  if (argc > 5)
+  {
+    printf("Wrong number of command-line arguments: ");
+    printf("%d arguments found, at most %d expected\n", argc - 1, 4);
+    printf("Usage: RE_bench [runs] [max_n] [budget_ms] [corpus dir]\n");
+    return 1;
+  }
+
+  const int n_runs = (argc > 1) ? atoi(argv[1]) : DEFAULT_RUNS;
+  const int max_n = (argc > 2) ? atoi(argv[2]) : DEFAULT_MAX_N;
+  const int budget_ms = (argc > 3) ? atoi(argv[3]) : DEFAULT_BUDGET_MS;
+  if (n_runs <= 0 || max_n <= 0 || budget_ms <= 0)
+  {
+    printf("The runs, max_n and budget must be positive\n");
+    return 1;
+  }
+
+  printf("family,n,length,runs,median_us,p99_us,allocs,alloc_bytes,"
+         "peak_rss_kb,status\n");
+
+  for (Family family = 0; family < N_FAMILIES; ++family)
+  {
+    for (int n = 1; n <= max_n; ++n)
+    {
+      Pattern pattern;
+      Point point;
+      long rss_kb = 0;
+
+      if (!pattern_generate(&pattern, family, n))
+      {
+        printf("Out of memory\n");
+        return 1;
+      }
+
+      memset(&point, 0, sizeof(Point));
+      const char * const status = measure_apart(&pattern, n_runs, &point,
+                                                &rss_kb);
+      printf("%s,%d,%zu,%d,%.3f,%.3f,%" PRIu64 ",%" PRIu64 ",%ld,%s\n",
+             family_names[family], n, pattern.len, n_runs, 1e6 * point.median,
+             1e6 * point.p99, point.allocs, point.alloc_bytes, rss_kb, status);
+      free(pattern.data);
+
+      if (0 != strcmp(status, "ok") || 1e3 * point.median > budget_ms)
+        break;
+    }
+  }
+
+  if (argc > 4 && !replay_corpus(argv[4], n_runs))
+  {
+    printf("Cannot replay the corpus '%s'\n", argv[4]);
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,532 @@
+/*
+ *  Content-addressed on-disk cache, and its use for compiled automata.
+ */
+
+#include "RE_cache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ENTRY_MAGIC  "RECACHE"
+#define ENTRY_SUFFIX ".entry"
+#define STATS_FILE   "stats"
+#define FNV_OFFSET   14695981039346656037ull
+#define FNV_PRIME    1099511628211ull
+
+typedef struct
+{
+  char     magic [8];
+  uint64_t key_len;
+  uint64_t value_offset; // Multiple of COMPILED_ALIGN.
+  uint64_t value_size;
+} EntryHeader;
+
+typedef struct
+{
+  char          * path;
+  struct timespec mtime;
+  uint64_t        size;
+} EntryFile;
+
+uint64_t hash_bytes (const void *p_data, size_t len, uint64_t h)
+{
+  const unsigned char *p = p_data;
+
+  if (0 == h)
+    h = FNV_OFFSET;
+
+  for (size_t i = 0; i < len; ++i)
+  {
+    h ^= p[i];
+    h *= FNV_PRIME;
+  }
+  return h;
+}
+
+static char * join_path (const char *dir, const char *name)
+{
+  const size_t len = strlen(dir) + 1 + strlen(name) + 1;
+  char *path = malloc(len);
+  if (NULL != path)
+    snprintf(path, len, "%s/%s", dir, name);
+  return path;
+}
+
+static char * entry_path (const DiskCache * const p_cache,
+                          const void *p_key,
+                          size_t key_len)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "%016" PRIx64 ENTRY_SUFFIX,
+           hash_bytes(p_key, key_len, 0));
+  return join_path(p_cache->dir, name);
+}
+
+// Create dir and its missing parents.
+static bool make_dirs (const char *dir)
+{
+  char *path = strdup(dir);
+  if (NULL == path)
+    return false;
+
+  for (char *p = path + 1; ; ++p)
+  {
+    if ('/' == *p || '\0' == *p)
+    {
+      const char c = *p;
+      *p = '\0';
+      if (0 != mkdir(path, 0755) && EEXIST != errno)
+      {
+        free(path);
+        return false;
+      }
+      *p = c;
+      if ('\0' == c)
+        break;
+    }
+  }
+
+  free(path);
+  return true;
+}
+
+bool disk_cache_open (DiskCache * const p_cache,
+                      const char *dir,
+                      uint64_t max_bytes)
+{
+  memset(p_cache, 0, sizeof(DiskCache));
+  p_cache->max_bytes = max_bytes;
+  p_cache->dir = strdup(dir);
+  if (NULL == p_cache->dir || !make_dirs(dir))
+  {
+    free(p_cache->dir);
+    p_cache->dir = NULL;
+    return false;
+  }
+  return true;
+}
+
+// The directory is $RE_CACHE_DIR, or RE_parser in $XDG_CACHE_HOME or in
+// ~/.cache.  The size limit is $RE_CACHE_MAX_BYTES.
+bool disk_cache_open_default (DiskCache * const p_cache)
+{
+  const char *dir = getenv("RE_CACHE_DIR");
+  const char *max = getenv("RE_CACHE_MAX_BYTES");
+  const uint64_t max_bytes = (NULL != max) ? strtoull(max, NULL, 10)
+                                           : DISK_CACHE_DEFAULT_MAX_BYTES;
+  char *path = NULL;
+
+  if (NULL != dir)
+    path = strdup(dir);
+  else if (NULL != (dir = getenv("XDG_CACHE_HOME")))
+    path = join_path(dir, "RE_parser");
+  else if (NULL != (dir = getenv("HOME")))
+    path = join_path(dir, ".cache/RE_parser");
+
+  if (NULL == path)
+  {
+    memset(p_cache, 0, sizeof(DiskCache));
+    return false;
+  }
+
+  const bool ok = disk_cache_open(p_cache, path, max_bytes);
+  free(path);
+  return ok;
+}
+
+// The stats file holds the counters saved by every process, then the bytes
+// of the entries, UINT64_MAX when not known.  Returns the locked file.
+static int lock_stats (const DiskCache * const p_cache,
+                       DiskCacheStats * const p_saved,
+                       uint64_t * const p_bytes)
+{
+  char buffer[128];
+  char *path = join_path(p_cache->dir, STATS_FILE);
+  if (NULL == path)
+    return -1;
+
+  const int fd = open(path, O_RDWR | O_CREAT, 0644);
+  free(path);
+  if (fd < 0)
+    return -1;
+  if (0 != flock(fd, LOCK_EX))
+  {
+    close(fd);
+    return -1;
+  }
+
+  memset(p_saved, 0, sizeof(DiskCacheStats));
+  *p_bytes = UINT64_MAX;
+  const ssize_t n = pread(fd, buffer, sizeof(buffer) - 1, 0);
+  if (n > 0)
+  {
+    buffer[n] = '\0';
+    if (5 != sscanf(buffer, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+                    " %" SCNu64, &p_saved->hits, &p_saved->misses,
+                    &p_saved->stores, &p_saved->evictions, p_bytes))
+      *p_bytes = UINT64_MAX;
+  }
+  return fd;
+}
+
+static bool unlock_stats (int fd,
+                          const DiskCacheStats * const p_saved,
+                          uint64_t bytes)
+{
+  char buffer[128];
+  const int len = snprintf(buffer, sizeof(buffer),
+                           "%" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+                           " %" PRIu64 "\n", p_saved->hits, p_saved->misses,
+                           p_saved->stores, p_saved->evictions, bytes);
+  const bool ok = 0 == ftruncate(fd, 0)
+                  && len == pwrite(fd, buffer, (size_t)len, 0);
+
+  flock(fd, LOCK_UN);
+  close(fd);
+  return ok;
+}
+
+// Add the counters of this process to the ones of the stats file.
+static void save_stats (DiskCache * const p_cache)
+{
+  DiskCacheStats saved;
+  uint64_t bytes;
+  const int fd = lock_stats(p_cache, &saved, &bytes);
+  if (fd < 0)
+    return;
+
+  saved.hits += p_cache->stats.hits;
+  saved.misses += p_cache->stats.misses;
+  saved.stores += p_cache->stats.stores;
+  saved.evictions += p_cache->stats.evictions;
+  if (unlock_stats(fd, &saved, bytes))
+    memset(&p_cache->stats, 0, sizeof(DiskCacheStats));
+}
+
+void disk_cache_close (DiskCache * const p_cache)
+{
+  if (NULL != p_cache->dir)
+    save_stats(p_cache);
+
+  free(p_cache->dir);
+  memset(p_cache, 0, sizeof(DiskCache));
+}
+
+// Counters saved by every process, plus the ones of this process.
+bool disk_cache_read_stats (const DiskCache * const p_cache,
+                            DiskCacheStats * const p_stats)
+{
+  char *path = join_path(p_cache->dir, STATS_FILE);
+  if (NULL == path)
+    return false;
+
+  *p_stats = p_cache->stats;
+  FILE *fp = fopen(path, "r");
+  free(path);
+  if (NULL == fp)
+    return true;
+
+  DiskCacheStats saved;
+  if (4 == fscanf(fp, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
+                  &saved.hits, &saved.misses, &saved.stores, &saved.evictions))
+  {
+    p_stats->hits += saved.hits;
+    p_stats->misses += saved.misses;
+    p_stats->stores += saved.stores;
+    p_stats->evictions += saved.evictions;
+  }
+
+  fclose(fp);
+  return true;
+}
+
+bool disk_cache_get (DiskCache * const p_cache,
+                     const void *p_key,
+                     size_t key_len,
+                     DiskCacheEntry * const p_entry)
+{
+  struct stat st;
+  char *path = entry_path(p_cache, p_key, key_len);
+  int fd = -1;
+
+  memset(p_entry, 0, sizeof(DiskCacheEntry));
+  if (NULL != path)
+    fd = open(path, O_RDONLY);
+
+  if (fd >= 0 && 0 == fstat(fd, &st) && st.st_size >= (off_t)sizeof(EntryHeader))
+  {
+    void *p_base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED != p_base)
+    {
+      const EntryHeader * const p_header = p_base;
+      const uint64_t size = (uint64_t)st.st_size;
+
+      if (0 == memcmp(p_header->magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC))
+          && p_header->key_len == key_len
+          && key_len <= size - sizeof(EntryHeader)
+          && 0 == memcmp((const char *)p_base + sizeof(EntryHeader), p_key,
+                         key_len)
+          && p_header->value_offset <= size
+          && p_header->value_size <= size - p_header->value_offset)
+      {
+        p_entry->p_base = p_base;
+        p_entry->size = (size_t)st.st_size;
+        p_entry->p_value = (const char *)p_base + p_header->value_offset;
+        p_entry->value_size = (size_t)p_header->value_size;
+      }
+      else
+      {
+        munmap(p_base, (size_t)st.st_size);
+      }
+    }
+  }
+
+  if (fd >= 0)
+    close(fd);
+
+  if (NULL != p_entry->p_base)
+  {
+    // Used now: this is what the eviction order looks at.
+    utimensat(AT_FDCWD, path, NULL, 0);
+    ++p_cache->stats.hits;
+  }
+  else
+  {
+    ++p_cache->stats.misses;
+  }
+
+  free(path);
+  return NULL != p_entry->p_base;
+}
+
+void disk_cache_release (DiskCacheEntry * const p_entry)
+{
+  if (NULL != p_entry->p_base)
+    munmap(p_entry->p_base, p_entry->size);
+  memset(p_entry, 0, sizeof(DiskCacheEntry));
+}
+
+static int compare_age (const void *p_a, const void *p_b)
+{
+  const EntryFile * const p_fa = p_a;
+  const EntryFile * const p_fb = p_b;
+  if (p_fa->mtime.tv_sec != p_fb->mtime.tv_sec)
+    return (p_fa->mtime.tv_sec > p_fb->mtime.tv_sec) ? 1 : -1;
+  return (p_fa->mtime.tv_nsec > p_fb->mtime.tv_nsec)
+         - (p_fa->mtime.tv_nsec < p_fb->mtime.tv_nsec);
+}
+
+// Remove the least recently used entries, if the cache exceeds its limit,
+// until it fits in 3/4 of it, so that the next stores do not scan again.
+// Returns the bytes of the entries left.
+static uint64_t evict (DiskCache * const p_cache)
+{
+  DIR *p_dir = opendir(p_cache->dir);
+  EntryFile *p_files = NULL;
+  size_t n_files = 0;
+  size_t cap_files = 0;
+  uint64_t total = 0;
+  struct dirent *p_ent;
+
+  if (NULL == p_dir)
+    return UINT64_MAX;
+
+  const size_t suffix_len = strlen(ENTRY_SUFFIX);
+  while (NULL != (p_ent = readdir(p_dir)))
+  {
+    const size_t len = strlen(p_ent->d_name);
+    struct stat st;
+
+    if (len <= suffix_len
+        || 0 != strcmp(p_ent->d_name + len - suffix_len, ENTRY_SUFFIX))
+      continue;
+
+    char *path = join_path(p_cache->dir, p_ent->d_name);
+    if (NULL == path || 0 != stat(path, &st))
+    {
+      free(path);
+      continue;
+    }
+
+    if (n_files == cap_files)
+    {
+      cap_files = (cap_files > 0) ? 2 * cap_files : 64;
+      EntryFile *p_new = realloc(p_files, cap_files * sizeof(EntryFile));
+      if (NULL == p_new)
+      {
+        free(path);
+        break;
+      }
+      p_files = p_new;
+    }
+
+    p_files[n_files++] = (EntryFile) { path, st.st_mtim, (uint64_t)st.st_size };
+    total += (uint64_t)st.st_size;
+  }
+  closedir(p_dir);
+
+  if (total > p_cache->max_bytes)
+  {
+    const uint64_t low_water = p_cache->max_bytes - p_cache->max_bytes / 4;
+    qsort(p_files, n_files, sizeof(EntryFile), compare_age);
+    for (size_t i = 0; i < n_files && total > low_water; ++i)
+    {
+      if (0 == unlink(p_files[i].path))
+      {
+        total -= p_files[i].size;
+        ++p_cache->stats.evictions;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < n_files; ++i)
+    free(p_files[i].path);
+  free(p_files);
+  return total;
+}
+
+// Account for a store that grew the entries by delta bytes: the directory
+// is only scanned when the total exceeds the limit, or is not known.
+static void add_bytes (DiskCache * const p_cache, int64_t delta)
+{
+  DiskCacheStats saved;
+  uint64_t bytes;
+  const int fd = lock_stats(p_cache, &saved, &bytes);
+  if (fd < 0)
+    return;
+
+  if (UINT64_MAX != bytes && (delta >= 0 || (uint64_t)-delta <= bytes))
+    bytes += (uint64_t)delta;
+  else
+    bytes = UINT64_MAX;
+  if (bytes > p_cache->max_bytes)
+    bytes = evict(p_cache);
+  unlock_stats(fd, &saved, bytes);
+}
+
+bool disk_cache_put (DiskCache * const p_cache,
+                     const void *p_key,
+                     size_t key_len,
+                     const void *p_value,
+                     size_t value_size)
+{
+  static const char zeros[COMPILED_ALIGN] = { 0 };
+  EntryHeader header;
+  char *path = entry_path(p_cache, p_key, key_len);
+  char *tmp = NULL;
+  bool ok = false;
+
+  if (NULL == path)
+    return false;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, ENTRY_MAGIC, sizeof(ENTRY_MAGIC));
+  header.key_len = key_len;
+  header.value_offset = (sizeof(header) + key_len + COMPILED_ALIGN - 1)
+                        & ~(uint64_t)(COMPILED_ALIGN - 1);
+  header.value_size = value_size;
+
+  // A store may replace an entry of the same key.
+  struct stat st;
+  const int64_t old_size = (0 == stat(path, &st)) ? (int64_t)st.st_size : 0;
+
+  // Threads of one process may store the same key at once.
+  static atomic_uint n_tmp;
+  const size_t tmp_len = strlen(path) + 48;
+  tmp = malloc(tmp_len);
+  if (NULL != tmp)
+  {
+    snprintf(tmp, tmp_len, "%s.%ld.%u.tmp", path, (long)getpid(),
+             atomic_fetch_add(&n_tmp, 1));
+    FILE *fp = fopen(tmp, "wb");
+    if (NULL != fp)
+    {
+      const size_t pad = (size_t)header.value_offset - sizeof(header) - key_len;
+      ok = 1 == fwrite(&header, sizeof(header), 1, fp)
+           && key_len == fwrite(p_key, 1, key_len, fp)
+           && pad == fwrite(zeros, 1, pad, fp)
+           && value_size == fwrite(p_value, 1, value_size, fp);
+      ok = (0 == fclose(fp)) && ok;
+      ok = ok && 0 == rename(tmp, path);
+      if (!ok)
+        unlink(tmp);
+    }
+  }
+
+  if (ok)
+  {
+    ++p_cache->stats.stores;
+    add_bytes(p_cache, (int64_t)(header.value_offset + value_size) - old_size);
+  }
+
+  free(tmp);
+  free(path);
+  return ok;
+}
+
+/**** Compiled automata. ****/
+
+// The key is made of the engine options followed by the pattern.  The
+// grammar has no insignificant characters, so the pattern bytes are already
+// in normal form.
+static char * compiled_key (const char *rexpr, size_t *p_len)
+{
+  char options[64];
+  const int n = snprintf(options, sizeof(options),
+                         "compiled v%d minimized\n", COMPILED_VERSION);
+  const size_t len = (size_t)n + strlen(rexpr);
+
+  char *key = malloc(len + 1);
+  if (NULL != key)
+  {
+    memcpy(key, options, (size_t)n);
+    memcpy(key + n, rexpr, strlen(rexpr) + 1);
+  }
+  *p_len = len;
+  return key;
+}
+
+// Map the compiled automaton of rexpr from the cache, or compile it and
+// store it there.
+bool compile_cached (DiskCache * const p_cache,
+                     const char *rexpr,
+                     Compiled * const p_compiled)
+{
+  DiskCacheEntry entry;
+  size_t key_len;
+  char *key = compiled_key(rexpr, &key_len);
+
+  memset(p_compiled, 0, sizeof(Compiled));
+  if (NULL == key)
+    return false;
+
+  if (disk_cache_get(p_cache, key, key_len, &entry))
+  {
+    if (compiled_view(entry.p_value, entry.value_size, &p_compiled->view))
+    {
+      p_compiled->p_base = entry.p_base;
+      p_compiled->size = entry.size;
+      p_compiled->mapped = true;
+      free(key);
+      return true;
+    }
+    disk_cache_release(&entry); // Stale format, compile it again.
+  }
+
+  const bool ok = compile(rexpr, p_compiled);
+  if (ok)
+    disk_cache_put(p_cache, key, key_len, p_compiled->p_base, p_compiled->size);
+
+  free(key);
+  return ok;
+}
@@ -0,0 +1,82 @@
+/*
+ *  Content-addressed on-disk cache.
+ *
+ *  Each entry is one file of the cache directory, named after a 64-bit hash
+ *  of its key.  The file holds the key, to detect hash collisions, followed
+ *  by the value starting on a COMPILED_ALIGN boundary, so that a mapped
+ *  compiled automaton can be used in place.  Entries are written to a
+ *  temporary file and renamed, readers never see a partial entry.
+ *
+ *  A hit refreshes the modification time of the entry.  Hit, miss, store and
+ *  eviction counters are kept in the 'stats' file of the directory, shared
+ *  by all the processes using it, with the bytes of the entries: a store
+ *  adds its size there, and only when the total exceeds the size limit is
+ *  the directory scanned, the least recently used entries removed until it
+ *  is down to 3/4 of the limit, and the total set to what is left.
+ */
+
+#pragma once
+
+#include "RE_compiled.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DISK_CACHE_DEFAULT_MAX_BYTES ((uint64_t)64 << 20)
+
+typedef struct
+{
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t stores;
+  uint64_t evictions;
+} DiskCacheStats;
+
+typedef struct
+{
+  char           * dir;
+  uint64_t         max_bytes;
+  DiskCacheStats   stats; // Counters of this process not yet saved.
+} DiskCache;
+
+// A value read from the cache: p_value points into the mapped entry.
+typedef struct
+{
+  void       * p_base;
+  size_t       size;
+  const void * p_value;
+  size_t       value_size;
+} DiskCacheEntry;
+
+bool disk_cache_open (DiskCache * const p_cache,
+                      const char *dir,
+                      uint64_t max_bytes);
+
+bool disk_cache_open_default (DiskCache * const p_cache);
+
+void disk_cache_close (DiskCache * const p_cache);
+
+bool disk_cache_get (DiskCache * const p_cache,
+                     const void *p_key,
+                     size_t key_len,
+                     DiskCacheEntry * const p_entry);
+
+void disk_cache_release (DiskCacheEntry * const p_entry);
+
+bool disk_cache_put (DiskCache * const p_cache,
+                     const void *p_key,
+                     size_t key_len,
+                     const void *p_value,
+                     size_t value_size);
+
+bool disk_cache_read_stats (const DiskCache * const p_cache,
+                            DiskCacheStats * const p_stats);
+
+uint64_t hash_bytes (const void *p_data, size_t len, uint64_t h);
+
+/**** Compiled automata. ****/
+
+bool compile_cached (DiskCache * const p_cache,
+                     const char *rexpr,
+                     Compiled * const p_compiled);
@@ -0,0 +1,400 @@
+/*
+ *  Compiled automaton images: building, saving, mapping and matching.
+ */
+
+#include "RE_compiled.h"
+#include "RE_trace.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t align_up (size_t n)
+{
+  return (n + COMPILED_ALIGN - 1) & ~(size_t)(COMPILED_ALIGN - 1);
+}
+
+// FNV-1a of the bytes after the header.
+static uint64_t checksum (const uint8_t *p_image, size_t size)
+{
+  uint64_t h = 14695981039346656037ull;
+
+  for (size_t i = sizeof(CompiledHeader); i < size; ++i)
+  {
+    h ^= p_image[i];
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+// Lay the tables out after the header and copy them in a new image.
+static bool build_image (const Dfa * const p_dfa,
+                         const Nfa * const p_nfa,
+                         Compiled * const p_compiled)
+{
+  CompiledHeader header;
+  const size_t n_trans = (size_t)p_dfa->n_states
+                         * (size_t)p_dfa->classes.n_classes;
+  size_t size = align_up(sizeof(CompiledHeader));
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, COMPILED_MAGIC, sizeof(COMPILED_MAGIC));
+  header.version = COMPILED_VERSION;
+  header.byte_order = COMPILED_BYTE_ORDER;
+  header.dfa_n_states = (uint32_t)p_dfa->n_states;
+  header.dfa_n_classes = (uint32_t)p_dfa->classes.n_classes;
+  header.dfa_start = (uint32_t)p_dfa->start;
+  header.nfa_n_states = (uint32_t)p_nfa->n_states;
+  header.nfa_n_sets = (uint32_t)p_nfa->n_sets;
+  header.nfa_start = (uint32_t)p_nfa->start;
+
+  header.dfa_class_offset = (uint32_t)size;
+  size = align_up(size + BYTE_VALUES);
+  header.dfa_trans_offset = (uint32_t)size;
+  size = align_up(size + n_trans * sizeof(int32_t));
+  header.dfa_accept_offset = (uint32_t)size;
+  size = align_up(size + (size_t)p_dfa->n_states * sizeof(int32_t));
+  header.nfa_states_offset = (uint32_t)size;
+  size = align_up(size + (size_t)p_nfa->n_states * sizeof(CompiledNfaState));
+  header.nfa_sets_offset = (uint32_t)size;
+  size = align_up(size + (size_t)p_nfa->n_sets * sizeof(ByteSet));
+
+  if (size > UINT32_MAX)
+    return false;
+  header.total_size = (uint32_t)size;
+
+  uint8_t *p_image = aligned_alloc(COMPILED_ALIGN, size);
+  if (NULL == p_image)
+    return false;
+
+  memset(p_image, 0, size);
+  memcpy(p_image, &header, sizeof(header));
+  memcpy(p_image + header.dfa_class_offset, p_dfa->classes.class_of,
+         BYTE_VALUES);
+
+  int32_t *p_trans = (int32_t *)(p_image + header.dfa_trans_offset);
+  for (size_t i = 0; i < n_trans; ++i)
+    p_trans[i] = p_dfa->trans[i];
+
+  int32_t *p_accept = (int32_t *)(p_image + header.dfa_accept_offset);
+  for (int i = 0; i < p_dfa->n_states; ++i)
+    p_accept[i] = p_dfa->accept[i];
+
+  CompiledNfaState *p_states =
+    (CompiledNfaState *)(p_image + header.nfa_states_offset);
+  for (int i = 0; i < p_nfa->n_states; ++i)
+  {
+    p_states[i].kind = p_nfa->states[i].kind;
+    p_states[i].out[0] = p_nfa->states[i].out[0];
+    p_states[i].out[1] = p_nfa->states[i].out[1];
+    p_states[i].set = p_nfa->states[i].set;
+    p_states[i].accept = p_nfa->states[i].accept;
+  }
+
+  memcpy(p_image + header.nfa_sets_offset, p_nfa->sets,
+         (size_t)p_nfa->n_sets * sizeof(ByteSet));
+
+  ((CompiledHeader *)p_image)->checksum = checksum(p_image, size);
+
+  // The tables are checked once here, not on every load.
+  p_compiled->p_base = p_image;
+  p_compiled->size = size;
+  p_compiled->mapped = false;
+  return compiled_view(p_image, size, &p_compiled->view)
+         && compiled_verify(&p_compiled->view);
+}
+
+bool compiled_from_nfa (const Nfa * const p_nfa, Compiled * const p_compiled)
+{
+  Dfa dfa;
+
+  memset(p_compiled, 0, sizeof(Compiled));
+  if (!dfa_build(&dfa, p_nfa))
+    return false;
+
+  bool ok = dfa_minimize(&dfa);
+  if (ok)
+  {
+    const uint64_t t = trace_begin();
+    ok = build_image(&dfa, p_nfa, p_compiled);
+    trace_end(TRACE_IMAGE, t);
+  }
+  dfa_free(&dfa);
+  return ok;
+}
+
+bool compile (const char *rexpr, Compiled * const p_compiled)
+{
+  Node * p_tree = node_new();
+  Nfa nfa;
+  bool ok = false;
+
+  memset(p_compiled, 0, sizeof(Compiled));
+  nfa_init(&nfa);
+  if (parse(rexpr, p_tree))
+    ok = nfa_from_tree(&nfa, p_tree) && compiled_from_nfa(&nfa, p_compiled);
+
+  nfa_free(&nfa);
+  node_free(p_tree);
+  return ok;
+}
+
+bool compiled_save (const Compiled * const p_compiled, const char *path)
+{
+  FILE *fp = fopen(path, "wb");
+  if (NULL == fp)
+    return false;
+
+  const bool ok = 1 == fwrite(p_compiled->p_base, p_compiled->size, 1, fp);
+  return (0 == fclose(fp)) && ok;
+}
+
+bool compiled_load (const char *path, Compiled * const p_compiled)
+{
+  struct stat st;
+
+  memset(p_compiled, 0, sizeof(Compiled));
+
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  if (0 != fstat(fd, &st) || st.st_size <= 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  void *p_base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (MAP_FAILED == p_base)
+    return false;
+
+  p_compiled->p_base = p_base;
+  p_compiled->size = (size_t)st.st_size;
+  p_compiled->mapped = true;
+
+  if (!compiled_view(p_base, (size_t)st.st_size, &p_compiled->view))
+  {
+    compiled_free(p_compiled);
+    return false;
+  }
+
+  return true;
+}
+
+void compiled_free (Compiled * const p_compiled)
+{
+  if (NULL != p_compiled->p_base)
+  {
+    if (p_compiled->mapped)
+      munmap(p_compiled->p_base, p_compiled->size);
+    else
+      free(p_compiled->p_base);
+  }
+  memset(p_compiled, 0, sizeof(Compiled));
+}
+
+static bool table_fits (uint32_t offset, size_t len, size_t size)
+{
+  return 0 == offset % COMPILED_ALIGN && offset <= size && len <= size - offset;
+}
+
+// The checksum matches, and every state, class and set index read by the
+// matchers is in range, so that they need no checks of their own.
+bool compiled_verify (const CompiledView * const p_view)
+{
+  const CompiledHeader * const p_header = p_view->p_header;
+  const size_t n_trans = (size_t)p_header->dfa_n_states
+                         * (size_t)p_header->dfa_n_classes;
+  const int64_t n_nfa_states = p_header->nfa_n_states;
+
+  if (checksum((const uint8_t *)p_header, p_header->total_size)
+      != p_header->checksum)
+    return false;
+
+  for (size_t b = 0; b < BYTE_VALUES; ++b)
+    if (p_view->class_of[b] >= p_header->dfa_n_classes)
+      return false;
+
+  for (size_t i = 0; i < n_trans; ++i)
+    if (p_view->trans[i] < 0
+        || (uint32_t)p_view->trans[i] >= p_header->dfa_n_states)
+      return false;
+
+  for (uint32_t i = 0; i < p_header->nfa_n_states; ++i)
+  {
+    const CompiledNfaState * const p_s = &p_view->nfa_states[i];
+    if (NFA_SET == p_s->kind)
+    {
+      if (p_s->set < 0 || (uint32_t)p_s->set >= p_header->nfa_n_sets
+          || p_s->out[0] < 0 || p_s->out[0] >= n_nfa_states)
+        return false;
+    }
+    else if ((NFA_EPSILON != p_s->kind && NFA_TAG != p_s->kind)
+             || p_s->out[0] >= n_nfa_states || p_s->out[1] >= n_nfa_states)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Check the header of an image and point p_view to its tables, in constant
+// time: the tables are checked by compiled_verify.
+bool compiled_view (const void *p_image, size_t size, CompiledView * const p_view)
+{
+  const CompiledHeader * const p_header = p_image;
+  const uint8_t * const p_base = p_image;
+
+  if (0 != (uintptr_t)p_image % COMPILED_ALIGN
+      || size < sizeof(CompiledHeader)
+      || 0 != memcmp(p_header->magic, COMPILED_MAGIC, sizeof(COMPILED_MAGIC))
+      || COMPILED_VERSION != p_header->version
+      || COMPILED_BYTE_ORDER != p_header->byte_order
+      || p_header->total_size != size
+      || 0 == p_header->dfa_n_states
+      || INT32_MAX < p_header->dfa_n_states
+      || p_header->dfa_start >= p_header->dfa_n_states
+      || INT32_MAX < p_header->nfa_n_states
+      || p_header->nfa_start >= p_header->nfa_n_states)
+    return false;
+
+  const size_t n_trans = (size_t)p_header->dfa_n_states
+                         * (size_t)p_header->dfa_n_classes;
+  if (!table_fits(p_header->dfa_class_offset, BYTE_VALUES, size)
+      || !table_fits(p_header->dfa_trans_offset, n_trans * sizeof(int32_t), size)
+      || !table_fits(p_header->dfa_accept_offset,
+                     (size_t)p_header->dfa_n_states * sizeof(int32_t), size)
+      || !table_fits(p_header->nfa_states_offset,
+                     (size_t)p_header->nfa_n_states * sizeof(CompiledNfaState),
+                     size)
+      || !table_fits(p_header->nfa_sets_offset,
+                     (size_t)p_header->nfa_n_sets * sizeof(ByteSet), size))
+    return false;
+
+  p_view->p_header = p_header;
+  p_view->class_of = p_base + p_header->dfa_class_offset;
+  p_view->trans = (const int32_t *)(p_base + p_header->dfa_trans_offset);
+  p_view->accept = (const int32_t *)(p_base + p_header->dfa_accept_offset);
+  p_view->nfa_states =
+    (const CompiledNfaState *)(p_base + p_header->nfa_states_offset);
+  p_view->nfa_sets = (const uint32_t *)(p_base + p_header->nfa_sets_offset);
+  return true;
+}
+
+bool compiled_match (const CompiledView * const p_view, const char *s, size_t len)
+{
+  const size_t n_classes = p_view->p_header->dfa_n_classes;
+  int32_t state = (int32_t)p_view->p_header->dfa_start;
+
+  for (size_t i = 0; i < len; ++i)
+    state = p_view->trans[(size_t)state * n_classes
+                          + p_view->class_of[(unsigned char)s[i]]];
+
+  return NFA_NO_ACCEPT != p_view->accept[state];
+}
+
+/**** NFA simulation. ****/
+
+// The scratch space holds the current and next state lists, the stack of the
+// epsilon closures and the step at which each state was last added.
+size_t compiled_nfa_scratch_size (const CompiledView * const p_view)
+{
+  return 4 * (size_t)p_view->p_header->nfa_n_states * sizeof(int32_t);
+}
+
+// Add state s and its epsilon closure to p_list, unless already there.
+static int add_state (const CompiledView * const p_view,
+                      int32_t s,
+                      int32_t *p_list,
+                      int n,
+                      int32_t *p_stack,
+                      int32_t *p_on_list,
+                      int32_t step)
+{
+  int top = 0;
+
+  if (p_on_list[s] == step)
+    return n;
+
+  p_on_list[s] = step;
+  p_stack[top++] = s;
+
+  while (top > 0)
+  {
+    const CompiledNfaState * const p_s = &p_view->nfa_states[p_stack[--top]];
+    p_list[n++] = p_stack[top];
+
+    if (NFA_SET != p_s->kind)
+    {
+      // Push out[1] first so that out[0] is explored first.
+      for (int k = 1; k >= 0; --k)
+      {
+        const int32_t t = p_s->out[k];
+        if (t >= 0 && p_on_list[t] != step)
+        {
+          p_on_list[t] = step;
+          p_stack[top++] = t;
+        }
+      }
+    }
+  }
+
+  return n;
+}
+
+bool compiled_nfa_match (const CompiledView * const p_view,
+                         const char *s,
+                         size_t len,
+                         void *p_scratch)
+{
+  const size_t n_states = p_view->p_header->nfa_n_states;
+  int32_t *p_current = p_scratch;
+  int32_t *p_next = p_current + n_states;
+  int32_t *p_stack = p_next + n_states;
+  int32_t *p_on_list = p_stack + n_states;
+  int32_t step = 1;
+  int n_current;
+
+  for (size_t i = 0; i < n_states; ++i)
+    p_on_list[i] = 0;
+
+  n_current = add_state(p_view, (int32_t)p_view->p_header->nfa_start,
+                        p_current, 0, p_stack, p_on_list, step);
+
+  for (size_t i = 0; i < len && n_current > 0; ++i)
+  {
+    const unsigned char c = (unsigned char)s[i];
+    int n_next = 0;
+
+    ++step;
+    for (int k = 0; k < n_current; ++k)
+    {
+      const CompiledNfaState * const p_s = &p_view->nfa_states[p_current[k]];
+      if (NFA_SET != p_s->kind)
+        continue;
+
+      const uint32_t *p_set = &p_view->nfa_sets[(size_t)p_s->set * 8];
+      if (0 != (p_set[c >> 5] & ((uint32_t)1 << (c & 31))))
+        n_next = add_state(p_view, p_s->out[0], p_next, n_next,
+                           p_stack, p_on_list, step);
+    }
+
+    int32_t *p_tmp = p_current;
+    p_current = p_next;
+    p_next = p_tmp;
+    n_current = n_next;
+  }
+
+  for (int k = 0; k < n_current; ++k)
+    if (NFA_NO_ACCEPT != p_view->nfa_states[p_current[k]].accept)
+      return true;
+
+  return false;
+}
@@ -0,0 +1,109 @@
+/*
+ *  Compiled automaton image, in a versioned and position-independent binary
+ *  format that can be written to a file and mapped back in memory.
+ *
+ *  The image starts with a CompiledHeader and is followed by tables only.
+ *  Tables are referenced by their byte offset from the start of the image,
+ *  never by pointer, and every table starts on a COMPILED_ALIGN boundary:
+ *
+ *  DFA class map    uint8_t [256]                  byte -> byte class.
+ *  DFA transitions  int32_t [n_states * n_classes] next state.
+ *  DFA accept       int32_t [n_states]             rule, or -1.
+ *  NFA states       CompiledNfaState [n_states].
+ *  NFA byte sets    uint32_t [n_sets * 8]          256-bit sets.
+ *
+ *  Loading an image maps the file and checks the header, the offsets and the
+ *  sizes of the tables: there is no parsing and no allocation, matching
+ *  reads the mapped tables directly.  The tables are checked when the image
+ *  is built, that every state, class and set index is in range, and their
+ *  checksum is stored in the header: compiled_verify checks both again, for
+ *  images that are not trusted.  Images are
+ *  stored in the byte order of the machine that compiled them, and images of
+ *  another byte order or version are rejected.
+ */
+
+#pragma once
+
+#include "RE_automaton.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define COMPILED_MAGIC      "REAUTOM"
+#define COMPILED_VERSION    2
+#define COMPILED_BYTE_ORDER 0x01020304u
+#define COMPILED_ALIGN      64
+
+typedef struct
+{
+  char     magic [8];         // COMPILED_MAGIC, NUL terminated.
+  uint32_t version;
+  uint32_t byte_order;        // COMPILED_BYTE_ORDER as written.
+  uint32_t total_size;        // Size of the whole image in bytes.
+  uint32_t dfa_n_states;
+  uint32_t dfa_n_classes;
+  uint32_t dfa_start;
+  uint32_t dfa_class_offset;
+  uint32_t dfa_trans_offset;
+  uint32_t dfa_accept_offset;
+  uint32_t nfa_n_states;
+  uint32_t nfa_n_sets;
+  uint32_t nfa_start;
+  uint32_t nfa_states_offset;
+  uint32_t nfa_sets_offset;
+  uint32_t padding;
+  uint64_t checksum;          // Of the bytes after the header.
+} CompiledHeader;
+
+typedef struct
+{
+  int32_t kind;   // NfaKind.
+  int32_t out [2];
+  int32_t set;
+  int32_t accept;
+} CompiledNfaState;
+
+// Pointers to the tables of an image, computed when it is loaded.
+typedef struct
+{
+  const CompiledHeader   * p_header;
+  const uint8_t          * class_of;
+  const int32_t          * trans;
+  const int32_t          * accept;
+  const CompiledNfaState * nfa_states;
+  const uint32_t         * nfa_sets;
+} CompiledView;
+
+typedef struct
+{
+  void         * p_base; // Start of the image.
+  size_t         size;
+  bool           mapped; // The image is a mapped file, not a malloc'd buffer.
+  CompiledView   view;
+} Compiled;
+
+bool compiled_from_nfa (const Nfa * const p_nfa, Compiled * const p_compiled);
+
+bool compile (const char *rexpr, Compiled * const p_compiled);
+
+bool compiled_save (const Compiled * const p_compiled, const char *path);
+
+bool compiled_load (const char *path, Compiled * const p_compiled);
+
+void compiled_free (Compiled * const p_compiled);
+
+bool compiled_view (const void *p_image, size_t size, CompiledView * const p_view);
+
+// Check the checksum and the indices of the tables of an image, which reads
+// all of it.
+bool compiled_verify (const CompiledView * const p_view);
+
+bool compiled_match (const CompiledView * const p_view, const char *s, size_t len);
+
+size_t compiled_nfa_scratch_size (const CompiledView * const p_view);
+
+bool compiled_nfa_match (const CompiledView * const p_view,
+                         const char *s,
+                         size_t len,
+                         void *p_scratch);
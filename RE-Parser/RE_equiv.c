@@ -0,0 +1,204 @@
+/*
+ *  Equivalence and containment of regular expressions, on the product of two
+ *  lazily determinized automata (Hopcroft-Karp).
+ */
+
+#include "RE_equiv.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// A pair of states of the product, with the way it was reached.
+typedef struct
+{
+  int           state1;
+  int           state2;
+  int           parent; // Index of the previous pair, -1 for the start.
+  unsigned char byte;   // Byte read from the previous pair.
+} Pair;
+
+// Union-find over the states of both DFAs: state s of the first DFA is
+// element 2s, state s of the second one is element 2s + 1.
+typedef struct
+{
+  int *parent;
+  int  cap;
+} UnionFind;
+
+static bool uf_reserve (UnionFind * const p_uf, int element)
+{
+  if (element < p_uf->cap)
+    return true;
+
+  int cap = (p_uf->cap > 0) ? p_uf->cap : 64;
+  while (cap <= element)
+    cap *= 2;
+
+  int *p_parent = realloc(p_uf->parent, (size_t)cap * sizeof(int));
+  if (NULL == p_parent)
+    return false;
+
+  for (int i = p_uf->cap; i < cap; ++i)
+    p_parent[i] = i;
+
+  p_uf->parent = p_parent;
+  p_uf->cap = cap;
+  return true;
+}
+
+static int uf_find (UnionFind * const p_uf, int element)
+{
+  while (p_uf->parent[element] != element)
+  {
+    p_uf->parent[element] = p_uf->parent[p_uf->parent[element]];
+    element = p_uf->parent[element];
+  }
+  return element;
+}
+
+static char * counterexample (const Pair *p_pairs, int last)
+{
+  int len = 0;
+  for (int i = last; p_pairs[i].parent >= 0; i = p_pairs[i].parent)
+    ++len;
+
+  char *s = malloc((size_t)len + 1);
+  if (NULL == s)
+    return NULL;
+
+  s[len] = '\0';
+  for (int i = last; p_pairs[i].parent >= 0; i = p_pairs[i].parent)
+    s[--len] = (char)p_pairs[i].byte;
+
+  return s;
+}
+
+static bool accepts (const LazyDfa * const p_dfa, int state)
+{
+  return NFA_NO_ACCEPT != p_dfa->accept[state];
+}
+
+EquivStatus equiv (const Nfa * const p_nfa1,
+                   const Nfa * const p_nfa2,
+                   char ** pp_counterexample)
+{
+  const Nfa * nfas[2] = { p_nfa1, p_nfa2 };
+  ByteClasses classes;
+  LazyDfa dfa1, dfa2;
+  UnionFind uf = { NULL, 0 };
+  Pair *p_pairs = NULL;
+  int n_pairs = 0;
+  int cap_pairs = 0;
+  int failed = -1;    // Pair where the DFAs disagree.
+  bool oom = false;
+
+  if (NULL != pp_counterexample)
+    *pp_counterexample = NULL;
+
+  // Both DFAs must read the same byte classes to be walked in lockstep.
+  byte_classes_compute(nfas, 2, &classes);
+  if (!lazy_dfa_init(&dfa1, p_nfa1, &classes))
+    return EQUIV_OUT_OF_MEMORY;
+  if (!lazy_dfa_init(&dfa2, p_nfa2, &classes))
+  {
+    lazy_dfa_free(&dfa1);
+    return EQUIV_OUT_OF_MEMORY;
+  }
+
+  const int start1 = lazy_dfa_start(&dfa1);
+  const int start2 = lazy_dfa_start(&dfa2);
+  oom = DFA_UNKNOWN == start1 || DFA_UNKNOWN == start2
+        || !uf_reserve(&uf, 2 * start1) || !uf_reserve(&uf, 2 * start2 + 1);
+
+  if (!oom)
+  {
+    cap_pairs = 64;
+    p_pairs = malloc((size_t)cap_pairs * sizeof(Pair));
+    oom = NULL == p_pairs;
+  }
+
+  if (!oom)
+  {
+    p_pairs[n_pairs++] = (Pair) { start1, start2, -1, 0 };
+    uf.parent[2 * start1] = 2 * start2 + 1;
+    if (accepts(&dfa1, start1) != accepts(&dfa2, start2))
+      failed = 0;
+  }
+
+  // Breadth-first, so that the counterexample is short.
+  for (int head = 0; !oom && failed < 0 && head < n_pairs; ++head)
+  {
+    for (int c = 0; c < classes.n_classes; ++c)
+    {
+      const int next1 = lazy_dfa_next(&dfa1, p_pairs[head].state1, c);
+      const int next2 = lazy_dfa_next(&dfa2, p_pairs[head].state2, c);
+      if (DFA_UNKNOWN == next1 || DFA_UNKNOWN == next2
+          || !uf_reserve(&uf, 2 * next1) || !uf_reserve(&uf, 2 * next2 + 1))
+      {
+        oom = true;
+        break;
+      }
+
+      const int root1 = uf_find(&uf, 2 * next1);
+      const int root2 = uf_find(&uf, 2 * next2 + 1);
+      if (root1 == root2)
+        continue;
+
+      uf.parent[root1] = root2;
+
+      if (n_pairs == cap_pairs)
+      {
+        Pair *p_new = realloc(p_pairs, 2 * (size_t)cap_pairs * sizeof(Pair));
+        if (NULL == p_new)
+        {
+          oom = true;
+          break;
+        }
+        p_pairs = p_new;
+        cap_pairs *= 2;
+      }
+
+      p_pairs[n_pairs++] = (Pair) { next1, next2, head, classes.rep[c] };
+
+      if (accepts(&dfa1, next1) != accepts(&dfa2, next2))
+      {
+        failed = n_pairs - 1;
+        break;
+      }
+    }
+  }
+
+  if (failed >= 0 && NULL != pp_counterexample)
+    *pp_counterexample = counterexample(p_pairs, failed);
+
+  free(p_pairs);
+  free(uf.parent);
+  lazy_dfa_free(&dfa1);
+  lazy_dfa_free(&dfa2);
+
+  if (oom)
+    return EQUIV_OUT_OF_MEMORY;
+  return (failed < 0) ? EQUIV_HOLDS : EQUIV_DIFFERS;
+}
+
+// L1 is a subset of L2 iff L1 + L2 = L2, and a string accepted by only one
+// of them is then accepted by L1 and not by L2.
+EquivStatus subset (const Nfa * const p_nfa1,
+                    const Nfa * const p_nfa2,
+                    char ** pp_counterexample)
+{
+  Nfa both;
+
+  if (NULL != pp_counterexample)
+    *pp_counterexample = NULL;
+
+  if (!nfa_union(&both, p_nfa1, p_nfa2))
+  {
+    nfa_free(&both);
+    return EQUIV_OUT_OF_MEMORY;
+  }
+
+  const EquivStatus result = equiv(&both, p_nfa2, pp_counterexample);
+  nfa_free(&both);
+  return result;
+}
@@ -0,0 +1,38 @@
+/*
+ *  Equivalence and containment of regular expressions.
+ *
+ *  Both automata are determinized lazily while their product is explored
+ *  breadth-first, and the states found equivalent so far are merged with a
+ *  union-find (Hopcroft-Karp).  The search stops at the first pair of states
+ *  that disagree on acceptance: the path leading to it is a string in the
+ *  symmetric difference of the two languages.  It is short, but not always
+ *  the shortest: a pair merged through the union-find is never explored, and
+ *  a shorter difference may lie behind it.
+ */
+
+#pragma once
+
+#include "RE_automaton.h"
+
+#include <stdbool.h>
+
+typedef enum
+{
+  EQUIV_HOLDS,
+  EQUIV_DIFFERS,
+  EQUIV_OUT_OF_MEMORY
+} EquivStatus;
+
+// EQUIV_HOLDS when both NFAs accept the same language.  On EQUIV_DIFFERS,
+// when pp_counterexample is not NULL, *pp_counterexample is set to a
+// malloc'd string accepted by exactly one of them, or to NULL when out of
+// memory for it.
+EquivStatus equiv (const Nfa * const p_nfa1,
+                   const Nfa * const p_nfa2,
+                   char ** pp_counterexample);
+
+// EQUIV_HOLDS when every string accepted by p_nfa1 is accepted by p_nfa2.
+// Otherwise the counterexample is accepted by p_nfa1 only.
+EquivStatus subset (const Nfa * const p_nfa1,
+                    const Nfa * const p_nfa2,
+                    char ** pp_counterexample);
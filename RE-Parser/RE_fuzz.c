@@ -0,0 +1,165 @@
+/*
+ *  Fuzzing harness of the parser, for libFuzzer and AFL.
+ *
+ *  Each input is an expression: it is parsed and, when it is valid, compiled
+ *  and matched against its own bytes.  The cost of the parse is its node
+ *  allocations (see AllocProfile), which measures the backtracking whatever
+ *  the machine.  An input that costs more than $RE_FUZZ_MAX_ALLOCS
+ *  allocations aborts, so that the fuzzer saves it as a crash, to be
+ *  minimized and added to the corpus replayed by RE_bench.  A parse makes at
+ *  least one allocation per step and per node live at once, so a budget of
+ *  as many steps and nodes stops an exponential parse early, instead of
+ *  letting it run for minutes and be reported as a timeout.
+ *
+ *  Built with -DRE_LIBFUZZER, libFuzzer's main drives LLVMFuzzerTestOneInput.
+ *  Otherwise main runs it on each file given, or on the standard input, as
+ *  AFL does.
+ *
+ *  Usage: RE_fuzz [file]...
+ */
+
+#include "RE_parser.h"
+#include "RE_automaton.h"
+#include "RE_compiled.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_MAX_ALLOCS 1000000
+
+static uint64_t max_allocs (void)
+{
+  static uint64_t max = 0;
+
+  if (0 == max)
+  {
+    const char * const value = getenv("RE_FUZZ_MAX_ALLOCS");
+    max = (NULL != value) ? strtoull(value, NULL, 10) : 0;
+    if (0 == max)
+      max = DEFAULT_MAX_ALLOCS;
+  }
+
+  return max;
+}
+
+static void compile_and_match (const Node * const p_tree,
+                               const char *s,
+                               size_t len)
+{
+  Nfa nfa;
+  Compiled compiled;
+
+  if (nfa_from_tree(&nfa, p_tree) && compiled_from_nfa(&nfa, &compiled))
+  {
+    compiled_match(&compiled.view, s, len);
+    compiled_free(&compiled);
+  }
+  nfa_free(&nfa);
+}
+
+int LLVMFuzzerTestOneInput (const uint8_t *data, size_t size)
+{
+  static Parser *p_parser = NULL;
+  char * const rexpr = malloc(size + 1);
+  Node * const p_tree = node_new();
+  AllocProfile profile;
+
+  if (NULL == p_parser)
+  {
+    const ParseBudget budget = { max_allocs(), max_allocs(), 0 };
+    p_parser = parser_new();
+    if (NULL != p_parser)
+      parser_set_budget(p_parser, &budget);
+  }
+  if (NULL == p_parser || NULL == rexpr || NULL == p_tree)
+  {
+    free(rexpr);
+    node_free(p_tree);
+    return 0;
+  }
+
+  memcpy(rexpr, data, size);
+  rexpr[size] = '\0';
+
+  const ParseStatus status = parser_parse(p_parser, rexpr, p_tree, NULL);
+  parser_profile(p_parser, &profile);
+  if (PARSE_STEPS_EXCEEDED == status || PARSE_NODES_EXCEEDED == status
+      || profile.n_allocs > max_allocs())
+  {
+    fprintf(stderr, "Superlinear input of %zu bytes: %" PRIu64
+            " allocations\n", size, profile.n_allocs);
+    abort();
+  }
+
+  if (PARSE_OK == status)
+    compile_and_match(p_tree, rexpr, size);
+
+  node_free(p_tree);
+  free(rexpr);
+  return 0;
+}
+
+#ifndef RE_LIBFUZZER
+
+static bool run_file (FILE *fp)
+{
+  size_t size = 0;
+  size_t cap = 4096;
+  uint8_t *data = malloc(cap);
+
+  while (NULL != data)
+  {
+    size += fread(data + size, 1, cap - size, fp);
+    if (size < cap)
+      break;
+
+    uint8_t * const p_grown = realloc(data, 2 * cap);
+    if (NULL == p_grown)
+    {
+      free(data);
+      data = NULL;
+    }
+    else
+    {
+      data = p_grown;
+      cap *= 2;
+    }
+  }
+
+  if (NULL == data || ferror(fp))
+  {
+    free(data);
+    return false;
+  }
+
+  LLVMFuzzerTestOneInput(data, size);
+  free(data);
+  return true;
+}
+
+int main (int argc, char **argv)
+{
+  if (argc < 2)
+    return run_file(stdin) ? 0 : 1;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    FILE *fp = fopen(argv[i], "rb");
+    const bool ok = NULL != fp && run_file(fp);
+
+    if (NULL != fp)
+      fclose(fp);
+    if (!ok)
+    {
+      printf("Cannot read '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+#endif
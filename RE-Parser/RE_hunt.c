@@ -0,0 +1,292 @@
+/*
+ *  Search for short expressions that parse() takes a superlinear time on.
+ *
+ *  The cost of an input is the node allocations of its parse (see
+ *  AllocProfile): it grows with the backtracking and, unlike a time, is the
+ *  same on every run and machine.  The search keeps the costliest input found
+ *  for each length up to max_len, and mutates them: a byte inserted, deleted
+ *  or replaced, a substring duplicated or grouped.  A mutant replaces the
+ *  input of its length when it costs more.  Inputs need not be valid, the
+ *  backtracking on a syntax error counts too.
+ *
+ *  At the end, the table of the costliest input per length is printed as CSV,
+ *  with the ratio of its cost to the one of the previous length: a ratio that
+ *  stays above 1 as the length grows is an exponential cost.  The costliest
+ *  inputs are then minimized, by removing bytes as long as the cost does not
+ *  drop, and saved in the corpus directory, one expression per file, for
+ *  RE_bench to replay.
+ *
+ *  Usage: RE_hunt [iterations] [max_len] [corpus dir]
+ */
+
+#include "RE_parser.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_ITERATIONS 5000
+#define DEFAULT_MAX_LEN    16
+#define MAX_LEN            40 // Inputs of more bytes can take hours to parse.
+#define N_SAVED            4  // Costliest inputs saved in the corpus.
+
+static const char alphabet [] = "ab#()*+";
+
+typedef struct
+{
+  char     text [MAX_LEN + 1];
+  uint64_t cost;               // 0 until an input of this length is found.
+} Elite;
+
+static Parser *p_parser;
+
+static uint64_t cost_of (const char *rexpr)
+{
+  Node * const p_tree = node_new();
+  AllocProfile profile;
+
+  if (NULL == p_tree)
+    return 0;
+
+  parser_parse(p_parser, rexpr, p_tree, NULL);
+  parser_profile(p_parser, &profile);
+  node_free(p_tree);
+  return profile.n_allocs;
+}
+
+/**** Mutations. ****/
+
+static uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t random_below (uint32_t n)
+{
+  // xorshift64*.
+  seed ^= seed >> 12;
+  seed ^= seed << 25;
+  seed ^= seed >> 27;
+  return (uint32_t)((seed * 2685821657736338717ULL) >> 32) % n;
+}
+
+static char random_byte (void)
+{
+  return alphabet[random_below(sizeof(alphabet) - 1)];
+}
+
+// Apply one to three mutations to text, of at most max_len bytes.
+static void mutate (char *text, size_t max_len)
+{
+  const int n_mutations = 1 + (int)random_below(3);
+  size_t len = strlen(text);
+
+  for (int m = 0; m < n_mutations; ++m)
+  {
+    const size_t i = random_below((uint32_t)len + 1);
+    const size_t j = i + random_below((uint32_t)(len - i) + 1);
+
+    switch (random_below(5))
+    {
+      case 0: // Insert a byte at i.
+        if (len < max_len)
+        {
+          memmove(&text[i + 1], &text[i], len - i + 1);
+          text[i] = random_byte();
+          ++len;
+        }
+        break;
+      case 1: // Delete the byte at i.
+        if (i < len)
+        {
+          memmove(&text[i], &text[i + 1], len - i);
+          --len;
+        }
+        break;
+      case 2: // Replace the byte at i.
+        if (i < len)
+          text[i] = random_byte();
+        break;
+      case 3: // Duplicate [i, j).
+        if (len + (j - i) <= max_len)
+        {
+          memmove(&text[j + (j - i)], &text[j], len - j + 1);
+          memcpy(&text[j], &text[i], j - i);
+          len += j - i;
+        }
+        break;
+      default: // Group [i, j).
+        if (len + 2 <= max_len)
+        {
+          memmove(&text[j + 2], &text[j], len - j + 1);
+          text[j + 1] = ')';
+          memmove(&text[i + 1], &text[i], j - i);
+          text[i] = '(';
+          len += 2;
+        }
+        break;
+    }
+  }
+}
+
+static void hunt (Elite * const elites, size_t max_len, long n_iterations)
+{
+  static const char * const seeds [] = { "a", "a*", "a+b", "(a)", "ab" };
+
+  for (size_t s = 0; s < sizeof(seeds) / sizeof(seeds[0]); ++s)
+  {
+    if (strlen(seeds[s]) > max_len)
+      continue;
+
+    Elite * const p_elite = &elites[strlen(seeds[s])];
+    strcpy(p_elite->text, seeds[s]);
+    p_elite->cost = cost_of(seeds[s]);
+  }
+
+  for (long it = 0; it < n_iterations; ++it)
+  {
+    // A random parent among the lengths found.
+    size_t len = 1 + random_below((uint32_t)max_len);
+    while (0 == elites[len].cost)
+      len = (len % max_len) + 1;
+
+    char text[MAX_LEN + 1];
+    strcpy(text, elites[len].text);
+    mutate(text, max_len);
+
+    const size_t new_len = strlen(text);
+    if (0 == new_len)
+      continue;
+
+    const uint64_t cost = cost_of(text);
+    if (cost > elites[new_len].cost)
+    {
+      strcpy(elites[new_len].text, text);
+      elites[new_len].cost = cost;
+    }
+  }
+}
+
+/**** Corpus. ****/
+
+// Remove bytes from the input as long as the cost does not drop.
+static void minimize (Elite * const p_elite)
+{
+  bool removed = true;
+
+  while (removed)
+  {
+    removed = false;
+    for (size_t i = 0; '\0' != p_elite->text[i]; )
+    {
+      char text[MAX_LEN + 1];
+      memcpy(text, p_elite->text, i);
+      strcpy(&text[i], &p_elite->text[i + 1]);
+
+      const uint64_t cost = ('\0' != text[0]) ? cost_of(text) : 0;
+      if (cost >= p_elite->cost)
+      {
+        strcpy(p_elite->text, text);
+        p_elite->cost = cost;
+        removed = true;
+      }
+      else
+      {
+        ++i;
+      }
+    }
+  }
+}
+
+static bool save (const char *dir, const Elite * const p_elite)
+{
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/hunt-%zu-%" PRIu64 ".re", dir,
+           strlen(p_elite->text), p_elite->cost);
+
+  FILE *fp = fopen(path, "w");
+  if (NULL == fp)
+    return false;
+
+  fputs(p_elite->text, fp);
+  const bool ok = 0 == fclose(fp);
+  if (ok)
+    printf("saved %s\n", path);
+  return ok;
+}
+
+static int compare_costs (const void *p_a, const void *p_b)
+{
+  const uint64_t a = ((const Elite *)p_a)->cost;
+  const uint64_t b = ((const Elite *)p_b)->cost;
+  return (a < b) - (a > b);
+}
+
+int main (int argc, char **argv)
+{
+  // Input checks.
+  if (argc > 4)
+  {
+    printf("Wrong number of command-line arguments: ");
+    printf("%d arguments found, at most %d expected\n", argc - 1, 3);
+    printf("Usage: RE_hunt [iterations] [max_len] [corpus dir]\n");
+    return 1;
+  }
+
+  const long n_iterations = (argc > 1) ? atol(argv[1]) : DEFAULT_ITERATIONS;
+  const int max_len = (argc > 2) ? atoi(argv[2]) : DEFAULT_MAX_LEN;
+  const char * const dir = (argc > 3) ? argv[3] : NULL;
+  if (n_iterations <= 0 || max_len < 2 || max_len > MAX_LEN)
+  {
+    printf("The iterations must be positive, and max_len in [2, %d]\n",
+           MAX_LEN);
+    return 1;
+  }
+
+  p_parser = parser_new();
+  if (NULL == p_parser)
+  {
+    printf("Out of memory\n");
+    return 1;
+  }
+
+  Elite elites[MAX_LEN + 1];
+  memset(elites, 0, sizeof(elites));
+  hunt(elites, (size_t)max_len, n_iterations);
+
+  printf("length,allocs,ratio,expression\n");
+  for (int len = 1; len <= max_len; ++len)
+  {
+    if (0 == elites[len].cost)
+      continue;
+
+    const uint64_t previous = elites[len - 1].cost;
+    printf("%d,%" PRIu64 ",%.2f,%s\n", len, elites[len].cost,
+            (0 != previous) ? (double)elites[len].cost / (double)previous : 0.0,
+            elites[len].text);
+  }
+
+  int status = 0;
+  if (NULL != dir)
+  {
+    qsort(elites, MAX_LEN + 1, sizeof(Elite), compare_costs);
+    for (int e = 0; e < N_SAVED && 0 != elites[e].cost; ++e)
+    {
+      minimize(&elites[e]);
+
+      bool seen = false;
+      for (int f = 0; f < e; ++f)
+        seen |= 0 == strcmp(elites[f].text, elites[e].text);
+
+      if (!seen && !save(dir, &elites[e]))
+      {
+        printf("Cannot save in '%s'\n", dir);
+        status = 1;
+        break;
+      }
+    }
+  }
+
+  parser_free(p_parser);
+  return status;
+}
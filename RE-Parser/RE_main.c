@@ -0,0 +1,570 @@
+/*
+ *  Command-line front end of the regular expression parser.
+ *
+ *  Usage:
+ *  RE_parser <regex>                  Print and save the parse tree.
+ *  RE_parser equiv <regex> <regex>    Check that two expressions are equivalent.
+ *  RE_parser subset <regex> <regex>   Check that the first language is
+ *                                     included in the second one.
+ *  RE_parser compile -o <file> <regex>
+ *                                     Save the compiled automaton in a file.
+ *  RE_parser load [-v] <file> <string>...
+ *                                     Map a compiled automaton and match
+ *                                     the strings with it.  -v checks its
+ *                                     tables first, for untrusted files.
+ *  RE_parser match <regex> <string>...
+ *                                     Match the strings, through the regex
+ *                                     and compile caches (see
+ *                                     RE_regex_cache.h and RE_cache.h).
+ *  RE_parser cache-stats              Print the compile cache counters.
+ *  RE_parser submatch <regex> <string>
+ *                                     Print the span of each group ( RE ).
+ *  RE_parser edit <regex> <offset> <delete_len> <text>
+ *                                     Replace delete_len bytes at offset by
+ *                                     the text and update the
+ *                                     parse tree incrementally.
+ *  RE_parser batch [-j N] [-steps N] [-nodes N] [-ms N] <file>
+ *                                     Compile the expression of each line
+ *                                     on N threads, and match it with the
+ *                                     tab-separated strings that follow.
+ *                                     Each parse has a budget of steps,
+ *                                     nodes and milliseconds (0 for none).
+ *                                     Repeated expressions are compiled
+ *                                     once, through the regex cache.
+ *  RE_parser --stats <command>        Run the command, then print the parser
+ *                                     and regex cache counters (built with
+ *                                     'make stats').
+ *  RE_parser --trace <file> <command> Run the command, then write the trace
+ *                                     of its phases (see RE_trace.h).
+ */
+
+#include "RE_parser.h"
+#include "RE_automaton.h"
+#include "RE_batch.h"
+#include "RE_cache.h"
+#include "RE_compiled.h"
+#include "RE_equiv.h"
+#include "RE_regex_cache.h"
+#include "RE_submatch.h"
+#include "RE_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REGEX_CACHE_BYTES ((size_t)64 << 20)
+
+// Parser counters of the threads a command started, for --stats.
+static ParseStats worker_stats;
+
+// Compiled expressions of the commands, shared by their threads.
+static RegexCache *p_regex_cache;
+
+static void print_usage (void)
+{
+  printf("Usage: RE_parser <regex>\n");
+  printf("       RE_parser equiv <regex> <regex>\n");
+  printf("       RE_parser subset <regex> <regex>\n");
+  printf("       RE_parser compile -o <file> <regex>\n");
+  printf("       RE_parser load [-v] <file> <string>...\n");
+  printf("       RE_parser match <regex> <string>...\n");
+  printf("       RE_parser cache-stats\n");
+  printf("       RE_parser submatch <regex> <string>\n");
+  printf("       RE_parser edit <regex> <offset> <delete_len> <text>\n");
+  printf("       RE_parser batch [-j N] [-steps N] [-nodes N] [-ms N] <file>\n");
+  printf("       RE_parser --stats <command>\n");
+  printf("       RE_parser --trace <file> <command>\n");
+}
+
+static int print_tree (const char *rexpr)
+{
+  Node * p_tree = node_new();
+  Parser * p_parser = parser_new();
+  SyntaxError error;
+  ParseStatus status = PARSE_OUT_OF_MEMORY;
+
+  if (NULL != p_tree && NULL != p_parser)
+    status = parser_parse(p_parser, rexpr, p_tree, &error);
+
+  if (PARSE_OK == status)
+  {
+    const uint64_t t = trace_begin();
+    node_print(node_child(p_tree, 0), 0);
+
+    FILE *fp = fopen("RE_parse_tree.txt", "w");
+    if (NULL != fp)
+    {
+      node_save(node_child(p_tree, 0), fp, 0);
+      fclose(fp);
+    }
+    else
+    {
+      printf("Cannot create file\n");
+    }
+    trace_end(TRACE_OUTPUT, t);
+  }
+  else if (PARSE_SYNTAX_ERROR == status)
+  {
+    char message[256];
+    printf("%s\n", parse_error_message(&error, rexpr, message,
+                                       sizeof(message)));
+    printf("Syntax error\n");
+  }
+  else
+  {
+    printf("Out of memory\n");
+  }
+
+  parser_free(p_parser);
+  node_free(p_tree);
+
+  return 0;
+}
+
+// Parse rexpr and lower it to an NFA.
+static bool build_nfa (const char *rexpr, Nfa * const p_nfa)
+{
+  Node * p_tree = node_new();
+  bool ok = false;
+
+  if (parse(rexpr, p_tree))
+  {
+    ok = nfa_from_tree(p_nfa, p_tree);
+    if (!ok)
+      printf("Out of memory\n");
+  }
+  else
+  {
+    printf("Syntax error in '%s'\n", rexpr);
+  }
+
+  node_free(p_tree);
+  return ok;
+}
+
+static int compare (const char *mode, const char *rexpr1, const char *rexpr2)
+{
+  Nfa nfa1, nfa2;
+  char *counterexample = NULL;
+  const bool is_equiv = (0 == strcmp(mode, "equiv"));
+
+  nfa_init(&nfa1);
+  nfa_init(&nfa2);
+  if (!build_nfa(rexpr1, &nfa1) || !build_nfa(rexpr2, &nfa2))
+  {
+    nfa_free(&nfa1);
+    nfa_free(&nfa2);
+    return 1;
+  }
+
+  const EquivStatus status = is_equiv
+                             ? equiv(&nfa1, &nfa2, &counterexample)
+                             : subset(&nfa1, &nfa2, &counterexample);
+
+  if (EQUIV_HOLDS == status)
+  {
+    printf(is_equiv ? "Equivalent\n" : "Subset\n");
+  }
+  else if (EQUIV_DIFFERS == status && NULL != counterexample)
+  {
+    // '#' stands for the empty string, as in the expressions.
+    printf("%s, counterexample: %s\n",
+           is_equiv ? "Not equivalent" : "Not a subset",
+           ('\0' == counterexample[0]) ? "#" : counterexample);
+  }
+  else
+  {
+    printf("Out of memory\n");
+  }
+
+  free(counterexample);
+  nfa_free(&nfa1);
+  nfa_free(&nfa2);
+
+  if (EQUIV_OUT_OF_MEMORY == status)
+    return 1;
+  return (EQUIV_HOLDS == status) ? 0 : 2;
+}
+
+static int compile_to_file (const char *path, const char *rexpr)
+{
+  Compiled compiled;
+
+  if (!compile(rexpr, &compiled))
+  {
+    printf("Cannot compile '%s'\n", rexpr);
+    return 1;
+  }
+
+  const uint64_t t = trace_begin();
+  const bool ok = compiled_save(&compiled, path);
+  trace_end(TRACE_OUTPUT, t);
+  if (!ok)
+    printf("Cannot create file\n");
+
+  compiled_free(&compiled);
+  return ok ? 0 : 1;
+}
+
+// Match each string and print the result, one phase each.
+static void print_matches (const CompiledView * const p_view,
+                           int n_strings,
+                           char **strings)
+{
+  for (int i = 0; i < n_strings; ++i)
+  {
+    uint64_t t = trace_begin();
+    const bool match = compiled_match(p_view, strings[i], strlen(strings[i]));
+    trace_end(TRACE_MATCH, t);
+
+    t = trace_begin();
+    printf("%s: %s\n", strings[i], match ? "match" : "no match");
+    trace_end(TRACE_OUTPUT, t);
+  }
+}
+
+static int load_and_match (const char *path,
+                           bool verify,
+                           int n_strings,
+                           char **strings)
+{
+  Compiled compiled;
+
+  const uint64_t t = trace_begin();
+  const bool loaded = compiled_load(path, &compiled);
+  trace_end(TRACE_READ, t);
+  if (!loaded)
+  {
+    printf("Cannot load '%s'\n", path);
+    return 1;
+  }
+  if (verify && !compiled_verify(&compiled.view))
+  {
+    printf("Corrupt image '%s'\n", path);
+    compiled_free(&compiled);
+    return 1;
+  }
+
+  print_matches(&compiled.view, n_strings, strings);
+
+  compiled_free(&compiled);
+  return 0;
+}
+
+static int match_cached (const char *rexpr, int n_strings, char **strings)
+{
+  const Compiled *p_compiled = regex_cache_get(p_regex_cache, rexpr);
+
+  // On a miss, compile through the disk cache, or directly without a usable
+  // cache directory.
+  if (NULL == p_compiled)
+  {
+    DiskCache cache;
+    Compiled compiled;
+    bool ok;
+
+    if (disk_cache_open_default(&cache))
+    {
+      ok = compile_cached(&cache, rexpr, &compiled);
+      disk_cache_close(&cache);
+    }
+    else
+    {
+      ok = compile(rexpr, &compiled);
+    }
+
+    if (ok)
+      p_compiled = regex_cache_put(p_regex_cache, rexpr, &compiled);
+  }
+
+  if (NULL == p_compiled)
+  {
+    printf("Cannot compile '%s'\n", rexpr);
+    return 1;
+  }
+
+  print_matches(&p_compiled->view, n_strings, strings);
+
+  regex_cache_release(p_regex_cache, p_compiled);
+  return 0;
+}
+
+static int print_cache_stats (void)
+{
+  DiskCache cache;
+  DiskCacheStats stats;
+
+  if (!disk_cache_open_default(&cache) || !disk_cache_read_stats(&cache, &stats))
+  {
+    printf("Cannot open the compile cache\n");
+    return 1;
+  }
+
+  printf("directory: %s\n", cache.dir);
+  printf("hits: %llu\n", (unsigned long long)stats.hits);
+  printf("misses: %llu\n", (unsigned long long)stats.misses);
+  printf("stores: %llu\n", (unsigned long long)stats.stores);
+  printf("evictions: %llu\n", (unsigned long long)stats.evictions);
+
+  disk_cache_close(&cache);
+  return 0;
+}
+
+static int print_submatches (const char *rexpr, const char *s)
+{
+  Node * p_tree = node_new();
+  Submatcher sm;
+
+  if (!parse(rexpr, p_tree))
+  {
+    printf("Syntax error\n");
+    node_free(p_tree);
+    return 1;
+  }
+
+  const bool ok = submatcher_build(&sm, p_tree);
+  node_free(p_tree);
+  if (!ok)
+  {
+    printf("Out of memory\n");
+    return 1;
+  }
+
+  const int n_slots = submatcher_n_slots(&sm);
+  int *p_slots = malloc((size_t)n_slots * sizeof(int));
+  if (NULL == p_slots)
+  {
+    submatcher_free(&sm);
+    return 1;
+  }
+
+  uint64_t t = trace_begin();
+  const bool match = submatch(&sm, s, strlen(s), p_slots);
+  trace_end(TRACE_MATCH, t);
+
+  t = trace_begin();
+  printf("Engine: %s\n", sm.one_pass ? "one-pass DFA" : "tagged NFA");
+  if (match)
+  {
+    for (int g = 0; 2 * g < n_slots; ++g)
+    {
+      const int start = p_slots[2 * g];
+      const int end = p_slots[2 * g + 1];
+      if (start < 0 || end < 0)
+        printf("%d: unset\n", g);
+      else
+        printf("%d: [%d, %d) '%.*s'\n", g, start, end, end - start, s + start);
+    }
+  }
+  else
+  {
+    printf("no match\n");
+  }
+  trace_end(TRACE_OUTPUT, t);
+
+  free(p_slots);
+  submatcher_free(&sm);
+  return 0;
+}
+
+static int print_edited_tree (const char *rexpr,
+                              const char *offset_arg,
+                              const char *delete_arg,
+                              const char *text)
+{
+  const int len = (int)strlen(rexpr);
+  const int offset = atoi(offset_arg);
+  const int delete_len = atoi(delete_arg);
+
+  if (offset < 0 || delete_len < 0 || offset > len || delete_len > len - offset)
+  {
+    printf("The edit is out of the expression\n");
+    return 1;
+  }
+
+  const int text_len = (int)strlen(text);
+  char *edited = malloc((size_t)(len - delete_len + text_len + 1));
+  Node * p_tree = node_new();
+  if (NULL == edited || NULL == p_tree)
+  {
+    printf("Out of memory\n");
+    free(edited);
+    free(p_tree);
+    return 1;
+  }
+
+  memcpy(edited, rexpr, (size_t)offset);
+  memcpy(edited + offset, text, (size_t)text_len);
+  strcpy(edited + offset + text_len, rexpr + offset + delete_len);
+
+  bool incremental = false;
+  const bool ok = parse(rexpr, p_tree)
+                  && reparse(edited, p_tree, offset, delete_len, text_len,
+                             &incremental);
+  if (ok)
+  {
+    const uint64_t t = trace_begin();
+    printf("%s: %s reparse\n", edited, incremental ? "incremental" : "full");
+    node_print(node_child(p_tree, 0), 0);
+    trace_end(TRACE_OUTPUT, t);
+  }
+  else
+  {
+    printf("Syntax error\n");
+  }
+
+  node_free(p_tree);
+  free(edited);
+  return ok ? 0 : 1;
+}
+
+static int run_batch (int argc, char **argv)
+{
+  ParseBudget budget = { BATCH_DEFAULT_MAX_STEPS, BATCH_DEFAULT_MAX_NODES,
+                         BATCH_DEFAULT_MAX_SECONDS };
+  int n_workers = 1;
+  Batch batch;
+  int i = 2;
+
+  for (; i + 2 < argc && '-' == argv[i][0]; i += 2)
+  {
+    const long long value = atoll(argv[i + 1]);
+
+    if (value < 0)
+      break;
+    else if (0 == strcmp(argv[i], "-j"))
+      n_workers = (int)value;
+    else if (0 == strcmp(argv[i], "-steps"))
+      budget.max_steps = (uint64_t)value;
+    else if (0 == strcmp(argv[i], "-nodes"))
+      budget.max_nodes = (uint64_t)value;
+    else if (0 == strcmp(argv[i], "-ms"))
+      budget.max_seconds = 1e-3 * (double)value;
+    else
+      break;
+  }
+
+  if (i + 1 != argc)
+  {
+    printf("Wrong batch options\n");
+    print_usage();
+    return 1;
+  }
+
+  if (n_workers <= 0)
+  {
+    printf("The number of threads must be positive\n");
+    return 1;
+  }
+
+  const char * const path = argv[i];
+  if (!batch_read(&batch, path))
+  {
+    printf("Cannot read '%s'\n", path);
+    return 1;
+  }
+
+  batch.budget = budget;
+  batch.p_cache = p_regex_cache;
+  const bool ok = batch_run(&batch, n_workers);
+  parse_stats_add(&worker_stats, &batch.stats);
+  if (ok)
+    batch_print(&batch, stdout);
+  else
+    printf("Out of memory\n");
+
+  batch_free(&batch);
+  return ok ? 0 : 1;
+}
+
+static int run_command (int argc, char **argv)
+{
+  if (argc == 2 && 0 == strcmp(argv[1], "cache-stats"))
+    return print_cache_stats();
+
+  if (argc == 2)
+    return print_tree(argv[1]);
+
+  if (argc == 4 && (0 == strcmp(argv[1], "equiv")
+                    || 0 == strcmp(argv[1], "subset")))
+    return compare(argv[1], argv[2], argv[3]);
+
+  if (argc == 5 && 0 == strcmp(argv[1], "compile") && 0 == strcmp(argv[2], "-o"))
+    return compile_to_file(argv[3], argv[4]);
+
+  if (argc >= 4 && 0 == strcmp(argv[1], "load") && 0 == strcmp(argv[2], "-v"))
+    return load_and_match(argv[3], true, argc - 4, &argv[4]);
+
+  if (argc >= 3 && 0 == strcmp(argv[1], "load"))
+    return load_and_match(argv[2], false, argc - 3, &argv[3]);
+
+  if (argc == 4 && 0 == strcmp(argv[1], "submatch"))
+    return print_submatches(argv[2], argv[3]);
+
+  if (argc == 6 && 0 == strcmp(argv[1], "edit"))
+    return print_edited_tree(argv[2], argv[3], argv[4], argv[5]);
+
+  if (argc >= 3 && 0 == strcmp(argv[1], "match"))
+    return match_cached(argv[2], argc - 3, &argv[3]);
+
+  if (argc >= 3 && 0 == strcmp(argv[1], "batch"))
+    return run_batch(argc, argv);
+
+  printf("Wrong number of command-line arguments: ");
+  printf("%d arguments found, %d expected\n", argc -1, 1);
+  print_usage();
+  return 1;
+}
+
+int main (int argc, char **argv)
+{
+  // Input checks.
+  if (argc > 2 && 0 == strcmp(argv[1], "--trace"))
+  {
+    if (!trace_start(argv[2]))
+    {
+      printf("Cannot start the trace\n");
+      return 1;
+    }
+
+    argv[2] = argv[0];
+    argc -= 2;
+    argv += 2;
+  }
+
+  p_regex_cache = regex_cache_new(REGEX_CACHE_BYTES);
+  if (NULL == p_regex_cache)
+  {
+    printf("Out of memory\n");
+    return 1;
+  }
+
+  if (argc > 1 && 0 == strcmp(argv[1], "--stats"))
+  {
+    if (!parse_stats_enabled())
+    {
+      printf("The parser counters are compiled out, build with 'make stats'\n");
+      regex_cache_free(p_regex_cache);
+      return 1;
+    }
+
+    argv[1] = argv[0];
+    parse_stats_reset();
+    const int status = run_command(argc - 1, &argv[1]);
+
+    ParseStats stats;
+    parse_stats_get(&stats);
+    parse_stats_add(&stats, &worker_stats);
+    parse_stats_print(&stats, stdout);
+
+    RegexCacheStats cache_stats;
+    regex_cache_stats(p_regex_cache, &cache_stats);
+    regex_cache_stats_print(&cache_stats, stdout);
+    regex_cache_free(p_regex_cache);
+    return status;
+  }
+
+  const int status = run_command(argc, argv);
+  regex_cache_free(p_regex_cache);
+  return status;
+}
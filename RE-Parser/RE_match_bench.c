@@ -0,0 +1,512 @@
+/*
+ *  Benchmark of the matching engines, against POSIX regex from the C library.
+ *
+ *  Each case is a pattern and a corpus that it matches as a whole: random
+ *  bytes of an alphabet followed by a suffix, or the bytes of a real text
+ *  file given on the command line.  The pattern is compiled with every
+ *  engine, the compilation is timed, and so are several passes of matching
+ *  over the corpus, after checking that all the engines agree:
+ *
+ *  nfa       NFA simulation over the compiled image.
+ *  lazy_dfa  DFA determinized on demand from the NFA.
+ *  dfa       Minimized full DFA of the compiled image.
+ *  submatch  One-pass DFA, or Pike VM, with the captures of the groups.
+ *  posix     regcomp/regexec, the pattern translated to an anchored ERE.
+ *
+ *  The results are printed as CSV, or as JSON with -json, one record per
+ *  case and engine.
+ *
+ *  Usage: RE_match_bench [-json] [megabytes] [passes] [text file]
+ */
+
+#include "RE_automaton.h"
+#include "RE_compiled.h"
+#include "RE_parser.h"
+#include "RE_submatch.h"
+
+#include <regex.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_MEGABYTES 8
+#define DEFAULT_PASSES    3
+
+/**** Cases. ****/
+
+typedef struct
+{
+  const char * name;
+  const char * pattern;
+  const char * alphabet; // NULL for the text file.
+  const char * suffix;
+} Case;
+
+static const Case cases [] =
+{
+  { "ab_suffix", "(a+b)*abb", "ab", "abb" },
+  { "ab_nth", "(a+b)*a(a+b)(a+b)(a+b)(a+b)", "ab", "abbbb" },
+  { "words", "([a-z]+[ \\n]+[.,])*", "etaoinshrdlu \n.,", "" },
+  { "digits", "([0-9][0-9]*[,])*[0-9][0-9]*", "0123456789,", "0" },
+  { "text_lines", "([^\\n]+\\n)*", NULL, "" },
+  { "text_words", "([A-Za-z_]+[0-9]+[^_0-9A-Za-z])*", NULL, "" }
+};
+
+#define N_CASES (sizeof(cases) / sizeof(cases[0]))
+
+typedef struct
+{
+  char     * data;
+  size_t     len;
+  uint64_t   seed;
+} Corpus;
+
+static uint32_t corpus_random (Corpus * const p_corpus, uint32_t n)
+{
+  // xorshift64*.
+  p_corpus->seed ^= p_corpus->seed >> 12;
+  p_corpus->seed ^= p_corpus->seed << 25;
+  p_corpus->seed ^= p_corpus->seed >> 27;
+  return (uint32_t)((p_corpus->seed * 2685821657736338717ULL) >> 32) % n;
+}
+
+// Random bytes of the alphabet, ending with the suffix.  A ',' never starts
+// the corpus or follows another one, the first letter is used instead.
+static bool corpus_generate (Corpus * const p_corpus,
+                             const Case * const p_case,
+                             size_t size)
+{
+  const size_t n_letters = strlen(p_case->alphabet);
+  const size_t suffix_len = strlen(p_case->suffix);
+
+  p_corpus->len = size + suffix_len;
+  p_corpus->seed = 0x9e3779b97f4a7c15ULL;
+  p_corpus->data = malloc(p_corpus->len + 1);
+  if (NULL == p_corpus->data)
+    return false;
+
+  for (size_t i = 0; i < size; ++i)
+  {
+    char c = p_case->alphabet[corpus_random(p_corpus, (uint32_t)n_letters)];
+    if (',' == c && (0 == i || ',' == p_corpus->data[i - 1]))
+      c = p_case->alphabet[0];
+    p_corpus->data[i] = c;
+  }
+  memcpy(p_corpus->data + size, p_case->suffix, suffix_len + 1);
+  return true;
+}
+
+static bool corpus_read (Corpus * const p_corpus, const char *path)
+{
+  FILE *fp = fopen(path, "rb");
+  long size = -1;
+
+  p_corpus->data = NULL;
+  if (NULL == fp)
+    return false;
+  if (0 == fseek(fp, 0, SEEK_END))
+    size = ftell(fp);
+  rewind(fp);
+
+  if (size >= 0)
+    p_corpus->data = malloc((size_t)size + 1);
+  p_corpus->len = (size >= 0) ? (size_t)size : 0;
+  const bool ok = NULL != p_corpus->data
+                  && p_corpus->len == fread(p_corpus->data, 1, p_corpus->len, fp);
+  fclose(fp);
+  if (ok)
+    p_corpus->data[p_corpus->len] = '\0';
+  return ok;
+}
+
+/**** POSIX translation. ****/
+
+// Where the last factor of an open group starts, and the parentheses to
+// close with the group.
+typedef struct
+{
+  size_t factor;
+  size_t n_close;
+} PosixLevel;
+
+// Anchored ERE of the same language.  '+' takes the factor before it and
+// the rest of its group, where '|' would take the whole concatenations: ab+c
+// is a(b|(c)).  '#' becomes an empty group, and escaped bytes bracket
+// expressions, inside which the C library reads no escapes.  The caller
+// frees the result.
+static char * posix_pattern (const char *rexpr)
+{
+  const size_t len = strlen(rexpr);
+  char *p_out = malloc(6 * len + 5);
+  PosixLevel *p_levels = malloc((len + 1) * sizeof(PosixLevel));
+  size_t depth = 0;
+  size_t n = 0;
+  bool in_class = false;
+
+  if (NULL == p_out || NULL == p_levels)
+  {
+    free(p_out);
+    free(p_levels);
+    return NULL;
+  }
+
+  p_levels[0] = (PosixLevel) { SIZE_MAX, 0 };
+  p_out[n++] = '^';
+  p_out[n++] = '(';
+  for (size_t i = 0; i < len; ++i)
+  {
+    PosixLevel * const p_level = &p_levels[depth];
+    char c = rexpr[i];
+
+    if ('\\' == c && i + 1 < len)
+    {
+      c = rexpr[++i];
+      c = ('n' == c) ? '\n' : ('t' == c) ? '\t' : ('r' == c) ? '\r' : c;
+      if (!in_class)
+      {
+        p_level->factor = n;
+        p_out[n++] = '[';
+      }
+      p_out[n++] = c;
+      if (!in_class)
+        p_out[n++] = ']';
+      continue;
+    }
+
+    if (in_class)
+    {
+      in_class = ']' != c;
+    }
+    else if ('[' == c)
+    {
+      p_level->factor = n;
+      in_class = true;
+    }
+    else if ('(' == c)
+    {
+      p_level->factor = n;
+      p_levels[++depth] = (PosixLevel) { SIZE_MAX, 0 };
+    }
+    else if (')' == c && 0 != depth)
+    {
+      for (; 0 != p_level->n_close; --p_level->n_close)
+        p_out[n++] = ')';
+      --depth;
+    }
+    else if ('+' == c)
+    {
+      const size_t factor = (SIZE_MAX != p_level->factor) ? p_level->factor
+                                                          : n;
+      memmove(p_out + factor + 1, p_out + factor, n - factor);
+      p_out[factor] = '(';
+      ++n;
+      p_out[n++] = '|';
+      c = '(';
+      p_level->factor = SIZE_MAX;
+      p_level->n_close += 2;
+    }
+    else if ('#' == c)
+    {
+      p_level->factor = n;
+      p_out[n++] = '(';
+      c = ')';
+    }
+    else if ('*' != c)
+    {
+      p_level->factor = n;
+    }
+    p_out[n++] = c;
+  }
+  for (; 0 != p_levels[0].n_close; --p_levels[0].n_close)
+    p_out[n++] = ')';
+  p_out[n++] = ')';
+  p_out[n++] = '$';
+  p_out[n] = '\0';
+  free(p_levels);
+  return p_out;
+}
+
+/**** Engines. ****/
+
+typedef enum
+{
+  ENGINE_NFA,
+  ENGINE_LAZY_DFA,
+  ENGINE_DFA,
+  ENGINE_SUBMATCH,
+  ENGINE_POSIX,
+  N_ENGINES
+} Engine;
+
+static const char * const engine_names [N_ENGINES] =
+{
+  "nfa", "lazy_dfa", "dfa", "submatch", "posix"
+};
+
+// One compiled pattern, with the fields of its engine only.
+typedef struct
+{
+  Engine       engine;
+  Compiled     compiled;
+  void       * p_scratch;
+  Nfa          nfa;
+  LazyDfa      lazy;
+  Submatcher   sm;
+  int        * slots;
+  regex_t      regex;
+} Matcher;
+
+static bool matcher_compile (Matcher * const p_matcher,
+                             Engine engine,
+                             const char *rexpr)
+{
+  Node *p_tree = NULL;
+  bool ok = false;
+
+  memset(p_matcher, 0, sizeof(Matcher));
+  p_matcher->engine = engine;
+
+  switch (engine)
+  {
+    case ENGINE_NFA:
+      ok = compile(rexpr, &p_matcher->compiled);
+      p_matcher->p_scratch = ok ? malloc(compiled_nfa_scratch_size(
+                                           &p_matcher->compiled.view))
+                                : NULL;
+      ok = ok && NULL != p_matcher->p_scratch;
+      break;
+    case ENGINE_DFA:
+      ok = compile(rexpr, &p_matcher->compiled);
+      break;
+    case ENGINE_LAZY_DFA:
+    case ENGINE_SUBMATCH:
+      p_tree = node_new();
+      ok = NULL != p_tree && parse(rexpr, p_tree);
+      if (ENGINE_LAZY_DFA == engine)
+      {
+        nfa_init(&p_matcher->nfa);
+        ok = ok && nfa_from_tree(&p_matcher->nfa, p_tree)
+             && lazy_dfa_init(&p_matcher->lazy, &p_matcher->nfa, NULL);
+      }
+      else
+      {
+        ok = ok && submatcher_build(&p_matcher->sm, p_tree);
+        p_matcher->slots = ok ? malloc((size_t)submatcher_n_slots(&p_matcher->sm)
+                                       * sizeof(int))
+                              : NULL;
+        ok = ok && NULL != p_matcher->slots;
+      }
+      node_free(p_tree);
+      break;
+    default:
+    {
+      char *posix = posix_pattern(rexpr);
+      ok = NULL != posix
+           && 0 == regcomp(&p_matcher->regex, posix, REG_EXTENDED | REG_NOSUB);
+      free(posix);
+      break;
+    }
+  }
+
+  return ok;
+}
+
+static bool matcher_match (Matcher * const p_matcher, const char *s, size_t len)
+{
+  switch (p_matcher->engine)
+  {
+    case ENGINE_NFA:
+      return compiled_nfa_match(&p_matcher->compiled.view, s, len,
+                                p_matcher->p_scratch);
+    case ENGINE_DFA:
+      return compiled_match(&p_matcher->compiled.view, s, len);
+    case ENGINE_LAZY_DFA:
+      return lazy_dfa_match(&p_matcher->lazy, s, len);
+    case ENGINE_SUBMATCH:
+      return submatch(&p_matcher->sm, s, len, p_matcher->slots);
+    default:
+      return 0 == regexec(&p_matcher->regex, s, 0, NULL, 0);
+  }
+}
+
+// Only called after a successful compilation.
+static void matcher_free (Matcher * const p_matcher)
+{
+  switch (p_matcher->engine)
+  {
+    case ENGINE_NFA:
+    case ENGINE_DFA:
+      free(p_matcher->p_scratch);
+      compiled_free(&p_matcher->compiled);
+      break;
+    case ENGINE_LAZY_DFA:
+      lazy_dfa_free(&p_matcher->lazy);
+      nfa_free(&p_matcher->nfa);
+      break;
+    case ENGINE_SUBMATCH:
+      free(p_matcher->slots);
+      submatcher_free(&p_matcher->sm);
+      break;
+    default:
+      regfree(&p_matcher->regex);
+      break;
+  }
+}
+
+/**** Measures. ****/
+
+typedef struct
+{
+  double compile_seconds;
+  double best_seconds;
+  double median_seconds;
+  bool   matched;
+} Result;
+
+static double now (void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + 1e-9 * (double)t.tv_nsec;
+}
+
+static int compare_doubles (const void *p_a, const void *p_b)
+{
+  const double a = *(const double *)p_a;
+  const double b = *(const double *)p_b;
+  return (a > b) - (a < b);
+}
+
+static bool bench (Engine engine, const char *rexpr,
+                   const Corpus * const p_corpus, int n_passes,
+                   Result * const p_result)
+{
+  Matcher matcher;
+  double seconds[n_passes];
+
+  const double t0 = now();
+  if (!matcher_compile(&matcher, engine, rexpr))
+    return false;
+  p_result->compile_seconds = now() - t0;
+
+  for (int i = 0; i < n_passes; ++i)
+  {
+    const double t1 = now();
+    p_result->matched = matcher_match(&matcher, p_corpus->data, p_corpus->len);
+    seconds[i] = now() - t1;
+  }
+  qsort(seconds, (size_t)n_passes, sizeof(double), compare_doubles);
+  p_result->best_seconds = seconds[0];
+  p_result->median_seconds = seconds[n_passes / 2];
+
+  matcher_free(&matcher);
+  return true;
+}
+
+static void print_result (bool json, bool first, const Case * const p_case,
+                          Engine engine, const Corpus * const p_corpus,
+                          const Result * const p_result)
+{
+  const double mb = (double)p_corpus->len / 1e6;
+
+  if (json)
+    printf("%s\n  {\"case\": \"%s\", \"engine\": \"%s\", \"corpus_bytes\": %zu, "
+           "\"compile_us\": %.3f, \"best_mbps\": %.2f, \"median_mbps\": %.2f, "
+           "\"matched\": %s}", first ? "" : ",", p_case->name,
+           engine_names[engine], p_corpus->len,
+           1e6 * p_result->compile_seconds, mb / p_result->best_seconds,
+           mb / p_result->median_seconds, p_result->matched ? "true" : "false");
+  else
+    printf("%s,%s,%zu,%.3f,%.2f,%.2f,%d\n", p_case->name,
+           engine_names[engine], p_corpus->len,
+           1e6 * p_result->compile_seconds, mb / p_result->best_seconds,
+           mb / p_result->median_seconds, p_result->matched);
+}
+
+int main (int argc, char **argv)
+{
+  // Input checks.
+  const bool json = argc > 1 && 0 == strcmp(argv[1], "-json");
+  const int arg = json ? 2 : 1;
+  if (argc - arg > 3)
+  {
+    printf("Wrong number of command-line arguments: ");
+    printf("%d arguments found, at most %d expected\n", argc - 1, 4);
+    printf("Usage: RE_match_bench [-json] [megabytes] [passes] [text file]\n");
+    return 1;
+  }
+
+  const int megabytes = (argc > arg) ? atoi(argv[arg]) : DEFAULT_MEGABYTES;
+  const int n_passes = (argc > arg + 1) ? atoi(argv[arg + 1]) : DEFAULT_PASSES;
+  const char * const text_path = (argc > arg + 2) ? argv[arg + 2] : NULL;
+  if (megabytes <= 0 || n_passes <= 0)
+  {
+    printf("The size and the number of passes must be positive\n");
+    return 1;
+  }
+
+  Corpus text = { NULL, 0, 0 };
+  if (NULL != text_path && !corpus_read(&text, text_path))
+  {
+    printf("Cannot read '%s'\n", text_path);
+    return 1;
+  }
+
+  if (json)
+    printf("[");
+  else
+    printf("case,engine,corpus_bytes,compile_us,best_mbps,median_mbps,matched\n");
+
+  bool first = true;
+  int status = 0;
+  for (size_t c = 0; c < N_CASES; ++c)
+  {
+    const Case * const p_case = &cases[c];
+    Corpus corpus;
+    Result results[N_ENGINES];
+    int reference = -1; // First engine that compiled the pattern.
+
+    // The text cases need a text file.
+    if (NULL == p_case->alphabet && NULL == text_path)
+      continue;
+    if (NULL == p_case->alphabet)
+      corpus = text;
+    else if (!corpus_generate(&corpus, p_case, (size_t)megabytes << 20))
+    {
+      printf("Out of memory\n");
+      return 1;
+    }
+
+    for (Engine engine = 0; engine < N_ENGINES; ++engine)
+    {
+      if (!bench(engine, p_case->pattern, &corpus, n_passes, &results[engine]))
+      {
+        fprintf(stderr, "%s: %s cannot compile '%s'\n", p_case->name,
+                engine_names[engine], p_case->pattern);
+        status = 2;
+        continue;
+      }
+      if (reference < 0)
+        reference = (int)engine;
+      if (results[engine].matched != results[reference].matched)
+      {
+        fprintf(stderr, "%s: %s disagrees with %s\n", p_case->name,
+                engine_names[engine], engine_names[reference]);
+        status = 2;
+      }
+      print_result(json, first, p_case, engine, &corpus, &results[engine]);
+      first = false;
+    }
+
+    if (NULL != p_case->alphabet)
+      free(corpus.data);
+  }
+
+  if (json)
+    printf("\n]\n");
+  free(text.data);
+  return status;
+}
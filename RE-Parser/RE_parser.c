@@ -8,28 +8,48 @@
  *  Left recursion removal:
  *  RE  ::= # | # RE' | symbol | symbol RE' | ( RE ) | ( RE ) RE'
  *  RE' ::= + RE | + RE RE' | RE | RE RE' | * | * RE'.
+ *
+ *  A symbol is a letter, a digit or '_', an escaped byte ('\n', '\t' and
+ *  '\r' are control characters, any other escaped byte stands for itself),
+ *  or a byte class such as [_0-9A-Za-z] or [^\n].
  */
 
 #include "RE_parser.h"
+#include "RE_trace.h"
 
+#include <inttypes.h>
 #include <stddef.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 
-#define MAX_CONTENT_LEN 16 // Max characters of the content of a node.
+#define MAX_CONTENT_LEN 32 // Max characters of the content of a node.
 #define MAX_CHILDREN 4 // Max number of children for a variable in the parse tree.
 #define INDENTATION 1 // Child indentation when the parse tree is printed.
 
+// Counters of the parses of this thread, see parse_stats_get.
+#ifdef RE_STATS
+static _Thread_local ParseStats stats;
+static _Thread_local int depth;
+#define STATS(statement) do { statement; } while (0)
+#else
+#define STATS(statement) do { } while (0)
+#endif
+
 /**** Parse tree functions and data structures. ****/
 struct Node
 {
   char content   [MAX_CONTENT_LEN];
   Node * children [MAX_CHILDREN];
+  int width; // Bytes of the expression spanned, -1 until measured.
 };
 
 Node * node_new (void)
 {
-  return malloc(sizeof(Node));
+  Node * const p_node = malloc(sizeof(Node));
+  STATS(stats.nodes_new += (NULL != p_node));
+  STATS(stats.bytes_allocated += (NULL != p_node) ? sizeof(Node) : 0);
+  return p_node;
 }
 
 void node_init (Node * const p_node, const char * s)
@@ -38,6 +58,7 @@ void node_init (Node * const p_node, const char * s)
     p_node->children[i] = NULL;
 
   strcpy(p_node->content, s);
+  p_node->width = -1;
 }
 
 void node_add_child (Node * const p_node, Node * const p_child)
@@ -52,10 +73,21 @@ void node_add_child (Node * const p_node, Node * const p_child)
   }
 }
 
+const char * node_content (const Node * const p_node)
+{
+  return p_node->content;
+}
+
+Node * node_child (const Node * const p_node, int i)
+{
+  return (0 <= i && i < MAX_CHILDREN) ? p_node->children[i] : NULL;
+}
+
 void node_free (Node * p_node)
 {
   if (NULL != p_node)
   {
+    STATS(++stats.nodes_freed);
     for (int i = 0; i < MAX_CHILDREN; ++i)
     {
       node_free(p_node->children[i]);
@@ -73,6 +105,7 @@ void node_free_last_child (Node * const p_node)
     {
       node_free(p_node->children[i]);
       p_node->children[i] = NULL;
+      p_node->width = -1;
       return;
     }
   }
@@ -85,6 +118,24 @@ void node_free_children (Node * const p_node)
     node_free(p_node->children[i]);
     p_node->children[i] = NULL;
   }
+  p_node->width = -1;
+}
+
+// The content of a leaf is its text in the expression.
+int node_width (Node * const p_node)
+{
+  if (p_node->width < 0)
+  {
+    int width = 0;
+    for (int i = 0; i < MAX_CHILDREN; ++i)
+      if (NULL != p_node->children[i])
+        width += node_width(p_node->children[i]);
+
+    p_node->width = (NULL == p_node->children[0])
+                    ? (int)strlen(p_node->content) : width;
+  }
+
+  return p_node->width;
 }
 
 void node_print (const Node * const p_node, int indent)
@@ -120,298 +171,856 @@ void node_save (Node *p_node, FILE *fp, int indent)
   }
 }
 
+/**** Parser. ****/
+
+struct Parser
+{
+  ParseBudget  budget;
+  uint64_t     steps;      // Calls to RE and RE'.
+  uint64_t     next_check; // Step of the next check, 0 once stopped.
+  double       start;      // Seconds on the monotonic clock.
+  ParseStatus  status;     // PARSE_OK until the parse is stopped.
+  AllocProfile profile;
+  SyntaxError  error;
+};
+
+static void parser_init (Parser * const p_parser)
+{
+  memset(p_parser, 0, sizeof(Parser));
+  p_parser->next_check = UINT64_MAX;
+}
+
+static double now (void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + 1e-9 * (double)t.tv_nsec;
+}
+
+// From now on, every RE and RE' fails.
+static void parser_stop (Parser * const p_parser, ParseStatus status)
+{
+  p_parser->status = status;
+  p_parser->next_check = 0;
+}
+
+// Called when a step reaches next_check.
+static bool within_budget (Parser * const p_parser)
+{
+  const ParseBudget * const p_budget = &p_parser->budget;
+
+  if (PARSE_OK != p_parser->status)
+    return false;
+
+  if (0 != p_budget->max_steps && p_parser->steps > p_budget->max_steps)
+    parser_stop(p_parser, PARSE_STEPS_EXCEEDED);
+  else if (0 != p_budget->max_nodes
+           && (uint64_t)p_parser->profile.peak_bytes
+              > p_budget->max_nodes * sizeof(Node))
+    parser_stop(p_parser, PARSE_NODES_EXCEEDED);
+  else if (0 < p_budget->max_seconds
+           && now() - p_parser->start > p_budget->max_seconds)
+    parser_stop(p_parser, PARSE_DEADLINE_EXCEEDED);
+  else
+    p_parser->next_check = p_parser->steps + PARSE_CHECK_INTERVAL;
+
+  return PARSE_OK == p_parser->status;
+}
+
+// The labels of the variables start with 'R', which no symbol of two bytes
+// or more does; the other labels are one byte.
+static Label label_of (const char *s)
+{
+  if ('R' == s[0] && 'o' == s[1])
+    return LABEL_ROOT;
+  if ('R' == s[0] && 'E' == s[1])
+    return ('\'' == s[2]) ? LABEL_RE_PRIME : LABEL_RE;
+  if ('\0' != s[0] && '\0' == s[1])
+  {
+    switch (s[0])
+    {
+      case '#': return LABEL_EPSILON;
+      case '(': return LABEL_LPAR;
+      case ')': return LABEL_RPAR;
+      case '*': return LABEL_STAR;
+      case '+': return LABEL_PLUS;
+      default: break;
+    }
+  }
+  return LABEL_SYMBOL;
+}
+
+// A new node of the parse, counted in its profile.
+static Node * parser_node (Parser * const p_parser, const char *s)
+{
+  AllocProfile * const p_profile = &p_parser->profile;
+  Node * const p_node = node_new();
+
+  if (NULL == p_node)
+  {
+    parser_stop(p_parser, PARSE_OUT_OF_MEMORY);
+    return NULL;
+  }
+
+  node_init(p_node, s);
+  ++p_profile->n_allocs;
+  p_profile->bytes_allocated += sizeof(Node);
+  p_profile->live_bytes += (int64_t)sizeof(Node);
+  if (p_profile->live_bytes > p_profile->peak_bytes)
+    p_profile->peak_bytes = p_profile->live_bytes;
+  ++p_profile->nodes[label_of(s)];
+  return p_node;
+}
+
+// node_free, counted in the profile of the parse.
+static void parser_node_free (Parser * const p_parser, Node * p_node)
+{
+  if (NULL != p_node)
+  {
+    for (int i = 0; i < MAX_CHILDREN; ++i)
+    {
+      parser_node_free(p_parser, p_node->children[i]);
+      p_node->children[i] = NULL;
+    }
+    ++p_parser->profile.n_frees;
+    p_parser->profile.live_bytes -= (int64_t)sizeof(Node);
+    node_free(p_node);
+  }
+}
+
+static void parser_free_last_child (Parser * const p_parser,
+                                    Node * const p_node)
+{
+  for (int i = MAX_CHILDREN-1; i >= 0; --i)
+  {
+    if (p_node->children[i] != NULL)
+    {
+      parser_node_free(p_parser, p_node->children[i]);
+      p_node->children[i] = NULL;
+      p_node->width = -1;
+      return;
+    }
+  }
+}
+
+static void parser_free_children (Parser * const p_parser, Node * const p_node)
+{
+  for (int i = 0; i < MAX_CHILDREN; ++i)
+  {
+    parser_node_free(p_parser, p_node->children[i]);
+    p_node->children[i] = NULL;
+  }
+  p_node->width = -1;
+}
+
+// What was expected at position i did not match.  A syntax error is at the
+// furthest such position.
+static void expect (Parser * const p_parser, int i, uint32_t expected)
+{
+  SyntaxError * const p_error = &p_parser->error;
+
+  if (i > p_error->position)
+  {
+    p_error->position = i;
+    p_error->expected = expected;
+  }
+  else if (i == p_error->position)
+  {
+    p_error->expected |= expected;
+  }
+}
+
 /**** Terminals ****/
 
-bool epsilon (const char *reg_expr,
-              const int * const p_idx_in,
-              int * const p_idx_out,
-              Node * const p_node)
+static bool epsilon (Parser * const p_parser,
+                     const char *reg_expr,
+                     const int * const p_idx_in,
+                     int * const p_idx_out,
+                     Node * const p_node)
 {
+  STATS(++stats.calls_terminal[TERMINAL_EPSILON]);
   const int i = *p_idx_in;
   if (reg_expr[i] == '#')               // Use '#' as epsilon.
   {
+    Node * p_node_eps = parser_node(p_parser, "#");
+    if (NULL == p_node_eps)
+      return false;
     *p_idx_out = i + 1;                 // Index of the next lexeme.
-    Node * p_node_eps = node_new();
-    node_init(p_node_eps, "#");
     node_add_child(p_node, p_node_eps); // Add the node to the parse tree.
     return true;
   }
 
+  expect(p_parser, i, 1u << TERMINAL_EPSILON);
   return false;
 }
 
-bool symbol (const char *reg_expr,
-             const int * const p_idx_in,
-             int * const p_idx_out,
-             Node * const p_node)
+// Length of the byte class starting at reg_expr[i] with '[', 0 if invalid.
+static int class_length (const char *reg_expr, int i)
 {
+  int j = i + 1;
+
+  if ('^' == reg_expr[j])
+    ++j;
+  if (']' == reg_expr[j])               // Empty class.
+    return 0;
+
+  while (']' != reg_expr[j])
+  {
+    if ('\0' == reg_expr[j])
+      return 0;
+    j += ('\\' == reg_expr[j] && '\0' != reg_expr[j + 1]) ? 2 : 1;
+  }
+
+  return j + 1 - i;
+}
+
+static bool symbol (Parser * const p_parser,
+                    const char *reg_expr,
+                    const int * const p_idx_in,
+                    int * const p_idx_out,
+                    Node * const p_node)
+{
+  STATS(++stats.calls_terminal[TERMINAL_SYMBOL]);
   const int i = *p_idx_in;
+  int len = 0;
 
   if (   (reg_expr[i] == '_')
       || (48 <= reg_expr[i] && reg_expr[i] <= 57)   // Digits.
       || (65 <= reg_expr[i] && reg_expr[i] <= 90)   // Caps letters.
       || (97 <= reg_expr[i] && reg_expr[i] <= 122)) // Letters.
+    len = 1;
+  else if (reg_expr[i] == '\\' && reg_expr[i + 1] != '\0') // Escaped byte.
+    len = 2;
+  else if (reg_expr[i] == '[')                      // Byte class.
+    len = class_length(reg_expr, i);
+
+  if (0 < len && len < MAX_CONTENT_LEN)
   {
-    *p_idx_out = i + 1;
-    Node * p_node_symbol = node_new();
-    char s[2];
-    s[0] = reg_expr[i];
-    s[1] = '\0';
-    node_init(p_node_symbol, s);
+    char s[MAX_CONTENT_LEN];
+    memcpy(s, &reg_expr[i], (size_t)len);
+    s[len] = '\0';
+    Node * p_node_symbol = parser_node(p_parser, s);
+    if (NULL == p_node_symbol)
+      return false;
+    *p_idx_out = i + len;
     node_add_child(p_node, p_node_symbol);
     return true;
   }
 
+  expect(p_parser, i, 1u << TERMINAL_SYMBOL);
   return false;
 }
 
-bool lpar (const char *reg_expr,
-           const int * const p_idx_in,
-           int * const p_idx_out,
-           Node * const p_node)
+static bool lpar (Parser * const p_parser,
+                  const char *reg_expr,
+                  const int * const p_idx_in,
+                  int * const p_idx_out,
+                  Node * const p_node)
 {
+  STATS(++stats.calls_terminal[TERMINAL_LPAR]);
   const int i = *p_idx_in;
 
   if (40 == reg_expr[i])
   {
+    Node * p_node_lpar = parser_node(p_parser, "(");
+    if (NULL == p_node_lpar)
+      return false;
     *p_idx_out = i + 1;
-    Node * p_node_lpar = node_new();
-    node_init(p_node_lpar, "(");
     node_add_child(p_node, p_node_lpar);
     return true;
   }
 
+  expect(p_parser, i, 1u << TERMINAL_LPAR);
   return false;
 }
 
-bool rpar (const char *reg_expr,
-           const int * const p_idx_in,
-           int * const p_idx_out,
-           Node * const p_node)
+static bool rpar (Parser * const p_parser,
+                  const char *reg_expr,
+                  const int * const p_idx_in,
+                  int * const p_idx_out,
+                  Node * const p_node)
 {
+  STATS(++stats.calls_terminal[TERMINAL_RPAR]);
   const int i = *p_idx_in;
 
   if (41 == reg_expr[i])
   {
+    Node * p_node_rpar = parser_node(p_parser, ")");
+    if (NULL == p_node_rpar)
+      return false;
     *p_idx_out = i + 1;
-    Node * p_node_rpar = node_new();
-    node_init(p_node_rpar, ")");
     node_add_child(p_node, p_node_rpar);
     return true;
   }
 
+  expect(p_parser, i, 1u << TERMINAL_RPAR);
   return false;
 }
 
-bool star (const char *reg_expr,
-           const int * const p_idx_in,
-           int * const p_idx_out,
-           Node * const p_node)
+static bool star (Parser * const p_parser,
+                  const char *reg_expr,
+                  const int * const p_idx_in,
+                  int * const p_idx_out,
+                  Node * const p_node)
 {
+  STATS(++stats.calls_terminal[TERMINAL_STAR]);
   const int i = *p_idx_in;
 
   if (42 == reg_expr[i])
   {
+    Node * p_node_star = parser_node(p_parser, "*");
+    if (NULL == p_node_star)
+      return false;
     *p_idx_out = i + 1;
-    Node * p_node_star = node_new();
-    node_init(p_node_star, "*");
     node_add_child(p_node, p_node_star);
     return true;
   }
 
+  expect(p_parser, i, 1u << TERMINAL_STAR);
   return false;
 }
 
-bool plus (const char *reg_expr,
-           const int * const p_idx_in,
-           int * const p_idx_out,
-           Node * const p_node)
+static bool plus (Parser * const p_parser,
+                  const char *reg_expr,
+                  const int * const p_idx_in,
+                  int * const p_idx_out,
+                  Node * const p_node)
 {
+  STATS(++stats.calls_terminal[TERMINAL_PLUS]);
   const int i = *p_idx_in;
 
   if (43 == reg_expr[i])
   {
+    Node * p_node_plus = parser_node(p_parser, "+");
+    if (NULL == p_node_plus)
+      return false;
     *p_idx_out = i + 1;
-    Node * p_node_plus = node_new();
-    node_init(p_node_plus, "+");
     node_add_child(p_node, p_node_plus);
     return true;
   }
 
+  expect(p_parser, i, 1u << TERMINAL_PLUS);
   return false;
 }
 
 /**** Variables. ****/
 
+#ifdef RE_STATS
+static void enter (uint64_t *p_calls)
+{
+  ++*p_calls;
+  if (++depth > stats.max_depth)
+    stats.max_depth = depth;
+}
+#endif
+
+static bool RE (Parser * const p_parser,
+                const char *reg_expr,
+                const int * const p_idx_in,
+                int * const p_idx_out,
+                Node * const p_node);
+
+static bool RE_prime (Parser * const p_parser,
+                      const char *reg_expr,
+                      const int * const p_idx_in,
+                      int * const p_idx_out,
+                      Node * const p_node);
+
 // RE' ::= + RE | + RE RE' | RE | RE RE' | * | * RE'.
-bool RE_prime (const char *reg_expr,
-               const int * const p_idx_in,
-               int * const p_idx_out,
-               Node * const p_node)
+static bool RE_prime_alternatives (Parser * const p_parser,
+                                   const char *reg_expr,
+                                   const int * const p_idx_in,
+                                   int * const p_idx_out,
+                                   Node * const p_node)
 {
   int idx_tmp1;
   int idx_tmp2;
 
-  Node * p_RE_prime = node_new();
-  node_init(p_RE_prime, "RE'");
+  Node * p_RE_prime = parser_node(p_parser, "RE'");
+  if (NULL == p_RE_prime)
+    return false;
   node_add_child(p_node, p_RE_prime);
 
   // RE' -> + RE RE'
-  if (plus(reg_expr, p_idx_in, &idx_tmp1, p_RE_prime))
-    if (RE(reg_expr, &idx_tmp1, &idx_tmp2, p_RE_prime))
-      if(RE_prime(reg_expr, &idx_tmp2, p_idx_out, p_RE_prime))
+  STATS(++stats.tried[PRODUCTION_PRIME_PLUS_PRIME]);
+  if (plus(p_parser, reg_expr, p_idx_in, &idx_tmp1, p_RE_prime))
+    if (RE(p_parser, reg_expr, &idx_tmp1, &idx_tmp2, p_RE_prime))
+      if(RE_prime(p_parser, reg_expr, &idx_tmp2, p_idx_out, p_RE_prime))
         return true;
 
-  node_free_children(p_RE_prime);
+  STATS(++stats.failed[PRODUCTION_PRIME_PLUS_PRIME]);
+  parser_free_children(p_parser, p_RE_prime);
 
   // RE' -> + RE.
-  if (plus(reg_expr, p_idx_in, &idx_tmp1, p_RE_prime))
-    if (RE(reg_expr, &idx_tmp1, p_idx_out, p_RE_prime))
+  STATS(++stats.tried[PRODUCTION_PRIME_PLUS]);
+  if (plus(p_parser, reg_expr, p_idx_in, &idx_tmp1, p_RE_prime))
+    if (RE(p_parser, reg_expr, &idx_tmp1, p_idx_out, p_RE_prime))
       return true;
 
-  node_free_children(p_RE_prime);
+  STATS(++stats.failed[PRODUCTION_PRIME_PLUS]);
+  parser_free_children(p_parser, p_RE_prime);
 
   // RE' -> * RE'.
-  if (star(reg_expr, p_idx_in, &idx_tmp1, p_RE_prime))
-    if (RE_prime(reg_expr, &idx_tmp1, p_idx_out, p_RE_prime))
+  STATS(++stats.tried[PRODUCTION_PRIME_STAR_PRIME]);
+  if (star(p_parser, reg_expr, p_idx_in, &idx_tmp1, p_RE_prime))
+    if (RE_prime(p_parser, reg_expr, &idx_tmp1, p_idx_out, p_RE_prime))
       return true;
 
-  node_free_children(p_RE_prime);
+  STATS(++stats.failed[PRODUCTION_PRIME_STAR_PRIME]);
+  parser_free_children(p_parser, p_RE_prime);
 
   // RE' -> RE RE'.
-  if (RE(reg_expr, p_idx_in, &idx_tmp1, p_RE_prime))
-    if (RE_prime(reg_expr, &idx_tmp1, p_idx_out, p_RE_prime))
+  STATS(++stats.tried[PRODUCTION_PRIME_RE_PRIME]);
+  if (RE(p_parser, reg_expr, p_idx_in, &idx_tmp1, p_RE_prime))
+    if (RE_prime(p_parser, reg_expr, &idx_tmp1, p_idx_out, p_RE_prime))
       return true;
 
-  node_free_children(p_RE_prime);
+  STATS(++stats.failed[PRODUCTION_PRIME_RE_PRIME]);
+  parser_free_children(p_parser, p_RE_prime);
 
   // RE' -> RE.
-  if (RE(reg_expr, p_idx_in, p_idx_out, p_RE_prime))
+  STATS(++stats.tried[PRODUCTION_PRIME_RE]);
+  if (RE(p_parser, reg_expr, p_idx_in, p_idx_out, p_RE_prime))
     return true;
 
-  node_free_children(p_RE_prime);
+  STATS(++stats.failed[PRODUCTION_PRIME_RE]);
+  parser_free_children(p_parser, p_RE_prime);
 
   // RE' -> *.
-  if (star(reg_expr, p_idx_in, p_idx_out, p_RE_prime))
+  STATS(++stats.tried[PRODUCTION_PRIME_STAR]);
+  if (star(p_parser, reg_expr, p_idx_in, p_idx_out, p_RE_prime))
     return true;
 
-  node_free_last_child(p_node);  // This is a failure branch, remove it.
+  STATS(++stats.failed[PRODUCTION_PRIME_STAR]);
+  parser_free_last_child(p_parser, p_node);  // This is a failure branch, remove it.
   return false;
 }
 
+static bool RE_prime (Parser * const p_parser,
+                      const char *reg_expr,
+                      const int * const p_idx_in,
+                      int * const p_idx_out,
+                      Node * const p_node)
+{
+  if (++p_parser->steps >= p_parser->next_check && !within_budget(p_parser))
+    return false;
+
+  STATS(enter(&stats.calls_RE_prime));
+  const bool ok = RE_prime_alternatives(p_parser, reg_expr, p_idx_in,
+                                        p_idx_out, p_node);
+  STATS(--depth);
+  return ok;
+}
+
 // RE ::= # | # RE' | symbol | symbol RE' | ( RE ) | ( RE ) RE'.
-bool RE (const char *reg_expr,
-         const int * const p_idx_in,
-         int * const p_idx_out,
-         Node * const p_node)
+static bool RE_alternatives (Parser * const p_parser,
+                             const char *reg_expr,
+                             const int * const p_idx_in,
+                             int * const p_idx_out,
+                             Node * const p_node)
 {
   int idx_tmp1, idx_tmp2, idx_tmp3;
 
-  Node *p_RE = node_new();
-  node_init(p_RE, "RE");
+  Node *p_RE = parser_node(p_parser, "RE");
+  if (NULL == p_RE)
+    return false;
   node_add_child(p_node, p_RE);
 
   // RE -> # RE'.
-  if (epsilon(reg_expr, p_idx_in, &idx_tmp1, p_RE))
-    if (RE_prime(reg_expr, &idx_tmp1, p_idx_out, p_RE))
+  STATS(++stats.tried[PRODUCTION_RE_EPSILON_PRIME]);
+  if (epsilon(p_parser, reg_expr, p_idx_in, &idx_tmp1, p_RE))
+    if (RE_prime(p_parser, reg_expr, &idx_tmp1, p_idx_out, p_RE))
       return true;
 
-  node_free_children(p_RE);
+  STATS(++stats.failed[PRODUCTION_RE_EPSILON_PRIME]);
+  parser_free_children(p_parser, p_RE);
 
   // RE -> symbol RE'.
-  if (symbol(reg_expr, p_idx_in, &idx_tmp1, p_RE))
-    if (RE_prime(reg_expr, &idx_tmp1, p_idx_out, p_RE))
+  STATS(++stats.tried[PRODUCTION_RE_SYMBOL_PRIME]);
+  if (symbol(p_parser, reg_expr, p_idx_in, &idx_tmp1, p_RE))
+    if (RE_prime(p_parser, reg_expr, &idx_tmp1, p_idx_out, p_RE))
       return true;
 
-  node_free_children(p_RE);
+  STATS(++stats.failed[PRODUCTION_RE_SYMBOL_PRIME]);
+  parser_free_children(p_parser, p_RE);
 
   // RE -> ( RE ) RE'.
-  if (lpar(reg_expr, p_idx_in, &idx_tmp1, p_RE))
-    if (RE(reg_expr, &idx_tmp1, &idx_tmp2, p_RE))
-      if (rpar(reg_expr, &idx_tmp2, &idx_tmp3, p_RE))
-        if (RE_prime(reg_expr, &idx_tmp3, p_idx_out, p_RE))
+  STATS(++stats.tried[PRODUCTION_RE_GROUP_PRIME]);
+  if (lpar(p_parser, reg_expr, p_idx_in, &idx_tmp1, p_RE))
+    if (RE(p_parser, reg_expr, &idx_tmp1, &idx_tmp2, p_RE))
+      if (rpar(p_parser, reg_expr, &idx_tmp2, &idx_tmp3, p_RE))
+        if (RE_prime(p_parser, reg_expr, &idx_tmp3, p_idx_out, p_RE))
           return true;
 
-  node_free_children(p_RE);
+  STATS(++stats.failed[PRODUCTION_RE_GROUP_PRIME]);
+  parser_free_children(p_parser, p_RE);
 
   // RE -> ( RE ).
-  if (lpar(reg_expr, p_idx_in, &idx_tmp1, p_RE))
-    if (RE(reg_expr, &idx_tmp1, &idx_tmp2, p_RE))
-      if (rpar(reg_expr, &idx_tmp2, p_idx_out, p_RE))
+  STATS(++stats.tried[PRODUCTION_RE_GROUP]);
+  if (lpar(p_parser, reg_expr, p_idx_in, &idx_tmp1, p_RE))
+    if (RE(p_parser, reg_expr, &idx_tmp1, &idx_tmp2, p_RE))
+      if (rpar(p_parser, reg_expr, &idx_tmp2, p_idx_out, p_RE))
         return true;
 
-  node_free_children(p_RE);
+  STATS(++stats.failed[PRODUCTION_RE_GROUP]);
+  parser_free_children(p_parser, p_RE);
 
   // RE -> #.
-  if (epsilon(reg_expr, p_idx_in, p_idx_out, p_RE))
+  STATS(++stats.tried[PRODUCTION_RE_EPSILON]);
+  if (epsilon(p_parser, reg_expr, p_idx_in, p_idx_out, p_RE))
     return true;
 
-  node_free_children(p_RE);
+  STATS(++stats.failed[PRODUCTION_RE_EPSILON]);
+  parser_free_children(p_parser, p_RE);
 
   // RE -> symbol.
-  if (symbol(reg_expr, p_idx_in, p_idx_out, p_RE))
+  STATS(++stats.tried[PRODUCTION_RE_SYMBOL]);
+  if (symbol(p_parser, reg_expr, p_idx_in, p_idx_out, p_RE))
     return true;
 
-  node_free_last_child(p_node); // This is a failure branch, remove it.
+  STATS(++stats.failed[PRODUCTION_RE_SYMBOL]);
+  parser_free_last_child(p_parser, p_node); // This is a failure branch, remove it.
   return false;
 }
 
-bool parse (const char *reg_expr, Node *p_node)
+static bool RE (Parser * const p_parser,
+                const char *reg_expr,
+                const int * const p_idx_in,
+                int * const p_idx_out,
+                Node * const p_node)
+{
+  if (++p_parser->steps >= p_parser->next_check && !within_budget(p_parser))
+    return false;
+
+  STATS(enter(&stats.calls_RE));
+  const bool ok = RE_alternatives(p_parser, reg_expr, p_idx_in, p_idx_out,
+                                  p_node);
+  STATS(--depth);
+  return ok;
+}
+
+Parser * parser_new (void)
+{
+  Parser * const p_parser = malloc(sizeof(Parser));
+  if (NULL != p_parser)
+    parser_init(p_parser);
+  return p_parser;
+}
+
+void parser_free (Parser * const p_parser)
+{
+  free(p_parser);
+}
+
+void parser_set_budget (Parser * const p_parser,
+                        const ParseBudget * const p_budget)
+{
+  if (NULL != p_budget)
+    p_parser->budget = *p_budget;
+  else
+    memset(&p_parser->budget, 0, sizeof(ParseBudget));
+}
+
+ParseStatus parser_parse (Parser * const p_parser,
+                          const char *reg_expr,
+                          Node * const p_node,
+                          SyntaxError * const p_error)
 {
+  const uint64_t t = trace_begin();
+  const ParseBudget * const p_budget = &p_parser->budget;
   int start_index = 0;
   int end_index = 0;
 
+  memset(&p_parser->profile, 0, sizeof(AllocProfile));
+  memset(&p_parser->error, 0, sizeof(SyntaxError));
+  p_parser->steps = 0;
+  p_parser->status = PARSE_OK;
+  p_parser->start = (0 < p_budget->max_seconds) ? now() : 0;
+  p_parser->next_check = (0 != p_budget->max_steps || 0 != p_budget->max_nodes
+                          || 0 < p_budget->max_seconds)
+                         ? PARSE_CHECK_INTERVAL : UINT64_MAX;
+
   node_init(p_node, "Root");
+  ++p_parser->profile.nodes[LABEL_ROOT];
 
-  if (RE(reg_expr, &start_index , &end_index, p_node))
+  // Once stopped, RE' may still end on a '*': the tree is not the parse.
+  const bool ok = RE(p_parser, reg_expr, &start_index, &end_index, p_node);
+  if (PARSE_OK == p_parser->status && !ok)
   {
-    if ('\0' != reg_expr[end_index])
-      printf("Parser is not working properly: input characters left\n");
-    else
-      return true;
+    p_parser->status = PARSE_SYNTAX_ERROR;
   }
-  else
+  else if (PARSE_OK == p_parser->status && '\0' != reg_expr[end_index])
   {
-    printf("Unexpected character '%c' in position %d\n",
-           reg_expr[end_index], end_index);
+    // RE stops at an unmatched ')'.
+    expect(p_parser, end_index, PARSE_EXPECTED_END);
+    p_parser->status = PARSE_SYNTAX_ERROR;
   }
 
-  return false;
+  if (PARSE_OK != p_parser->status)
+    parser_free_children(p_parser, p_node);
+  if (NULL != p_error)
+    *p_error = p_parser->error;
+
+  trace_end(TRACE_PARSE, t);
+  return p_parser->status;
+}
+
+void parser_profile (const Parser * const p_parser,
+                     AllocProfile * const p_profile)
+{
+  *p_profile = p_parser->profile;
+}
+
+bool parse (const char *reg_expr, Node *p_node)
+{
+  Parser parser;
+
+  parser_init(&parser);
+  return PARSE_OK == parser_parse(&parser, reg_expr, p_node, NULL);
 }
 
-int main (int argc, char **argv)
+const char * parse_status_name (ParseStatus status)
 {
-  // Input checks.
-  if (argc != 2)
+  static const char * const names [] =
   {
-    printf("Wrong number of command-line arguments: ");
-    printf("%d arguments found, %d expected\n", argc -1, 1);
-    return 1;
-  }
+    "ok", "syntax error", "step budget exceeded", "node budget exceeded",
+    "deadline exceeded", "out of memory"
+  };
 
-  Node tree;
+  return names[status];
+}
 
-  if (parse(argv[1], &tree))
+char * parse_error_message (const SyntaxError * const p_error,
+                            const char *reg_expr,
+                            char *buffer,
+                            size_t size)
+{
+  static const char * const names [N_TERMINALS + 1] =
   {
-    node_print(tree.children[0], 0);
+    "'#'", "a symbol", "'('", "')'", "'*'", "'+'", "the end"
+  };
+  const int i = p_error->position;
+  const char *separator = ", expected ";
+  int len;
 
-    FILE *fp = fopen("RE_parse_tree.txt", "w");
-    if (NULL != fp)
-    {
-      node_save(tree.children[0], fp, 0);
-      fclose(fp);
-    }
-    else
+  if (0 == size)
+    return buffer;
+
+  if ('\0' == reg_expr[i])
+    len = snprintf(buffer, size, "Unexpected end in position %d", i);
+  else
+    len = snprintf(buffer, size, "Unexpected character '%c' in position %d",
+                   reg_expr[i], i);
+
+  for (int t = 0; t <= N_TERMINALS && 0 <= len && (size_t)len < size; ++t)
+  {
+    if (0 != (p_error->expected & (1u << t)))
     {
-      printf("Cannot create file\n");
+      len += snprintf(buffer + len, size - (size_t)len, "%s%s", separator,
+                      names[t]);
+      separator = ", ";
     }
   }
-  else
+
+  return buffer;
+}
+
+// Parse again the inner RE of the group p_node, whose '(' is at start: the
+// parse of the group is unchanged if the new one still ends at its ')'.
+static bool reparse_inner (Parser * const p_parser,
+                           const char *reg_expr,
+                           Node * const p_node,
+                           int start,
+                           int delta)
+{
+  const int rpar = start + 1 + node_width(p_node->children[1]);
+  const int idx_in = start + 1;
+  int idx_out = 0;
+  bool done = false;
+
+  Node * p_tmp = node_new();
+  if (NULL == p_tmp)
+    return false;
+  node_init(p_tmp, "Root");
+
+  if (RE(p_parser, reg_expr, &idx_in, &idx_out, p_tmp)
+      && rpar + delta == idx_out)
+  {
+    node_free(p_node->children[1]);
+    p_node->children[1] = p_tmp->children[0];
+    p_tmp->children[0] = NULL;
+    done = true;
+  }
+
+  node_free(p_tmp);
+  return done;
+}
+
+// Reparse the innermost group ( RE ) below p_node, which starts at start,
+// that encloses the edited bytes [offset, end), or the next enclosing one if
+// it no longer ends at the same ')'.
+static bool reparse_group (Parser * const p_parser,
+                           const char *reg_expr,
+                           Node * const p_node,
+                           int start,
+                           int offset,
+                           int end,
+                           int delta)
+{
+  const bool is_group = NULL != p_node->children[0]
+                        && 0 == strcmp(p_node->children[0]->content, "(");
+  int child_start = start;
+  bool done = false;
+
+  for (int i = 0; !done && i < MAX_CHILDREN && NULL != p_node->children[i]; ++i)
+  {
+    const int child_end = child_start + node_width(p_node->children[i]);
+
+    if (child_start < offset && end < child_end)
+      done = reparse_group(p_parser, reg_expr, p_node->children[i],
+                           child_start, offset, end, delta);
+    if (!done && is_group && 1 == i && child_start <= offset && end <= child_end)
+      done = reparse_inner(p_parser, reg_expr, p_node, start, delta);
+
+    child_start = child_end;
+  }
+
+  if (done)
+    p_node->width = -1;
+  return done;
+}
+
+// reg_expr is the expression where text_len bytes replaced delete_len bytes at
+// offset, and p_node the parse tree of the expression before the edit.  The
+// subtrees outside of the group reparsed are kept.
+bool reparse (const char *reg_expr,
+              Node * const p_node,
+              int offset,
+              int delete_len,
+              int text_len,
+              bool * const p_incremental)
+{
+  Parser parser;
+
+  parser_init(&parser);
+  *p_incremental = NULL != p_node->children[0]
+                   && reparse_group(&parser, reg_expr, p_node, 0, offset,
+                                    offset + delete_len, text_len - delete_len);
+  if (*p_incremental)
+    return true;
+
+  node_free_children(p_node);
+  return parse(reg_expr, p_node);
+}
+
+/**** Statistics. ****/
+
+static const char * const terminal_names [N_TERMINALS] =
+{
+  "epsilon", "symbol", "lpar", "rpar", "star", "plus"
+};
+
+static const char * const production_names [N_PRODUCTIONS] =
+{
+  "RE -> # RE'", "RE -> symbol RE'", "RE -> ( RE ) RE'", "RE -> ( RE )",
+  "RE -> #", "RE -> symbol", "RE' -> + RE RE'", "RE' -> + RE",
+  "RE' -> * RE'", "RE' -> RE RE'", "RE' -> RE", "RE' -> *"
+};
+
+bool parse_stats_enabled (void)
+{
+#ifdef RE_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+void parse_stats_reset (void)
+{
+#ifdef RE_STATS
+  memset(&stats, 0, sizeof(ParseStats));
+#endif
+}
+
+// Zeros when the counters are compiled out.
+void parse_stats_get (ParseStats * const p_stats)
+{
+#ifdef RE_STATS
+  *p_stats = stats;
+#else
+  memset(p_stats, 0, sizeof(ParseStats));
+#endif
+}
+
+void parse_stats_add (ParseStats * const p_total,
+                      const ParseStats * const p_stats)
+{
+  p_total->calls_RE += p_stats->calls_RE;
+  p_total->calls_RE_prime += p_stats->calls_RE_prime;
+  for (int t = 0; t < N_TERMINALS; ++t)
+    p_total->calls_terminal[t] += p_stats->calls_terminal[t];
+  for (int p = 0; p < N_PRODUCTIONS; ++p)
   {
-    printf("Syntax error\n");
+    p_total->tried[p] += p_stats->tried[p];
+    p_total->failed[p] += p_stats->failed[p];
   }
+  p_total->nodes_new += p_stats->nodes_new;
+  p_total->nodes_freed += p_stats->nodes_freed;
+  p_total->bytes_allocated += p_stats->bytes_allocated;
+  if (p_stats->max_depth > p_total->max_depth)
+    p_total->max_depth = p_stats->max_depth;
+}
+
+void parse_stats_print (const ParseStats * const p_stats, FILE *fp)
+{
+  fprintf(fp, "RE calls: %" PRIu64 ", RE' calls: %" PRIu64
+          ", max depth: %d\n", p_stats->calls_RE, p_stats->calls_RE_prime,
+          p_stats->max_depth);
+  fprintf(fp, "nodes: %" PRIu64 " new, %" PRIu64 " freed, %" PRIu64
+          " bytes allocated\n", p_stats->nodes_new, p_stats->nodes_freed,
+          p_stats->bytes_allocated);
+
+  fprintf(fp, "terminal calls:");
+  for (int t = 0; t < N_TERMINALS; ++t)
+    fprintf(fp, " %s %" PRIu64 "%s", terminal_names[t],
+            p_stats->calls_terminal[t], (t + 1 < N_TERMINALS) ? "," : "\n");
+
+  fprintf(fp, "%-18s %12s %12s\n", "alternative", "tried", "failed");
+  for (int p = 0; p < N_PRODUCTIONS; ++p)
+    fprintf(fp, "%-18s %12" PRIu64 " %12" PRIu64 "\n", production_names[p],
+            p_stats->tried[p], p_stats->failed[p]);
+}
+
+/**** Allocation profile. ****/
 
-  node_free_children(&tree);
+static const char * const label_names [N_LABELS] =
+{
+  "Root", "RE", "RE'", "#", "symbol", "(", ")", "*", "+"
+};
+
+void alloc_profile_add (AllocProfile * const p_total,
+                        const AllocProfile * const p_profile)
+{
+  p_total->n_allocs += p_profile->n_allocs;
+  p_total->n_frees += p_profile->n_frees;
+  p_total->bytes_allocated += p_profile->bytes_allocated;
+  p_total->live_bytes += p_profile->live_bytes;
+  if (p_profile->peak_bytes > p_total->peak_bytes)
+    p_total->peak_bytes = p_profile->peak_bytes;
+  for (int l = 0; l < N_LABELS; ++l)
+    p_total->nodes[l] += p_profile->nodes[l];
+}
 
-  return 0;
+void alloc_profile_print (const AllocProfile * const p_profile, FILE *fp)
+{
+  fprintf(fp, "allocations: %" PRIu64 " (%" PRIu64 " bytes), %" PRIu64
+          " freed, %" PRId64 " bytes live, %" PRId64 " bytes peak\n",
+          p_profile->n_allocs, p_profile->bytes_allocated, p_profile->n_frees,
+          p_profile->live_bytes, p_profile->peak_bytes);
+
+  fprintf(fp, "nodes by label:");
+  for (int l = 0; l < N_LABELS; ++l)
+    fprintf(fp, " %s %" PRIu64 "%s", label_names[l], p_profile->nodes[l],
+            (l + 1 < N_LABELS) ? "," : "\n");
 }
@@ -7,11 +7,27 @@
  *  Left recursion removal:
  *  RE  ::= # | # RE' | symbol | symbol RE' | ( RE ) | ( RE ) RE',
  *  RE' ::= + RE | + RE RE' | RE | RE RE' | * | * RE'.
+ *
+ *  symbol ::= [_0-9A-Za-z] | \ byte | [ class ] | [ ^ class ].
+ *
+ *  RE parses the same way at a given index whatever precedes it, and never
+ *  past an unmatched ')': after an edit inside a group ( RE ), only that
+ *  group needs to be parsed again, as long as it still ends at its ')'.
+ *
+ *  The parser, with the automata and compiled images, is also built as a
+ *  library, libRE.a and libRE.so.  The state of a parse is in its Parser:
+ *  a Parser is used by one thread at a time, and parsers on different
+ *  threads do not share anything.  The library has no global state, but for
+ *  the counters of builds with RE_STATS, which are per thread, and the trace
+ *  once trace_start is called (see RE_trace.h).  Parsing does no I/O: errors
+ *  are returned in a SyntaxError, for the caller to report.
  */
 
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
 /**** Parse tree functions and data structures. ****/
@@ -24,68 +40,196 @@ void node_init(Node * const p_node, const char *s);
 
 void node_add_child(Node * const p_node, Node * const p_child);
 
+const char * node_content(const Node * const p_node);
+
+Node * node_child(const Node * const p_node, int i);
+
 void node_free(Node * p_node);
 
 void node_free_last_child(Node * const p_node);
 
 void node_free_children(Node * const p_node);
 
+int node_width (Node * const p_node);
+
 void node_print (const Node * const p_node, int indent);
 
 void node_save (Node *p_node, FILE *fp, int indent);
 
-/**** Terminals. ****/
-
-bool epsilon(
-  const char *rexpr,
-  const int *p_idx_int,
-  int * const p_idx_out,
-  Node * const p_node);
-
-bool symbol(
-  const char *rexpr,
-  const int *p_idx_int,
-  int * const p_idx_out,
-  Node * const p_node);
-
-bool lpar(
-  const char *rexpr,
-  const int *p_idx_int,
-  int * const p_idx_out,
-  Node * const p_node);
+/**** Parse. ****/
 
-bool rpar(
-  const char *rexpr,
-  const int *p_idx_int,
-  int * const p_idx_out,
-  Node * const p_node);
-
-bool star(
-  const char *rexpr,
-  const int *p_idx_int,
-  int * const p_idx_out,
-  Node * const p_node);
-
-bool plus(
-  const char *rexpr,
-  const int *p_idx_int,
-  int * const p_idx_out,
-  Node * const p_node);
-
-/**** Variables. ****/
-
-bool RE_prime(
-  const char *rexpr,
-  const int *p_idx_int,
-  int * const p_idx_out,
-  Node * const p_node);
-
-bool RE(
+// Parse rexpr in the tree p_node, without limits, with a parser of its own.
+bool parse (
   const char *rexpr,
-  const int *p_idx_int,
-  int * const p_idx_out,
   Node * const p_node);
 
-bool parse (
+bool reparse (
   const char *rexpr,
-  Node * const p_node);
+  Node * const p_node,
+  int offset,
+  int delete_len,
+  int text_len,
+  bool * const p_incremental);
+
+/**** Statistics. ****/
+
+// Counters of the parses run by a thread, kept only in builds with RE_STATS
+// defined: the other builds pay nothing for them.
+
+typedef enum
+{
+  TERMINAL_EPSILON,
+  TERMINAL_SYMBOL,
+  TERMINAL_LPAR,
+  TERMINAL_RPAR,
+  TERMINAL_STAR,
+  TERMINAL_PLUS,
+  N_TERMINALS
+} Terminal;
+
+typedef enum
+{
+  PRODUCTION_RE_EPSILON_PRIME,
+  PRODUCTION_RE_SYMBOL_PRIME,
+  PRODUCTION_RE_GROUP_PRIME,
+  PRODUCTION_RE_GROUP,
+  PRODUCTION_RE_EPSILON,
+  PRODUCTION_RE_SYMBOL,
+  PRODUCTION_PRIME_PLUS_PRIME,
+  PRODUCTION_PRIME_PLUS,
+  PRODUCTION_PRIME_STAR_PRIME,
+  PRODUCTION_PRIME_RE_PRIME,
+  PRODUCTION_PRIME_RE,
+  PRODUCTION_PRIME_STAR,
+  N_PRODUCTIONS
+} Production;
+
+typedef struct
+{
+  uint64_t calls_RE;
+  uint64_t calls_RE_prime;
+  uint64_t calls_terminal [N_TERMINALS];
+  uint64_t tried          [N_PRODUCTIONS]; // Alternatives entered.
+  uint64_t failed         [N_PRODUCTIONS]; // Alternatives backtracked from.
+  uint64_t nodes_new;
+  uint64_t nodes_freed;
+  uint64_t bytes_allocated;
+  int      max_depth;                      // Nested RE and RE' calls.
+} ParseStats;
+
+bool parse_stats_enabled (void);
+
+void parse_stats_reset (void);
+
+void parse_stats_get (ParseStats * const p_stats);
+
+// Add the counters of another thread to a total, the depth being the
+// largest one.
+void parse_stats_add (ParseStats * const p_total,
+                      const ParseStats * const p_stats);
+
+void parse_stats_print (const ParseStats * const p_stats, FILE *fp);
+
+/**** Allocation profile. ****/
+
+// Node allocations of a parse.  Unlike the counters above they are always
+// kept, as a node allocation already costs a malloc.
+
+typedef enum
+{
+  LABEL_ROOT,
+  LABEL_RE,
+  LABEL_RE_PRIME,
+  LABEL_EPSILON,
+  LABEL_SYMBOL,
+  LABEL_LPAR,
+  LABEL_RPAR,
+  LABEL_STAR,
+  LABEL_PLUS,
+  N_LABELS
+} Label;
+
+typedef struct
+{
+  uint64_t n_allocs;
+  uint64_t n_frees;
+  uint64_t bytes_allocated;
+  int64_t  live_bytes;        // At the end of the parse.
+  int64_t  peak_bytes;        // Most bytes live at once during the parse.
+  uint64_t nodes [N_LABELS];  // Nodes initialized, by label.
+} AllocProfile;
+
+// Add the profile of a parse to a total, the peak being the largest one.
+void alloc_profile_add (AllocProfile * const p_total,
+                        const AllocProfile * const p_profile);
+
+void alloc_profile_print (const AllocProfile * const p_profile, FILE *fp);
+
+/**** Parsers. ****/
+
+// The parser backtracks exponentially, so a short hostile expression can
+// take minutes.  A budget bounds the steps of a parse (calls to RE and RE'),
+// its nodes live at once and its time, 0 being no limit.  The budget is
+// checked every PARSE_CHECK_INTERVAL steps: past it, every RE and RE' fails,
+// the parse unwinds and its nodes are freed.  A failed allocation ends the
+// parse the same way.
+
+#define PARSE_CHECK_INTERVAL 1024
+
+#define PARSE_EXPECTED_END (1u << N_TERMINALS) // The end of the expression.
+
+typedef enum
+{
+  PARSE_OK,
+  PARSE_SYNTAX_ERROR,
+  PARSE_STEPS_EXCEEDED,
+  PARSE_NODES_EXCEEDED,
+  PARSE_DEADLINE_EXCEEDED,
+  PARSE_OUT_OF_MEMORY
+} ParseStatus;
+
+typedef struct
+{
+  uint64_t max_steps;
+  uint64_t max_nodes;
+  double   max_seconds;
+} ParseBudget;
+
+// Where a syntax error is: the furthest byte the parse could not go past,
+// and what it tried there.
+typedef struct
+{
+  int      position;
+  uint32_t expected; // Bits 1 << Terminal, and PARSE_EXPECTED_END.
+} SyntaxError;
+
+typedef struct Parser Parser;
+
+// A parser without a budget, or NULL when out of memory.
+Parser * parser_new (void);
+
+void parser_free (Parser * const p_parser);
+
+// The budget of the next parses, none when p_budget is NULL.
+void parser_set_budget (Parser * const p_parser,
+                        const ParseBudget * const p_budget);
+
+// Parse rexpr in the tree p_node, which is left empty unless the parse
+// succeeds.  On a syntax error, *p_error is where it is.
+ParseStatus parser_parse (Parser * const p_parser,
+                          const char *rexpr,
+                          Node * const p_node,
+                          SyntaxError * const p_error);
+
+// Allocations of the last parse.
+void parser_profile (const Parser * const p_parser,
+                     AllocProfile * const p_profile);
+
+const char * parse_status_name (ParseStatus status);
+
+// Write the message of a syntax error of rexpr in buffer, truncated to size
+// bytes.  Returns buffer.
+char * parse_error_message (const SyntaxError * const p_error,
+                            const char *rexpr,
+                            char *buffer,
+                            size_t size);
@@ -0,0 +1,308 @@
+/*
+ *  Sharded LRU cache of compiled regular expressions.
+ */
+
+#include "RE_regex_cache.h"
+#include "RE_cache.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_BUCKETS 64
+
+typedef struct Entry Entry;
+
+struct Entry
+{
+  Compiled   compiled;  // First member: handles point here.
+  Entry    * hash_next;
+  Entry    * prev;      // LRU list, most recently used first.
+  Entry    * next;
+  uint64_t   hash;
+  size_t     bytes;
+  int        refs;      // References handed out, plus one while cached.
+  size_t     key_len;
+  char       key [];
+};
+
+typedef struct
+{
+  pthread_mutex_t lock;
+  Entry        ** buckets;
+  size_t          n_buckets;
+  size_t          entries;
+  size_t          bytes;
+  size_t          budget;
+  Entry           lru;      // Sentinel of the LRU list.
+  uint64_t        hits;
+  uint64_t        misses;
+  uint64_t        evictions;
+} Shard;
+
+struct RegexCache
+{
+  Shard shards [REGEX_CACHE_SHARDS];
+};
+
+static void entry_free (Entry *p_entry)
+{
+  compiled_free(&p_entry->compiled);
+  free(p_entry);
+}
+
+static void lru_unlink (Entry * const p_entry)
+{
+  p_entry->prev->next = p_entry->next;
+  p_entry->next->prev = p_entry->prev;
+}
+
+static void lru_push_front (Shard * const p_shard, Entry * const p_entry)
+{
+  p_entry->prev = &p_shard->lru;
+  p_entry->next = p_shard->lru.next;
+  p_shard->lru.next->prev = p_entry;
+  p_shard->lru.next = p_entry;
+}
+
+static Entry ** find_slot (Shard * const p_shard,
+                           uint64_t hash,
+                           const char *key,
+                           size_t key_len)
+{
+  Entry **pp = &p_shard->buckets[hash & (p_shard->n_buckets - 1)];
+
+  for (; NULL != *pp; pp = &(*pp)->hash_next)
+    if ((*pp)->hash == hash && (*pp)->key_len == key_len
+        && 0 == memcmp((*pp)->key, key, key_len))
+      break;
+
+  return pp;
+}
+
+static void grow_buckets (Shard * const p_shard)
+{
+  const size_t n = 2 * p_shard->n_buckets;
+  Entry **p_buckets = calloc(n, sizeof(Entry *));
+  if (NULL == p_buckets)
+    return; // Keep the longer chains.
+
+  for (size_t b = 0; b < p_shard->n_buckets; ++b)
+  {
+    Entry *p_entry = p_shard->buckets[b];
+    while (NULL != p_entry)
+    {
+      Entry * const p_next = p_entry->hash_next;
+      p_entry->hash_next = p_buckets[p_entry->hash & (n - 1)];
+      p_buckets[p_entry->hash & (n - 1)] = p_entry;
+      p_entry = p_next;
+    }
+  }
+
+  free(p_shard->buckets);
+  p_shard->buckets = p_buckets;
+  p_shard->n_buckets = n;
+}
+
+// Drop one reference, the last one frees the entry.
+static void unref (Entry * const p_entry)
+{
+  if (0 == --p_entry->refs)
+    entry_free(p_entry);
+}
+
+// Remove the least recently used entries until the shard fits its budget.
+static void evict (Shard * const p_shard)
+{
+  while (p_shard->bytes > p_shard->budget && p_shard->lru.prev != &p_shard->lru)
+  {
+    Entry * const p_old = p_shard->lru.prev;
+    *find_slot(p_shard, p_old->hash, p_old->key, p_old->key_len) =
+      p_old->hash_next;
+    lru_unlink(p_old);
+    p_shard->bytes -= p_old->bytes;
+    --p_shard->entries;
+    ++p_shard->evictions;
+    unref(p_old);
+  }
+}
+
+RegexCache * regex_cache_new (size_t byte_budget)
+{
+  RegexCache *p_cache = calloc(1, sizeof(RegexCache));
+  if (NULL == p_cache)
+    return NULL;
+
+  for (int i = 0; i < REGEX_CACHE_SHARDS; ++i)
+  {
+    Shard * const p_shard = &p_cache->shards[i];
+    pthread_mutex_init(&p_shard->lock, NULL);
+    p_shard->n_buckets = INITIAL_BUCKETS;
+    p_shard->buckets = calloc(INITIAL_BUCKETS, sizeof(Entry *));
+    p_shard->budget = byte_budget / REGEX_CACHE_SHARDS;
+    p_shard->lru.prev = &p_shard->lru;
+    p_shard->lru.next = &p_shard->lru;
+    if (NULL == p_shard->buckets)
+    {
+      p_shard->n_buckets = 0;
+      regex_cache_free(p_cache);
+      return NULL;
+    }
+  }
+
+  return p_cache;
+}
+
+// Every reference must have been released before.
+void regex_cache_free (RegexCache * p_cache)
+{
+  if (NULL == p_cache)
+    return;
+
+  for (int i = 0; i < REGEX_CACHE_SHARDS; ++i)
+  {
+    Shard * const p_shard = &p_cache->shards[i];
+    p_shard->budget = 0;
+    if (0 != p_shard->n_buckets)
+      evict(p_shard);
+    free(p_shard->buckets);
+    pthread_mutex_destroy(&p_shard->lock);
+  }
+
+  free(p_cache);
+}
+
+static Shard * shard_of (RegexCache * const p_cache, uint64_t hash)
+{
+  return &p_cache->shards[(hash >> 32) % REGEX_CACHE_SHARDS];
+}
+
+const Compiled * regex_cache_get (RegexCache * const p_cache,
+                                  const char *rexpr)
+{
+  const size_t key_len = strlen(rexpr);
+  const uint64_t hash = hash_bytes(rexpr, key_len, 0);
+  Shard * const p_shard = shard_of(p_cache, hash);
+
+  pthread_mutex_lock(&p_shard->lock);
+  Entry * const p_entry = *find_slot(p_shard, hash, rexpr, key_len);
+  if (NULL != p_entry)
+  {
+    lru_unlink(p_entry);
+    lru_push_front(p_shard, p_entry);
+    ++p_entry->refs;
+    ++p_shard->hits;
+  }
+  else
+  {
+    ++p_shard->misses;
+  }
+  pthread_mutex_unlock(&p_shard->lock);
+
+  return (NULL != p_entry) ? &p_entry->compiled : NULL;
+}
+
+const Compiled * regex_cache_put (RegexCache * const p_cache,
+                                  const char *rexpr,
+                                  Compiled * const p_compiled)
+{
+  const size_t key_len = strlen(rexpr);
+  const uint64_t hash = hash_bytes(rexpr, key_len, 0);
+  Shard * const p_shard = shard_of(p_cache, hash);
+  Entry * const p_entry = malloc(sizeof(Entry) + key_len);
+
+  if (NULL == p_entry)
+  {
+    compiled_free(p_compiled);
+    return NULL;
+  }
+
+  p_entry->compiled = *p_compiled;
+  memcpy(p_entry->key, rexpr, key_len);
+  p_entry->key_len = key_len;
+  p_entry->hash = hash;
+  p_entry->bytes = sizeof(Entry) + key_len + p_entry->compiled.size;
+  p_entry->refs = 2;
+
+  pthread_mutex_lock(&p_shard->lock);
+  Entry ** const pp_slot = find_slot(p_shard, hash, rexpr, key_len);
+  if (NULL != *pp_slot)
+  {
+    // Another thread put it meanwhile, use its copy.
+    Entry * const p_other = *pp_slot;
+    ++p_other->refs;
+    pthread_mutex_unlock(&p_shard->lock);
+    entry_free(p_entry);
+    return &p_other->compiled;
+  }
+
+  p_entry->hash_next = NULL;
+  *pp_slot = p_entry;
+  lru_push_front(p_shard, p_entry);
+  p_shard->bytes += p_entry->bytes;
+  ++p_shard->entries;
+  evict(p_shard);
+  if (p_shard->entries > 2 * p_shard->n_buckets)
+    grow_buckets(p_shard);
+  pthread_mutex_unlock(&p_shard->lock);
+
+  return &p_entry->compiled;
+}
+
+const Compiled * regex_cache_compile (RegexCache * const p_cache,
+                                      const char *rexpr)
+{
+  const Compiled * const p_cached = regex_cache_get(p_cache, rexpr);
+  Compiled compiled;
+
+  if (NULL != p_cached)
+    return p_cached;
+
+  // Compile without holding the lock.
+  if (!compile(rexpr, &compiled))
+    return NULL;
+
+  return regex_cache_put(p_cache, rexpr, &compiled);
+}
+
+void regex_cache_release (RegexCache * const p_cache,
+                          const Compiled * p_compiled)
+{
+  if (NULL == p_compiled)
+    return;
+
+  Entry * const p_entry = (Entry *)p_compiled;
+  Shard * const p_shard = shard_of(p_cache, p_entry->hash);
+
+  pthread_mutex_lock(&p_shard->lock);
+  unref(p_entry);
+  pthread_mutex_unlock(&p_shard->lock);
+}
+
+void regex_cache_stats (RegexCache * const p_cache,
+                        RegexCacheStats * const p_stats)
+{
+  memset(p_stats, 0, sizeof(RegexCacheStats));
+
+  for (int i = 0; i < REGEX_CACHE_SHARDS; ++i)
+  {
+    Shard * const p_shard = &p_cache->shards[i];
+    pthread_mutex_lock(&p_shard->lock);
+    p_stats->hits += p_shard->hits;
+    p_stats->misses += p_shard->misses;
+    p_stats->evictions += p_shard->evictions;
+    p_stats->entries += p_shard->entries;
+    p_stats->bytes += p_shard->bytes;
+    pthread_mutex_unlock(&p_shard->lock);
+  }
+}
+
+void regex_cache_stats_print (const RegexCacheStats * const p_stats, FILE *fp)
+{
+  fprintf(fp, "regex cache: %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64
+          " evictions, %zu entries, %zu bytes\n", p_stats->hits,
+          p_stats->misses, p_stats->evictions, p_stats->entries,
+          p_stats->bytes);
+}
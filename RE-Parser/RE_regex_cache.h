@@ -0,0 +1,64 @@
+/*
+ *  In-process cache of compiled regular expressions, for the programs that
+ *  compile the same patterns over and over.
+ *
+ *  Patterns are keyed by their bytes and spread over REGEX_CACHE_SHARDS
+ *  shards by hash, each one with its own lock, hash table and LRU list, so
+ *  that threads compiling different patterns rarely contend.  Each shard
+ *  gets an equal part of the byte budget, and evicts its least recently used
+ *  entries to stay within it.
+ *
+ *  regex_cache_compile() returns a reference to the compiled pattern, that
+ *  stays valid until it is given back with regex_cache_release(), even if
+ *  the entry is evicted meanwhile.  Callers that compile in their own way,
+ *  with a parse budget or through the disk cache, use regex_cache_get() and
+ *  regex_cache_put() instead.  All the functions are thread-safe.
+ */
+
+#pragma once
+
+#include "RE_compiled.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define REGEX_CACHE_SHARDS 16
+
+typedef struct RegexCache RegexCache;
+
+typedef struct
+{
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  size_t   entries;
+  size_t   bytes;
+} RegexCacheStats;
+
+RegexCache * regex_cache_new (size_t byte_budget);
+
+void regex_cache_free (RegexCache * p_cache);
+
+// A reference to the cached pattern, or NULL on a miss.
+const Compiled * regex_cache_get (RegexCache * const p_cache,
+                                  const char *rexpr);
+
+// Cache *p_compiled, which the cache takes over, and return a reference to
+// it, or to the copy another thread put meanwhile.  NULL when out of memory,
+// *p_compiled being freed.
+const Compiled * regex_cache_put (RegexCache * const p_cache,
+                                  const char *rexpr,
+                                  Compiled * const p_compiled);
+
+// regex_cache_get, compiling and putting the pattern on a miss.
+const Compiled * regex_cache_compile (RegexCache * const p_cache,
+                                      const char *rexpr);
+
+void regex_cache_release (RegexCache * const p_cache,
+                          const Compiled * p_compiled);
+
+void regex_cache_stats (RegexCache * const p_cache,
+                        RegexCacheStats * const p_stats);
+
+void regex_cache_stats_print (const RegexCacheStats * const p_stats, FILE *fp);
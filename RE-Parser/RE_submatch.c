@@ -0,0 +1,382 @@
+/*
+ *  Submatch extraction with a one-pass DFA, or a Pike VM on the tagged NFA.
+ */
+
+#include "RE_submatch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int submatcher_n_slots (const Submatcher * const p_sm)
+{
+  return 2 * (p_sm->nfa.n_groups + 1);
+}
+
+void submatcher_free (Submatcher * const p_sm)
+{
+  nfa_free(&p_sm->nfa);
+  free(p_sm->next);
+  free(p_sm->actions);
+  free(p_sm->accept);
+  free(p_sm->accept_actions);
+  memset(p_sm, 0, sizeof(Submatcher));
+}
+
+/**** One-pass DFA. ****/
+
+typedef struct
+{
+  int      state;
+  uint32_t actions;
+} Path;
+
+// Node of the one-pass DFA for NFA state s, created on first use.
+static int node_of (Submatcher * const p_sm,
+                    int *p_node_state,
+                    int *p_state_node,
+                    int s)
+{
+  if (p_state_node[s] < 0)
+  {
+    p_state_node[s] = p_sm->n_nodes;
+    p_node_state[p_sm->n_nodes++] = s;
+  }
+  return p_state_node[s];
+}
+
+// Follow every epsilon path from each node.  Each byte class may start at
+// most one transition, and at most one path may reach an accepting state,
+// otherwise the expression is not one-pass.  Paths meeting in the same state
+// are rejected as well, to keep the capture actions unambiguous.
+static bool build_one_pass (Submatcher * const p_sm)
+{
+  const Nfa * const p_nfa = &p_sm->nfa;
+  const int n_states = p_nfa->n_states;
+  const int n_classes = p_sm->classes.n_classes;
+  int *p_node_state = malloc((size_t)n_states * sizeof(int));
+  int *p_state_node = malloc((size_t)n_states * sizeof(int));
+  int *p_seen = malloc((size_t)n_states * sizeof(int));
+  Path *p_stack = malloc((2 * (size_t)n_states + 1) * sizeof(Path));
+  bool ok = NULL != p_node_state && NULL != p_state_node
+            && NULL != p_seen && NULL != p_stack
+            && submatcher_n_slots(p_sm) <= ONE_PASS_MAX_SLOTS;
+
+  // There are at most one node per NFA state.
+  if (ok)
+  {
+    p_sm->next = malloc((size_t)n_states * (size_t)n_classes * sizeof(int32_t));
+    p_sm->actions = malloc((size_t)n_states * (size_t)n_classes * sizeof(uint32_t));
+    p_sm->accept = calloc((size_t)n_states, sizeof(bool));
+    p_sm->accept_actions = calloc((size_t)n_states, sizeof(uint32_t));
+    ok = NULL != p_sm->next && NULL != p_sm->actions
+         && NULL != p_sm->accept && NULL != p_sm->accept_actions;
+  }
+
+  if (ok)
+  {
+    for (int s = 0; s < n_states; ++s)
+    {
+      p_state_node[s] = -1;
+      p_seen[s] = -1;
+    }
+    for (size_t i = 0; i < (size_t)n_states * (size_t)n_classes; ++i)
+      p_sm->next[i] = -1;
+
+    p_sm->n_nodes = 0;
+    p_sm->start = node_of(p_sm, p_node_state, p_state_node, p_nfa->start);
+  }
+
+  for (int node = 0; ok && node < p_sm->n_nodes; ++node)
+  {
+    int top = 0;
+    p_stack[top++] = (Path) { p_node_state[node], 0 };
+
+    while (ok && top > 0)
+    {
+      const Path path = p_stack[--top];
+      const NfaState * const p_s = &p_nfa->states[path.state];
+
+      if (p_seen[path.state] == node)
+      {
+        ok = false;
+        break;
+      }
+      p_seen[path.state] = node;
+
+      if (NFA_NO_ACCEPT != p_s->accept)
+      {
+        ok = !p_sm->accept[node];
+        p_sm->accept[node] = true;
+        p_sm->accept_actions[node] = path.actions;
+      }
+
+      if (NFA_SET == p_s->kind)
+      {
+        const int target = node_of(p_sm, p_node_state, p_state_node, p_s->out[0]);
+        for (int c = 0; ok && c < n_classes; ++c)
+        {
+          if (!byte_set_has(&p_nfa->sets[p_s->set], p_sm->classes.rep[c]))
+            continue;
+
+          const size_t idx = (size_t)node * (size_t)n_classes + (size_t)c;
+          ok = p_sm->next[idx] < 0;
+          p_sm->next[idx] = target;
+          p_sm->actions[idx] = path.actions;
+        }
+      }
+      else if (NFA_TAG == p_s->kind)
+      {
+        p_stack[top++] = (Path) { p_s->out[0],
+                                  path.actions | (uint32_t)1 << p_s->tag };
+      }
+      else
+      {
+        for (int k = 1; k >= 0; --k)
+          if (p_s->out[k] >= 0)
+            p_stack[top++] = (Path) { p_s->out[k], path.actions };
+      }
+    }
+  }
+
+  free(p_node_state);
+  free(p_state_node);
+  free(p_seen);
+  free(p_stack);
+  return ok;
+}
+
+static bool one_pass_match (const Submatcher * const p_sm,
+                            const char *s,
+                            size_t len,
+                            int *p_slots)
+{
+  const size_t n_classes = (size_t)p_sm->classes.n_classes;
+  int node = p_sm->start;
+
+  for (size_t i = 0; i < len; ++i)
+  {
+    const size_t idx = (size_t)node * n_classes
+                       + p_sm->classes.class_of[(unsigned char)s[i]];
+    if (p_sm->next[idx] < 0)
+      return false;
+
+    for (uint32_t a = p_sm->actions[idx]; 0 != a; a &= a - 1)
+      p_slots[__builtin_ctz(a)] = (int)i;
+    node = p_sm->next[idx];
+  }
+
+  if (!p_sm->accept[node])
+    return false;
+
+  for (uint32_t a = p_sm->accept_actions[node]; 0 != a; a &= a - 1)
+    p_slots[__builtin_ctz(a)] = (int)len;
+  return true;
+}
+
+/**** Pike VM. ****/
+
+typedef struct
+{
+  int   n;
+  int * states;
+  int * slots;  // n_slots entries per thread.
+} ThreadList;
+
+typedef struct
+{
+  int state; // -1 to restore slot to value.
+  int slot;
+  int value;
+} Job;
+
+// Add the threads reached from state s through epsilon moves, in priority
+// order, with the captures in p_caps.
+static void add_thread (const Submatcher * const p_sm,
+                        ThreadList * const p_list,
+                        int s,
+                        int *p_caps,
+                        int pos,
+                        Job *p_jobs,
+                        int *p_on_list,
+                        int step)
+{
+  const Nfa * const p_nfa = &p_sm->nfa;
+  const int n_slots = submatcher_n_slots(p_sm);
+  int top = 0;
+
+  p_jobs[top++] = (Job) { s, 0, 0 };
+  while (top > 0)
+  {
+    const Job job = p_jobs[--top];
+    if (job.state < 0)
+    {
+      p_caps[job.slot] = job.value;
+      continue;
+    }
+
+    if (p_on_list[job.state] == step)
+      continue;
+    p_on_list[job.state] = step;
+
+    const NfaState * const p_s = &p_nfa->states[job.state];
+    if (NFA_SET == p_s->kind || NFA_NO_ACCEPT != p_s->accept)
+    {
+      p_list->states[p_list->n] = job.state;
+      memcpy(&p_list->slots[(size_t)p_list->n * (size_t)n_slots], p_caps,
+             (size_t)n_slots * sizeof(int));
+      ++p_list->n;
+    }
+
+    if (NFA_TAG == p_s->kind)
+    {
+      p_jobs[top++] = (Job) { -1, p_s->tag, p_caps[p_s->tag] };
+      p_caps[p_s->tag] = pos;
+      p_jobs[top++] = (Job) { p_s->out[0], 0, 0 };
+    }
+    else if (NFA_EPSILON == p_s->kind)
+    {
+      for (int k = 1; k >= 0; --k)
+        if (p_s->out[k] >= 0)
+          p_jobs[top++] = (Job) { p_s->out[k], 0, 0 };
+    }
+  }
+}
+
+static bool pike_match (const Submatcher * const p_sm,
+                        const char *s,
+                        size_t len,
+                        int *p_slots)
+{
+  const Nfa * const p_nfa = &p_sm->nfa;
+  const size_t n = (size_t)p_nfa->n_states;
+  const size_t n_slots = (size_t)submatcher_n_slots(p_sm);
+  ThreadList lists[2];
+  bool matched = false;
+
+  // Each state pushes at most a restore job and a move job.
+  Job *p_jobs = malloc(3 * (n + 1) * sizeof(Job));
+  int *p_on_list = malloc(n * sizeof(int));
+  int *p_caps = malloc(n_slots * sizeof(int));
+  int *p_buffer = malloc(2 * n * (1 + n_slots) * sizeof(int));
+  if (NULL == p_jobs || NULL == p_on_list || NULL == p_caps || NULL == p_buffer)
+  {
+    free(p_jobs);
+    free(p_on_list);
+    free(p_caps);
+    free(p_buffer);
+    return false;
+  }
+
+  for (int k = 0; k < 2; ++k)
+  {
+    lists[k].n = 0;
+    lists[k].states = p_buffer + (size_t)k * n * (1 + n_slots);
+    lists[k].slots = lists[k].states + n;
+  }
+  for (size_t i = 0; i < n; ++i)
+    p_on_list[i] = -1;
+  for (size_t i = 0; i < n_slots; ++i)
+    p_caps[i] = -1;
+
+  ThreadList *p_current = &lists[0];
+  ThreadList *p_next = &lists[1];
+  add_thread(p_sm, p_current, p_nfa->start, p_caps, 0, p_jobs, p_on_list, 0);
+
+  for (size_t i = 0; i < len && p_current->n > 0; ++i)
+  {
+    const unsigned char c = (unsigned char)s[i];
+    p_next->n = 0;
+
+    for (int t = 0; t < p_current->n; ++t)
+    {
+      const NfaState * const p_s = &p_nfa->states[p_current->states[t]];
+      if (NFA_SET != p_s->kind || !byte_set_has(&p_nfa->sets[p_s->set], c))
+        continue;
+
+      memcpy(p_caps, &p_current->slots[(size_t)t * n_slots],
+             n_slots * sizeof(int));
+      add_thread(p_sm, p_next, p_s->out[0], p_caps, (int)i + 1,
+                 p_jobs, p_on_list, (int)i + 1);
+    }
+
+    ThreadList *p_tmp = p_current;
+    p_current = p_next;
+    p_next = p_tmp;
+  }
+
+  // The first accepting thread is the one with the highest priority.
+  for (int t = 0; t < p_current->n && !matched; ++t)
+  {
+    if (NFA_NO_ACCEPT != p_nfa->states[p_current->states[t]].accept)
+    {
+      memcpy(p_slots, &p_current->slots[(size_t)t * n_slots],
+             n_slots * sizeof(int));
+      matched = true;
+    }
+  }
+
+  free(p_jobs);
+  free(p_on_list);
+  free(p_caps);
+  free(p_buffer);
+  return matched;
+}
+
+/**** Interface. ****/
+
+bool submatcher_build (Submatcher * const p_sm, const Node * const p_root)
+{
+  memset(p_sm, 0, sizeof(Submatcher));
+
+  if (!nfa_from_tree_tagged(&p_sm->nfa, p_root))
+  {
+    submatcher_free(p_sm);
+    return false;
+  }
+
+  const Nfa * const p_nfa = &p_sm->nfa;
+  byte_classes_compute(&p_nfa, 1, &p_sm->classes);
+
+  p_sm->one_pass = build_one_pass(p_sm);
+  if (!p_sm->one_pass)
+  {
+    free(p_sm->next);
+    free(p_sm->actions);
+    free(p_sm->accept);
+    free(p_sm->accept_actions);
+    p_sm->next = NULL;
+    p_sm->actions = NULL;
+    p_sm->accept = NULL;
+    p_sm->accept_actions = NULL;
+    p_sm->n_nodes = 0;
+  }
+
+  return true;
+}
+
+// p_slots receives submatcher_n_slots() offsets when s matches.
+bool submatch (const Submatcher * const p_sm,
+               const char *s,
+               size_t len,
+               int *p_slots)
+{
+  const int n_slots = submatcher_n_slots(p_sm);
+
+  for (int i = 0; i < n_slots; ++i)
+    p_slots[i] = -1;
+
+  const bool matched = p_sm->one_pass ? one_pass_match(p_sm, s, len, p_slots)
+                                      : pike_match(p_sm, s, len, p_slots);
+  if (matched)
+  {
+    p_slots[0] = 0;
+    p_slots[1] = (int)len;
+  }
+  else
+  {
+    for (int i = 0; i < n_slots; ++i)
+      p_slots[i] = -1;
+  }
+
+  return matched;
+}
@@ -0,0 +1,50 @@
+/*
+ *  Submatch extraction: positions of the groups ( RE ) in a matched string.
+ *
+ *  Captures are computed in a single left-to-right scan, without
+ *  backtracking.  When the expression is one-pass, that is when at every
+ *  point of the input the next byte selects at most one way to continue, the
+ *  tagged NFA is turned into a one-pass DFA: one state per NFA position and
+ *  transitions that carry the capture slots to write.  Otherwise the tagged
+ *  NFA is simulated with one capture array per thread (Pike VM), threads
+ *  being kept in priority order: the left operand of + first, and one more
+ *  iteration of * first.  A group inside a star reports its last iteration.
+ *
+ *  Captures are given as pairs of byte offsets [start, end) per group,
+ *  starting with the whole string as group 0.  Groups that did not take
+ *  part in the match have both offsets set to -1.
+ */
+
+#pragma once
+
+#include "RE_automaton.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ONE_PASS_MAX_SLOTS 32 // Slots that fit in a transition's action mask.
+
+typedef struct
+{
+  Nfa           nfa;          // Tagged NFA.
+  ByteClasses   classes;
+  bool          one_pass;
+  int           n_nodes;      // One-pass DFA states.
+  int           start;
+  int32_t     * next;         // n_nodes * n_classes, -1 when there is none.
+  uint32_t    * actions;      // Slots written before reading the byte.
+  bool        * accept;
+  uint32_t    * accept_actions;
+} Submatcher;
+
+bool submatcher_build (Submatcher * const p_sm, const Node * const p_root);
+
+void submatcher_free (Submatcher * const p_sm);
+
+int submatcher_n_slots (const Submatcher * const p_sm);
+
+bool submatch (const Submatcher * const p_sm,
+               const char *s,
+               size_t len,
+               int *p_slots);
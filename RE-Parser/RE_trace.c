@@ -0,0 +1,157 @@
+/*
+ *  Trace of the phases of the pipeline, in the Chrome trace-event format.
+ */
+
+#include "RE_trace.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct
+{
+  uint64_t start;    // Nanoseconds on the monotonic clock.
+  uint64_t duration;
+  uint32_t phase;
+} TraceEvent;
+
+typedef struct TraceBuffer TraceBuffer;
+
+struct TraceBuffer
+{
+  TraceBuffer * p_next;
+  int           tid;
+  uint64_t      n_events; // Events recorded, the last ones are kept.
+  TraceEvent    events [TRACE_BUFFER_EVENTS];
+};
+
+static const char * const phase_names [N_TRACE_PHASES] =
+{
+  "read", "parse", "lower", "determinize", "minimize", "image", "match",
+  "output"
+};
+
+static atomic_bool               started; // Set by the first trace_start.
+static atomic_bool               enabled;
+static uint64_t                  origin; // Clock when tracing started.
+static char                    * trace_path;
+static _Atomic(TraceBuffer *)    buffers;
+static atomic_int                n_buffers;
+static _Thread_local TraceBuffer * p_local;
+
+static uint64_t clock_ns (void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+static bool add_buffer (void)
+{
+  TraceBuffer * const p_buffer = calloc(1, sizeof(TraceBuffer));
+  if (NULL == p_buffer)
+    return false;
+
+  p_buffer->tid = atomic_fetch_add(&n_buffers, 1);
+  p_buffer->p_next = atomic_load(&buffers);
+  while (!atomic_compare_exchange_weak(&buffers, &p_buffer->p_next, p_buffer))
+    ;
+
+  p_local = p_buffer;
+  return true;
+}
+
+// Write the kept events of every thread, oldest first, then free them.
+// Errors go to stderr, the process is exiting.
+static void dump (void)
+{
+  const long pid = (long)getpid();
+  FILE *fp = fopen(trace_path, "w");
+  bool first = true;
+
+  atomic_store(&enabled, false);
+  if (NULL == fp)
+    fprintf(stderr, "Cannot write the trace '%s'\n", trace_path);
+  else
+    fprintf(fp, "{\"traceEvents\": [");
+
+  for (TraceBuffer *p_buffer = atomic_exchange(&buffers, NULL);
+       NULL != p_buffer; )
+  {
+    const uint64_t n = p_buffer->n_events;
+    const uint64_t from = (n > TRACE_BUFFER_EVENTS) ? n - TRACE_BUFFER_EVENTS
+                                                    : 0;
+
+    for (uint64_t i = from; NULL != fp && i < n; ++i)
+    {
+      const TraceEvent * const p_event =
+        &p_buffer->events[i % TRACE_BUFFER_EVENTS];
+      fprintf(fp, "%s\n  {\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, "
+              "\"dur\": %.3f, \"pid\": %ld, \"tid\": %d}", first ? "" : ",",
+              phase_names[p_event->phase],
+              1e-3 * (double)(p_event->start - origin),
+              1e-3 * (double)p_event->duration, pid, p_buffer->tid);
+      first = false;
+    }
+
+    TraceBuffer * const p_next = p_buffer->p_next;
+    free(p_buffer);
+    p_buffer = p_next;
+  }
+
+  if (NULL != fp)
+  {
+    fprintf(fp, "\n], \"displayTimeUnit\": \"ms\"}\n");
+    if (0 != fclose(fp))
+      fprintf(stderr, "Cannot write the trace '%s'\n", trace_path);
+  }
+  free(trace_path);
+  trace_path = NULL;
+  p_local = NULL;
+}
+
+bool trace_start (const char *path)
+{
+  if (atomic_exchange(&started, true))
+    return false;
+
+  trace_path = strdup(path);
+  if (NULL == trace_path)
+  {
+    atomic_store(&started, false);
+    return false;
+  }
+
+  origin = clock_ns();
+  if (0 != atexit(dump))
+  {
+    free(trace_path);
+    trace_path = NULL;
+    atomic_store(&started, false);
+    return false;
+  }
+
+  atomic_store(&enabled, true);
+  return true;
+}
+
+uint64_t trace_begin (void)
+{
+  return atomic_load_explicit(&enabled, memory_order_relaxed) ? clock_ns() : 0;
+}
+
+void trace_end (TracePhase phase, uint64_t start)
+{
+  if (0 == start || (NULL == p_local && !add_buffer()))
+    return;
+
+  TraceEvent * const p_event =
+    &p_local->events[p_local->n_events % TRACE_BUFFER_EVENTS];
+  p_event->start = start;
+  p_event->duration = clock_ns() - start;
+  p_event->phase = (uint32_t)phase;
+  ++p_local->n_events;
+}
@@ -0,0 +1,41 @@
+/*
+ *  Trace of the phases of the pipeline, in the Chrome trace-event format.
+ *
+ *  Each thread records its phases in its own ring buffer, without locks: a
+ *  phase is one complete event, its start and its duration, and the oldest
+ *  events of a full buffer are overwritten.  A thread's buffer is pushed on a
+ *  global list with a compare-and-swap when it records its first event.
+ *
+ *  Tracing is off until trace_start, and then costs a clock read per phase
+ *  boundary.  The events are written as JSON when the process exits, to be
+ *  loaded in chrome://tracing or Perfetto: the threads must be done by then.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TRACE_BUFFER_EVENTS 65536 // Events kept per thread.
+
+typedef enum
+{
+  TRACE_READ,        // Input read.
+  TRACE_PARSE,       // Expression to parse tree.
+  TRACE_LOWER,       // Parse tree to NFA.
+  TRACE_DETERMINIZE, // NFA to full DFA.
+  TRACE_MINIMIZE,
+  TRACE_IMAGE,       // Automata to compiled image.
+  TRACE_MATCH,
+  TRACE_OUTPUT,      // Results printed or saved.
+  N_TRACE_PHASES
+} TracePhase;
+
+// Trace from now on, to the file written at exit.  Only the first call
+// starts the trace, later ones return false.
+bool trace_start (const char *path);
+
+// Start of a phase, 0 when tracing is off.
+uint64_t trace_begin (void);
+
+void trace_end (TracePhase phase, uint64_t start);